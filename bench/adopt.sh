@@ -0,0 +1,10 @@
+#!/bin/sh
+# Time windowchef takes at startup to manage the windows that already exist.
+
+. bench/xvfb.sh
+
+start_x
+write_rc
+for n in 100 500; do
+	./bench/windows -e "exec ./windowchef -c $tmp/rc" "$n"
+done
@@ -0,0 +1,43 @@
+#!/bin/sh
+# Commands per second from waitron: a batch over one connection, against a
+# waitron process per command over the socket and over client messages.
+
+. bench/xvfb.sh
+
+n=${N:-2000}
+
+# name, start and end in milliseconds
+report() {
+	awk -v name="$1" -v n="$n" -v ms="$(($3 - $2))" 'BEGIN {
+		printf "%-28s %8.0f commands/s\n", name, n * 1000 / (ms > 0 ? ms : 1)
+	}'
+}
+
+start_x
+write_rc
+start_wm
+
+i=0
+: > "$tmp/commands"
+while [ "$i" -lt "$n" ]; do
+	echo "wm_config border_width $((i % 2 + 1))" >> "$tmp/commands"
+	i=$((i + 1))
+done
+
+start=$(now_ms)
+./waitron -f "$tmp/commands"
+report "waitron -f" "$start" "$(now_ms)"
+
+start=$(now_ms)
+while read -r line; do
+	./waitron --wait $line
+done < "$tmp/commands"
+report "waitron --wait per command" "$start" "$(now_ms)"
+
+# nothing to wait for without the socket: a last command over it syncs
+start=$(now_ms)
+while read -r line; do
+	WINDOWCHEF_SOCKET="$tmp/none" ./waitron $line
+done < "$tmp/commands"
+./waitron --wait wm_stats > /dev/null
+report "waitron per client message" "$start" "$(now_ms)"
@@ -0,0 +1,119 @@
+/* Copyright (c) 2016-2019 Tudor Ioan Roman. All rights reserved. */
+/* Licensed under the ISC License. See the LICENSE file in the project root for full license information. */
+
+/*
+ * Time find_client lookups at 10 to 10000 managed windows: the hash table
+ * windowchef uses against the walk of the window list it replaced.
+ *
+ * make bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../helpers.h"
+
+/* lookups per run, fewer for the list walk at big sizes */
+#define LOOKUPS 10000000
+#define LIST_WORK 200000000
+
+struct fake_client {
+	uint32_t window;
+};
+
+static uint32_t rng = 2463534242U;
+
+static uint32_t
+xorshift(void)
+{
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return rng;
+}
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Window ids like an X server hands out: a resource base per client
+ * connection and a counter in the low bits.
+ */
+
+static uint32_t
+window_id(uint32_t i)
+{
+	return ((i % 64 + 1) << 21) | (i / 64 + 1);
+}
+
+static struct fake_client *
+list_find(struct list_item *list, uint32_t win)
+{
+	struct list_item *item;
+
+	for (item = list; item != NULL; item = item->next)
+		if (((struct fake_client *)item->data)->window == win)
+			return item->data;
+
+	return NULL;
+}
+
+static void
+run(uint32_t n)
+{
+	struct htable table = { NULL, NULL, 0, 0 };
+	struct list_item *list = NULL, *item;
+	struct fake_client *clients;
+	volatile uintptr_t sink = 0;
+	uint32_t i, list_lookups;
+	double start, hash_ns, list_ns;
+
+	clients = calloc(n, sizeof(struct fake_client));
+	if (clients == NULL)
+		exit(EXIT_FAILURE);
+
+	for (i = 0; i < n; i++) {
+		clients[i].window = window_id(i);
+		item = list_add_item(&list);
+		if (item == NULL || !htable_put(&table, clients[i].window, &clients[i]))
+			exit(EXIT_FAILURE);
+		item->data = &clients[i];
+	}
+
+	start = now();
+	for (i = 0; i < LOOKUPS; i++)
+		sink += (uintptr_t)htable_get(&table, window_id(xorshift() % n));
+	hash_ns = (now() - start) * 1e9 / LOOKUPS;
+
+	list_lookups = LIST_WORK / n < LOOKUPS ? LIST_WORK / n : LOOKUPS;
+	start = now();
+	for (i = 0; i < list_lookups; i++)
+		sink += (uintptr_t)list_find(list, window_id(xorshift() % n));
+	list_ns = (now() - start) * 1e9 / list_lookups;
+
+	printf("%6u clients: %8.1f ns hash table, %10.1f ns list\n",
+			n, hash_ns, list_ns);
+
+	(void)(sink);
+	list_delete_all_items(&list, false);
+	htable_free(&table);
+	free(clients);
+}
+
+int
+main(void)
+{
+	run(10);
+	run(100);
+	run(1000);
+	run(10000);
+
+	return EXIT_SUCCESS;
+}
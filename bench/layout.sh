@@ -0,0 +1,63 @@
+#!/bin/sh
+# Time to lay out 200 windows: one window_layout command, against a move and
+# a resize command per window, sent by a waitron each or in one batch.
+
+. bench/xvfb.sh
+
+n=${N:-200}
+rounds=${ROUNDS:-10}
+
+# name, start and end in milliseconds
+report() {
+	awk -v name="$1" -v r="$rounds" -v ms="$(($3 - $2))" 'BEGIN {
+		printf "%-32s %8.1f ms per layout\n", name, ms / r
+	}'
+}
+
+start_x
+write_rc
+start_wm
+start_windows "$n"
+
+# two layouts to switch between, as "<id> <x> <y> <width> <height>" lines
+for l in 0 1; do
+	awk -v l="$l" '{
+		i = NR - 1
+		printf "%s %d %d %d %d\n", $1, (i % 20) * 95 + l * 10,
+			int(i / 20) * 105 + l * 10, 80 + l * 10, 90 - l * 10
+	}' "$tmp/ids" > "$tmp/layout$l"
+	awk '{
+		printf "@%s window_move_absolute %s %s\n", $1, $2, $3
+		printf "@%s window_resize_absolute %s %s\n", $1, $4, $5
+	}' "$tmp/layout$l" > "$tmp/commands$l"
+	awk 'BEGIN { printf "window_layout" }
+		{ printf " %s %s %s %s %s 0", $1, $2, $3, $4, $5 }
+		END { printf "\n" }' "$tmp/layout$l" > "$tmp/bulk$l"
+done
+
+start=$(now_ms)
+r=0
+while [ "$r" -lt "$rounds" ]; do
+	while read -r line; do
+		./waitron $line
+	done < "$tmp/commands$((r % 2))"
+	r=$((r + 1))
+done
+./waitron --wait wm_stats > /dev/null
+report "a waitron per command" "$start" "$(now_ms)"
+
+start=$(now_ms)
+r=0
+while [ "$r" -lt "$rounds" ]; do
+	./waitron -f "$tmp/commands$((r % 2))"
+	r=$((r + 1))
+done
+report "commands in one batch" "$start" "$(now_ms)"
+
+start=$(now_ms)
+r=0
+while [ "$r" -lt "$rounds" ]; do
+	./waitron --wait $(cat "$tmp/bulk$((r % 2))")
+	r=$((r + 1))
+done
+report "one window_layout" "$start" "$(now_ms)"
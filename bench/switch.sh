@@ -0,0 +1,38 @@
+#!/bin/sh
+# Latency of showing and hiding a group of 100 windows, with each hide_mode.
+# The time of a waitron that does nothing is taken out.
+
+. bench/xvfb.sh
+
+n=${N:-100}
+switches=${SWITCHES:-50}
+
+# milliseconds taken by $switches runs of a waitron command
+run() {
+	start=$(now_ms)
+	i=0
+	while [ "$i" -lt "$switches" ]; do
+		./waitron --wait "$@" > /dev/null
+		i=$((i + 1))
+	done
+	echo $(($(now_ms) - start))
+}
+
+start_x
+for mode in unmap offscreen; do
+	write_rc "hide_mode $mode"
+	start_wm
+	start_windows "$n"
+	./waitron --wait @all group_add_window 1
+
+	base=$(run wm_stats)
+	# an even number of switches leaves the group shown
+	ms=$(run group_toggle 1)
+	awk -v mode="$mode" -v n="$n" -v s="$switches" -v ms="$ms" -v base="$base" 'BEGIN {
+		printf "hide_mode %-10s %8.2f ms per switch of %d windows\n",
+			mode, (ms - base) / s, n
+	}'
+
+	stop_windows
+	stop_wm
+done
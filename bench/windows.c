@@ -0,0 +1,211 @@
+/* Copyright (c) 2016-2019 Tudor Ioan Roman. All rights reserved. */
+/* Licensed under the ISC License. See the LICENSE file in the project root for full license information. */
+
+/*
+ * Create and map windows for the benchmarks that need an X server.
+ *
+ * windows [-w] <count>
+ *	Once the window manager manages them (with -w), print their ids, one
+ *	per line, and keep them until killed.
+ * windows -e <command> <count>
+ *	Create the windows first, then run <command>, usually the window
+ *	manager, print how long it took until it managed all of them, and
+ *	stop it.
+ */
+
+#include <xcb/xcb.h>
+
+#include <err.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* seconds to wait for the window manager */
+#define TIMEOUT 60
+
+static xcb_connection_t *conn;
+static xcb_screen_t *scr;
+static xcb_atom_t client_list;
+/* the windows we created, sorted for bsearch */
+static xcb_window_t *ours;
+static uint32_t nr_ours;
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+compare_windows(const void *a, const void *b)
+{
+	xcb_window_t x = *(const xcb_window_t *)a, y = *(const xcb_window_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Number of our windows in _NET_CLIENT_LIST. A window manager that ran
+ * before may have left ids of windows that are long gone there.
+ */
+
+static uint32_t
+managed_windows(void)
+{
+	xcb_get_property_reply_t *reply;
+	xcb_window_t *wins;
+	uint32_t len, i, n = 0;
+
+	reply = xcb_get_property_reply(conn, xcb_get_property(conn, false,
+				scr->root, client_list, XCB_ATOM_WINDOW, 0, UINT32_MAX / 4),
+			NULL);
+	if (reply == NULL)
+		return 0;
+
+	wins = xcb_get_property_value(reply);
+	len = xcb_get_property_value_length(reply) / sizeof(xcb_window_t);
+	for (i = 0; i < len; i++)
+		if (bsearch(&wins[i], ours, nr_ours, sizeof(xcb_window_t),
+					compare_windows) != NULL)
+			n++;
+	free(reply);
+
+	return n;
+}
+
+/*
+ * Wait until the window manager lists all our windows.
+ */
+
+static void
+wait_managed(void)
+{
+	xcb_generic_event_t *ev;
+	xcb_property_notify_event_t *e;
+
+	while (managed_windows() < nr_ours) {
+		do {
+			ev = xcb_wait_for_event(conn);
+			if (ev == NULL)
+				errx(EXIT_FAILURE, "lost the connection to the X server");
+			e = (xcb_property_notify_event_t *)ev;
+			if ((ev->response_type & ~0x80) == XCB_PROPERTY_NOTIFY
+					&& e->atom == client_list) {
+				free(ev);
+				break;
+			}
+			free(ev);
+		} while (true);
+	}
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: windows [-w] [-e command] count\n");
+	exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char **argv)
+{
+	xcb_intern_atom_reply_t *atom;
+	xcb_window_t *wins;
+	uint32_t values[2], count, i;
+	char *command = NULL;
+	bool wait = false;
+	double start;
+	pid_t pid = 0;
+	int opt, status;
+
+	while ((opt = getopt(argc, argv, "we:")) != -1) {
+		switch (opt) {
+		case 'w': wait = true; break;
+		case 'e': command = optarg; wait = true; break;
+		default: usage();
+		}
+	}
+	if (optind != argc - 1)
+		usage();
+	count = strtoul(argv[optind], NULL, 10);
+
+	conn = xcb_connect(NULL, NULL);
+	if (xcb_connection_has_error(conn))
+		errx(EXIT_FAILURE, "can't connect to the X server");
+	scr = xcb_setup_roots_iterator(xcb_get_setup(conn)).data;
+
+	atom = xcb_intern_atom_reply(conn, xcb_intern_atom(conn, false,
+				strlen("_NET_CLIENT_LIST"), "_NET_CLIENT_LIST"), NULL);
+	if (atom == NULL)
+		errx(EXIT_FAILURE, "can't intern _NET_CLIENT_LIST");
+	client_list = atom->atom;
+	free(atom);
+
+	/* other clients keep their own event masks on the root */
+	values[0] = XCB_EVENT_MASK_PROPERTY_CHANGE;
+	xcb_change_window_attributes(conn, scr->root, XCB_CW_EVENT_MASK, values);
+
+	wins = calloc(count, sizeof(xcb_window_t));
+	ours = calloc(count, sizeof(xcb_window_t));
+	if ((wins == NULL || ours == NULL) && count > 0)
+		err(EXIT_FAILURE, "calloc");
+
+	values[0] = scr->white_pixel;
+	values[1] = XCB_EVENT_MASK_STRUCTURE_NOTIFY;
+	for (i = 0; i < count; i++) {
+		wins[i] = xcb_generate_id(conn);
+		xcb_create_window(conn, XCB_COPY_FROM_PARENT, wins[i], scr->root,
+				(i * 37) % (scr->width_in_pixels - 200),
+				(i * 23) % (scr->height_in_pixels - 150), 200, 150, 0,
+				XCB_WINDOW_CLASS_INPUT_OUTPUT, scr->root_visual,
+				XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK, values);
+		xcb_map_window(conn, wins[i]);
+	}
+	memcpy(ours, wins, count * sizeof(xcb_window_t));
+	nr_ours = count;
+	qsort(ours, nr_ours, sizeof(xcb_window_t), compare_windows);
+	/* a round trip, so every window exists before the command starts */
+	free(xcb_get_input_focus_reply(conn, xcb_get_input_focus(conn), NULL));
+
+	alarm(TIMEOUT);
+	start = now();
+	if (command != NULL) {
+		pid = fork();
+		if (pid == -1)
+			err(EXIT_FAILURE, "fork");
+		if (pid == 0) {
+			execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+			_exit(127);
+		}
+	}
+
+	if (wait)
+		wait_managed();
+
+	if (command != NULL) {
+		printf("%u windows managed in %.1f ms\n", count, (now() - start) * 1e3);
+		fflush(stdout);
+		kill(pid, SIGTERM);
+		waitpid(pid, &status, 0);
+		xcb_disconnect(conn);
+		return EXIT_SUCCESS;
+	}
+
+	alarm(0);
+	for (i = 0; i < count; i++)
+		printf("0x%08x\n", wins[i]);
+	fflush(stdout);
+
+	/* the windows go away with the connection */
+	for (;;)
+		pause();
+}
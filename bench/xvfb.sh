@@ -0,0 +1,70 @@
+# Helpers for the benchmarks and tests that need an X server. Sourced from
+# the top of the tree by their scripts, which run windowchef and waitron from
+# there. Xvfb runs on a display of its own, $BENCH_DISPLAY, and everything
+# started here is stopped on exit. Timings need a date(1) that knows %N.
+
+: "${BENCH_DISPLAY:=:97}"
+tmp=$(mktemp -d)
+pids=
+export WINDOWCHEF_SOCKET="$tmp/sock"
+export WINDOWCHEF_STATE="$tmp/state"
+
+cleanup() {
+	for pid in $pids; do
+		kill "$pid" 2>/dev/null
+	done
+	wait 2>/dev/null
+	rm -rf "$tmp"
+}
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+now_ms() {
+	date +%s%N | cut -b1-13
+}
+
+start_x() {
+	Xvfb "$BENCH_DISPLAY" -screen 0 1920x1080x24 -nolisten tcp >/dev/null 2>&1 &
+	pids="$pids $!"
+	export DISPLAY="$BENCH_DISPLAY"
+	while [ ! -S "/tmp/.X11-unix/X${BENCH_DISPLAY#:}" ]; do
+		sleep 0.1
+	done
+}
+
+# the arguments are the lines of the configuration file
+write_rc() {
+	: > "$tmp/rc"
+	for line in "$@"; do
+		printf '%s\n' "$line" >> "$tmp/rc"
+	done
+}
+
+start_wm() {
+	./windowchef -c "$tmp/rc" 2>/dev/null &
+	wm_pid=$!
+	pids="$pids $wm_pid"
+	while [ ! -S "$WINDOWCHEF_SOCKET" ]; do
+		sleep 0.1
+	done
+}
+
+stop_wm() {
+	kill "$wm_pid" 2>/dev/null
+	wait "$wm_pid" 2>/dev/null
+}
+
+# create $1 windows and wait until they are managed; their ids are in $tmp/ids
+start_windows() {
+	./bench/windows -w "$1" > "$tmp/ids" &
+	windows_pid=$!
+	pids="$pids $windows_pid"
+	while [ "$(wc -l < "$tmp/ids")" -lt "$1" ]; do
+		sleep 0.05
+	done
+}
+
+stop_windows() {
+	kill "$windows_pid" 2>/dev/null
+	wait "$windows_pid" 2>/dev/null
+}
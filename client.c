@@ -11,415 +11,452 @@
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <unistd.h>
 
-#include "ipc.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "commands.h"
 #include "common.h"
-#include "types.h"
+#include "helpers.h"
+#include "ipc.h"
 
 xcb_connection_t *conn;
 xcb_screen_t *scr;
 
 int opterr = 0;
 
-static bool fn_offset(uint32_t *, int, char **);
-static bool fn_naturals(uint32_t *, int, char **);
-static bool fn_bool(uint32_t *, int, char **);
-static bool fn_config(uint32_t *, int, char **);
-static bool fn_hex(uint32_t *, int, char **);
-static bool fn_position(uint32_t *, int, char **);
-static bool fn_gap(uint32_t *, int, char **);
-static bool fn_direction(uint32_t *, int, char **);
-static bool fn_pac(uint32_t *, int, char **);
-static bool fn_mod(uint32_t *, int, char **);
-static bool fn_button(uint32_t *, int, char **);
-static bool fn_hack(uint32_t *, int, char **);
+/* replies read before more commands of a batch are sent */
+#define MAX_OUTSTANDING 1024
+
+/* the ipc socket, or -1 if commands go through X */
+static int ipc_fd = -1;
+static xcb_atom_t command_atom;
+/* socket requests whose reply hasn't been read yet */
+static uint32_t outstanding = 0;
+
+static int ipc_connect(void);
+static bool write_all(int, const void *, size_t);
+static bool read_all(int, void *, size_t);
+static bool read_message(int, struct ipc_reply_header *);
+static void print_event(int, struct ipc_reply_header *);
+static enum IPCStatus read_reply(int, uint32_t *);
+static bool wants_reply(enum IPCCommand);
+static void watch_events(void);
+static void open_connection(void);
+static void send_words(uint32_t, uint32_t *, int);
+static bool collect_replies(const char *);
+static bool close_connection(void);
+static int  send_command(int, char **, bool);
+static bool send_batch(FILE *, const char *);
 
 static void usage(char *, int);
 static void version(void);
 
-struct Command {
-	char *string_command;
-	enum IPCCommand command;
-	int argc;
-	bool (*handler)(uint32_t *, int , char **);
-};
+static void
+init_xcb(xcb_connection_t **conn)
+{
+	*conn = xcb_connect(NULL, NULL);
+	if (xcb_connection_has_error(*conn))
+		errx(EXIT_FAILURE, "unable to connect to X server");
+	scr = xcb_setup_roots_iterator(xcb_get_setup(*conn)).data;
+}
 
-struct ConfigEntry {
-	char *key;
-	enum IPCConfig config;
-	int argc;
-	bool (*handler)(uint32_t *, int, char **);
-};
+static xcb_atom_t
+get_atom(char *name)
+{
+	xcb_intern_atom_cookie_t cookie = xcb_intern_atom(conn, 0, strlen(name), name);
+	xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(conn, cookie, NULL);
 
-/* vim-tabularize is cool, i swear */
-static struct Command c[] = {
-	{ "window_move"               , IPCWindowMove            ,  2 , fn_offset   } ,
-	{ "window_move_absolute"      , IPCWindowMoveAbsolute    ,  2 , fn_offset   } ,
-	{ "window_resize"             , IPCWindowResize          ,  2 , fn_offset   } ,
-	{ "window_resize_absolute"    , IPCWindowResizeAbsolute  ,  2 , fn_naturals } ,
-	{ "window_maximize"           , IPCWindowMaximize        ,  0 , NULL        } ,
-	{ "window_unmaximize"         , IPCWindowUnmaximize      ,  0 , NULL        } ,
-	{ "window_hor_maximize"       , IPCWindowHorMaximize     ,  0 , NULL        } ,
-	{ "window_ver_maximize"       , IPCWindowVerMaximize     ,  0 , NULL        } ,
-	{ "window_monocle"            , IPCWindowMonocle         ,  0 , NULL        } ,
-	{ "window_close"              , IPCWindowClose           ,  0 , NULL        } ,
-	{ "window_put_in_grid"        , IPCWindowPutInGrid       ,  6 , fn_hack     } ,
-	{ "window_move_in_grid"       , IPCWindowMoveInGrid      ,  2 , fn_offset   } ,
-	{ "window_resize_in_grid"     , IPCWindowResizeInGrid    ,  2 , fn_offset   } ,
-	{ "window_snap"               , IPCWindowSnap            ,  1 , fn_position } ,
-	{ "window_cycle"              , IPCWindowCycle           ,  0 , NULL        } ,
-	{ "window_rev_cycle"          , IPCWindowRevCycle        ,  0 , NULL        } ,
-	{ "window_cycle_in_group"     , IPCWindowCycleInGroup    ,  0 , NULL        } ,
-	{ "window_rev_cycle_in_group" , IPCWindowRevCycleInGroup ,  0 , NULL        } ,
-	{ "window_cardinal_focus"     , IPCWindowCardinalFocus   ,  1 , fn_direction} ,
-	{ "window_focus"              , IPCWindowFocus           ,  1 , fn_hex      } ,
-	{ "window_focus_last"         , IPCWindowFocusLast       ,  0 , NULL        } ,
-	{ "group_add_window"          , IPCGroupAddWindow        ,  1 , fn_naturals } ,
-	{ "group_remove_window"       , IPCGroupRemoveWindow     ,  0 , NULL        } ,
-	{ "group_remove_all_windows"  , IPCGroupRemoveAllWindows ,  1 , fn_naturals } ,
-	{ "group_activate"            , IPCGroupActivate         ,  1 , fn_naturals } ,
-	{ "group_deactivate"          , IPCGroupDeactivate       ,  1 , fn_naturals } ,
-	{ "group_toggle"              , IPCGroupToggle           ,  1 , fn_naturals } ,
-	{ "group_activate_specific"   , IPCGroupActivateSpecific ,  1 , fn_naturals } ,
-	{ "wm_quit"                   , IPCWMQuit                ,  1 , fn_naturals } ,
-	{ "wm_config"                 , IPCWMConfig              , -1 , fn_config   },
-};
+	if (!reply)
+		return XCB_ATOM_STRING;
 
-static struct ConfigEntry configs[] = {
-	{ "border_width"        , IPCConfigBorderWidth       , 1 , fn_naturals },
-	{ "color_focused"       , IPCConfigColorFocused      , 1 , fn_hex      },
-	{ "color_unfocused"     , IPCConfigColorUnfocused    , 1 , fn_hex      },
-	{ "internal_border_width", IPCConfigInternalBorderWidth, 1 , fn_naturals },
-	{ "internal_color_focused", IPCConfigInternalColorFocused, 1 , fn_hex },
-	{ "internal_color_unfocused", IPCConfigInternalColorUnfocused, 1 , fn_hex },
-	{ "gap_width"           , IPCConfigGapWidth          , 2 , fn_gap      },
-	{ "grid_gap_width"      , IPCConfigGridGapWidth      , 1 , fn_naturals },
-	{ "cursor_position"     , IPCConfigCursorPosition    , 1 , fn_position },
-	{ "groups_nr"           , IPCConfigGroupsNr          , 1 , fn_naturals },
-	{ "enable_sloppy_focus" , IPCConfigEnableSloppyFocus , 1 , fn_bool     },
-	{ "enable_resize_hints" , IPCConfigEnableResizeHints , 1 , fn_bool     },
-	{ "sticky_windows"      , IPCConfigStickyWindows     , 1 , fn_bool     },
-	{ "enable_borders"      , IPCConfigEnableBorders     , 1 , fn_bool     },
-	{ "enable_last_window_focusing", IPCConfigEnableLastWindowFocusing, 1 , fn_bool },
-	{ "apply_settings"      , IPCConfigApplySettings     , 1 , fn_bool     },
-	{ "replay_click_on_focus" , IPCConfigReplayClickOnFocus, 1, fn_bool    },
-	{ "pointer_actions"     , IPCConfigPointerActions    , 3 , fn_pac      },
-	{ "pointer_modifier"    , IPCConfigPointerModifier   , 1 , fn_mod      },
-	{ "click_to_focus"      , IPCConfigClickToFocus      , 1 , fn_button   },
+	return reply->atom;
+}
+
+static const char *status_messages[NR_IPC_STATUSES] = {
+	"ok",
+	"unknown command",
+	"bad arguments",
+	"no such window",
+	"command failed",
 };
 
 /*
- * An offset is a pair of two signed integers.
- *
- * data[0], data[1] - if 1, then the number in negative
- * data[2], data[3] - the actual numbers, unsigned
+ * Connect to the ipc socket of windowchef. Returns -1 if it isn't there.
  */
-static bool
-fn_offset(uint32_t *data, int argc, char **argv)
+
+static int
+ipc_connect(void)
 {
-	int i = 0;
-	do {
-		errno = 0;
-		int c = strtol(argv[i], NULL, 10);
-		if (c >= 0)
-			data[i] = IPC_MUL_PLUS;
-		else
-			data[i] = IPC_MUL_MINUS;
-		data[i + 2] = abs(c);
-		i++;
-	} while (i < argc && errno == 0);
+	struct sockaddr_un addr;
+	int fd;
 
-	if (errno != 0)
-		return false;
-	else
-		return true;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (!get_ipc_socket_path(addr.sun_path, sizeof(addr.sun_path)))
+		return -1;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1)
+		return -1;
+
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
 }
 
 static bool
-fn_naturals(uint32_t *data, int argc, char **argv)
+write_all(int fd, const void *data, size_t len)
 {
-	int i = 0;
-	do {
-		errno = 0;
-		data[i] = strtol(argv[i], NULL, 10);
-		i++;
-	} while (i < argc && errno == 0);
-
-	if (errno != 0)
-		return false;
+	const char *p = data;
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(fd, p, len);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		len -= n;
+	}
+
 	return true;
 }
 
 static bool
-fn_bool(uint32_t *data, int argc, char **argv) {
-	int i = 0;
-	char *arg;
-	do {
-		arg = argv[i];
-		if (strcasecmp(argv[i], "true")       == 0
-					|| strcasecmp(arg, "yes") == 0
-					|| strcasecmp(arg, "t")   == 0
-					|| strcasecmp(arg, "y")   == 0
-					|| strcasecmp(arg, "1")   == 0)
-				data[i] = true;
-		else
-			data[i] = false;
-		i++;
-	} while (i < argc);
+read_all(int fd, void *data, size_t len)
+{
+	char *p = data;
+	ssize_t n;
+
+	while (len > 0) {
+		n = read(fd, p, len);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		len -= n;
+	}
 
 	return true;
 }
 
-static bool
-fn_config(uint32_t *data, int argc, char **argv) {
-	char *key;
-	bool status;
-	int i;
-
-	key = argv[0];
+/*
+ * Read the header of a message. Returns false at end of file.
+ */
 
-	i = 0;
-	while (i < NR_IPC_CONFIGS && strcmp(key, configs[i].key) != 0)
-		i++;
+static bool
+read_message(int fd, struct ipc_reply_header *rep)
+{
+	return read_all(fd, rep, sizeof(*rep));
+}
 
-	if (i < NR_IPC_CONFIGS) {
-		if (configs[i].argc != argc - 1)
-			errx(EXIT_FAILURE, "too many or not enough arguments. Want: %d", configs[i].argc);
-		data[0] = configs[i].config;
-		status = (configs[i].handler)(data + 1, argc - 1, argv + 1);
+/*
+ * Print an event as a line: its name, the window, group or output it is
+ * about and a geometry for the events that have one.
+ */
 
-		if (status == false)
-			errx(EXIT_FAILURE, "malformed input");
-	} else {
-		errx(EXIT_FAILURE, "no such config key");
+static void
+print_event(int fd, struct ipc_reply_header *rep)
+{
+	struct ipc_event event;
+
+	memset(&event, 0, sizeof(event));
+	if (rep->length != sizeof(event) || !read_all(fd, &event, sizeof(event)))
+		errx(EXIT_FAILURE, "malformed event from %s", __NAME__);
+	if (rep->status >= NR_IPC_EVENTS)
+		return;
+
+	if (event.dropped > 0)
+		printf("dropped %u\n", event.dropped);
+
+	switch (rep->status) {
+	case IPCEventGroupActivate:
+	case IPCEventGroupDeactivate:
+		printf("%s %u\n", event_names[rep->status], event.id);
+		break;
+	case IPCEventGeometry:
+	case IPCEventMonitorAdd:
+	case IPCEventMonitorRemove:
+		printf("%s 0x%08x %d %d %u %u\n", event_names[rep->status], event.id,
+				event.x, event.y, event.width, event.height);
+		break;
+	default:
+		printf("%s 0x%08x\n", event_names[rep->status], event.id);
+		break;
 	}
-	return true;
+	fflush(stdout);
 }
 
-static bool
-fn_hex(uint32_t *data, int argc, char **argv)
-{
-	int i = 0;
-	do {
-		errno = 0;
-		data[i] = strtol(argv[i], NULL, 16);
-		i++;
-	} while (i < argc && errno == 0);
-
-	if (errno != 0)
-		return false;
-	else
-		return true;
-}
+/*
+ * Read one reply, print its payload and return its status. Events
+ * arriving before it are printed too.
+ */
 
-static bool
-fn_direction(uint32_t *data, int argc, char **argv)
+static enum IPCStatus
+read_reply(int fd, uint32_t *id)
 {
-	char *pos = argv[0];
-	enum direction dir_sel;
-
-	if (strcasecmp(pos, "up") == 0 || strcasecmp(pos, "north") == 0)
-		dir_sel = NORTH;
-	else if (strcasecmp(pos, "down") == 0 || strcasecmp(pos, "south") == 0)
-		dir_sel = SOUTH;
-	else if (strcasecmp(pos, "left") == 0 || strcasecmp(pos, "west") == 0)
-		dir_sel = WEST;
-	else if (strcasecmp(pos, "right") == 0 || strcasecmp(pos, "east") == 0)
-		dir_sel = EAST;
-	else
-		return false;
+	struct ipc_reply_header rep;
+	char buf[4096];
+	size_t n;
+
+	for (;;) {
+		if (!read_message(fd, &rep))
+			errx(EXIT_FAILURE, "lost the connection to %s", __NAME__);
+		if (rep.id != IPC_EVENT_ID)
+			break;
+		print_event(fd, &rep);
+	}
 
-	(void)(argc);
-	data[0] = dir_sel;
+	while (rep.length > 0) {
+		n = rep.length < sizeof(buf) ? rep.length : sizeof(buf);
+		if (!read_all(fd, buf, n))
+			errx(EXIT_FAILURE, "lost the connection to %s", __NAME__);
+		fwrite(buf, 1, n, stdout);
+		rep.length -= n;
+	}
 
-	return true;
+	if (id != NULL)
+		*id = rep.id;
+	return rep.status < NR_IPC_STATUSES ? rep.status : IPCStatusFailed;
 }
 
-static bool
-fn_pac(uint32_t *data, int argc, char **argv)
-{
-	for (int i = 0; i < argc; i++) {
-		char *pac = argv[i];
-		if (strcasecmp(pac, "nothing") == 0)
-			data[i] = POINTER_ACTION_NOTHING;
-		else if (strcasecmp(pac, "focus") == 0)
-			data[i] = POINTER_ACTION_FOCUS;
-		else if (strcasecmp(pac, "move") == 0)
-			data[i] = POINTER_ACTION_MOVE;
-		else if (strcasecmp(pac, "resize_corner") == 0)
-			data[i] = POINTER_ACTION_RESIZE_CORNER;
-		else if (strcasecmp(pac, "resize_side") == 0)
-			data[i] = POINTER_ACTION_RESIZE_SIDE;
-		else
-			return false;
-	}
+/*
+ * Commands whose reply carries data worth waiting for.
+ */
 
-	return true;
-}
 static bool
-fn_mod(uint32_t *data, int argc, char **argv)
+wants_reply(enum IPCCommand command)
 {
-	(void)(argc);
-	if (strcasecmp(argv[0], "alt") == 0)
-		data[0] = XCB_MOD_MASK_1;
-	else if (strcasecmp(argv[0], "super") == 0)
-		data[0] = XCB_MOD_MASK_4;
-	else
+	switch (command) {
+	case IPCWMStats:
+	case IPCSubscribe:
+	case IPCQueryFocused:
+	case IPCQueryClients:
+	case IPCQueryMonitors:
+	case IPCQueryGroups:
+	case IPCQueryFocusHistory:
+		return true;
+	default:
 		return false;
-
-	return true;
+	}
 }
-static bool
-fn_button(uint32_t *data, int argc, char **argv)
+
+/*
+ * Print events until windowchef goes away.
+ */
+
+static void
+watch_events(void)
 {
-	char *btn = argv[0];
-	(void)(argc);
-
-	if (strcasecmp(btn, "left") == 0)
-		data[0] = 1;
-	else if (strcasecmp(btn, "middle") == 0)
-		data[0] = 2;
-	else if (strcasecmp(btn, "right") == 0)
-		data[0] = 3;
-	else if (strcasecmp(btn, "none") == 0)
-		data[0] = UINT32_MAX;
-	else if (strcasecmp(btn, "any") == 0)
-		data[0] = 0;
-	else
-		return false;
+	struct ipc_reply_header rep;
 
-	return true;
+	while (read_message(ipc_fd, &rep))
+		if (rep.id == IPC_EVENT_ID)
+			print_event(ipc_fd, &rep);
 }
 
 /*
- * Kinda like fn_naturals, but each two numbers are put as 16-bit numbers
- * in one uint32_t.
+ * Use the socket if windowchef listens on it, the X server otherwise.
  */
-static bool
-fn_hack(uint32_t *data, int argc, char **argv)
+
+static void
+open_connection(void)
 {
-	int i = 0, j = 0;
-	unsigned long d;
-	do {
-		errno = 0;
-		d = strtoul(argv[i], NULL, 10);
-		if (i % 2 == 0) {
-			data[j] = d << 16U;
-		} else {
-			data[j] |= d;
-			j++;
-		}
-		i++;
-	} while (i < argc && errno == 0);
+	ipc_fd = ipc_connect();
+	if (ipc_fd != -1)
+		return;
 
-	if (i % 2 == 1 || errno != 0)
-		return false;
-	return true;
+	init_xcb(&conn);
+	command_atom = get_atom(ATOM_COMMAND);
 }
 
-static bool
-fn_position(uint32_t *data, int argc, char **argv)
+/*
+ * Queue a command. Nothing is waited for: socket replies are read by
+ * collect_replies and X errors are checked by close_connection.
+ */
+
+static void
+send_words(uint32_t id, uint32_t *data, int words)
 {
-	char *pos = argv[0];
-	enum position snap_pos;
-
-	if (strcasecmp(pos, "topleft") == 0)
-		snap_pos = TOP_LEFT;
-	else if (strcasecmp(pos, "topright") == 0)
-		snap_pos = TOP_RIGHT;
-	else if (strcasecmp(pos, "bottomleft") == 0)
-		snap_pos = BOTTOM_LEFT;
-	else if (strcasecmp(pos, "bottomright") == 0)
-		snap_pos = BOTTOM_RIGHT;
-	else if (strcasecmp(pos, "middle") == 0 ||
-			strcasecmp(pos, "center") == 0 ||
-			strcasecmp(pos, "centre") == 0)
-		snap_pos = CENTER;
-	else if (strcasecmp(pos, "left") == 0)
-		snap_pos = LEFT;
-	else if (strcasecmp(pos, "bottom") == 0)
-		snap_pos = BOTTOM;
-	else if (strcasecmp(pos, "top") == 0)
-		snap_pos = TOP;
-	else if (strcasecmp(pos, "right") == 0)
-		snap_pos = RIGHT;
-	else if (strcasecmp(pos, "all") == 0)
-		snap_pos = ALL;
-	else
-		return false;
+	xcb_client_message_event_t msg;
+	struct ipc_request_header req;
+
+	if (ipc_fd != -1) {
+		req.length = words - 1;
+		req.id = id;
+		req.command = data[0];
+		if (!write_all(ipc_fd, &req, sizeof(req))
+				|| !write_all(ipc_fd, data + 1, req.length * sizeof(uint32_t)))
+			errx(EXIT_FAILURE, "couldn't send the command to %s", __NAME__);
+		outstanding++;
+		return;
+	}
 
-	(void)(argc);
-	data[0] = snap_pos;
+	/* spawn is refused over client messages, any X client can send them */
+	if (words > MIN_COMMAND_WORDS || data[0] == IPCSpawn)
+		errx(EXIT_FAILURE, "%s needs the socket of %s",
+				commands[data[0]].string_command, __NAME__);
+	if (data[1 + IPC_MIN_ARGS] != IPCTargetFocused)
+		errx(EXIT_FAILURE, "a target needs the socket of %s", __NAME__);
 
-	return true;
+	memset(&msg, 0, sizeof(msg));
+	msg.response_type = XCB_CLIENT_MESSAGE;
+	msg.window = scr->root;
+	msg.type = command_atom;
+	msg.format = 32;
+	memcpy(msg.data.data32, data, (IPC_MIN_ARGS + 1) * sizeof(uint32_t));
+
+	xcb_send_event(conn, false, scr->root,
+			XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT, (char *)&msg);
 }
 
+/*
+ * Read the replies of every request sent so far. Reply ids are the line
+ * numbers of the commands if name is not NULL.
+ */
+
 static bool
-fn_gap(uint32_t *data, int argc, char **argv)
+collect_replies(const char *name)
 {
-	(void)(argc);
-	bool status = true;
-
-	status = status && fn_position(data, 1, argv);
-	status = status && fn_naturals(data + 1, 1, argv + 1);
+	enum IPCStatus status;
+	bool ok = true;
+	uint32_t id;
+
+	for (; outstanding > 0; outstanding--) {
+		status = read_reply(ipc_fd, &id);
+		if (status == IPCStatusOk)
+			continue;
+		if (name != NULL)
+			warnx("%s:%u: %s", name, id, status_messages[status]);
+		else
+			warnx("%s", status_messages[status]);
+		ok = false;
+	}
 
-	return status;
+	return ok;
 }
 
-static void
-init_xcb(xcb_connection_t **conn)
-{
-	*conn = xcb_connect(NULL, NULL);
-	if (xcb_connection_has_error(*conn))
-		errx(EXIT_FAILURE, "unable to connect to X server");
-	scr = xcb_setup_roots_iterator(xcb_get_setup(*conn)).data;
-}
+/*
+ * Wait until windowchef got everything. Returns false if X reported
+ * errors.
+ */
 
-static xcb_atom_t
-get_atom(char *name)
+static bool
+close_connection(void)
 {
-	xcb_intern_atom_cookie_t cookie = xcb_intern_atom(conn, 0, strlen(name), name);
-	xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(conn, cookie, NULL);
+	xcb_generic_event_t *ev;
+	bool ok = true;
 
-	if (!reply)
-		return XCB_ATOM_STRING;
+	if (ipc_fd != -1) {
+		close(ipc_fd);
+		ipc_fd = -1;
+		return true;
+	}
 
-	return reply->atom;
+	/* one round trip for all the unchecked sends */
+	free(xcb_get_input_focus_reply(conn, xcb_get_input_focus(conn), NULL));
+	while ((ev = xcb_poll_for_event(conn)) != NULL) {
+		if (ev->response_type == 0) {
+			warnx("X error %d", ((xcb_generic_error_t *)ev)->error_code);
+			ok = false;
+		}
+		free(ev);
+	}
+
+	return ok;
 }
 
-static void
-send_command(struct Command *c, int argc, char **argv)
+/*
+ * Send one command. With wait, block until windowchef has applied it and
+ * return its status instead of just success or failure.
+ */
+
+static int
+send_command(int argc, char **argv, bool wait)
 {
-	xcb_client_message_event_t msg;
-	xcb_client_message_data_t data;
-	xcb_generic_error_t *err;
-	xcb_void_cookie_t cookie;
-	bool status = true;
+	enum IPCStatus status = IPCStatusOk;
+	uint32_t data[COMMAND_WORDS];
+	int words;
+
+	if ((words = encode_command(data, argc, argv)) == 0)
+		return EXIT_FAILURE;
+
+	open_connection();
+	if (ipc_fd == -1 && data[0] == IPCSubscribe)
+		errx(EXIT_FAILURE, "subscribe needs the socket of %s", __NAME__);
+	if (ipc_fd == -1 && wait)
+		errx(EXIT_FAILURE, "--wait needs the socket of %s", __NAME__);
+	send_words(1, data, words);
+	if (ipc_fd != -1 && (wait || wants_reply(data[0]))) {
+		/* sent once the requests of the command reached the X server */
+		status = read_reply(ipc_fd, NULL);
+		outstanding--;
+		if (status != IPCStatusOk)
+			warnx("%s", status_messages[status]);
+	}
+	if (status == IPCStatusOk && data[0] == IPCSubscribe)
+		watch_events();
+	if (!close_connection() && status == IPCStatusOk)
+		status = IPCStatusFailed;
+
+	if (wait)
+		return status;
+	return status == IPCStatusOk ? EXIT_SUCCESS : EXIT_FAILURE;
+}
 
-	msg.response_type = XCB_CLIENT_MESSAGE;
-	msg.type = get_atom(ATOM_COMMAND);
-	msg.format = 32;
-	data.data32[0] = c->command;
-	if (c->handler != NULL)
-		status = (c->handler)(data.data32 + 1, argc, argv);
-	if (status == false)
-		errx(EXIT_FAILURE, "malformed input");
+/*
+ * Send every command of a file, one per line, over one connection.
+ * Empty lines and comments, see split_line, are ignored.
+ */
 
-	msg.data = data;
+static bool
+send_batch(FILE *f, const char *name)
+{
+	uint32_t data[COMMAND_WORDS];
+	char *argv[MAX_COMMAND_ARGS];
+	char *line = NULL;
+	size_t size = 0;
+	uint32_t lineno = 0;
+	bool ok = true;
+	int argc, words;
+
+	open_connection();
+	while (getline(&line, &size, f) != -1) {
+		lineno++;
+		argc = split_line(line, argv, MAX_COMMAND_ARGS);
+		if (argc == 0)
+			continue;
+
+		if ((words = encode_command(data, argc, argv)) == 0) {
+			warnx("%s:%u: skipped", name, lineno);
+			ok = false;
+			continue;
+		}
+		send_words(lineno, data, words);
 
-	cookie = xcb_send_event_checked(conn, false, scr->root,
-			XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT, (char *)&msg);
+		/* don't let replies pile up in windowchef */
+		if (outstanding >= MAX_OUTSTANDING)
+			ok = collect_replies(name) && ok;
+	}
+	free(line);
 
-	err = xcb_request_check(conn, cookie);
-	if (err)
-		fprintf(stderr, "oops %d\n", err->error_code);
-	xcb_flush(conn);
+	if (ipc_fd != -1)
+		ok = collect_replies(name) && ok;
+	return close_connection() && ok;
 }
 
 static void
 usage(char *name, int status)
 {
-	fprintf(stderr, "Usage: %s [-h|-v] <command> [args...]\n", name);
+	fprintf(stderr, "Usage: %s [-h|-v] [-w|--wait] <command> [args...]\n", name);
+	fprintf(stderr, "       %s - | -f <file>\n", name);
 	exit(status);
 }
 
@@ -436,9 +473,9 @@ version(void)
 
 int main(int argc, char **argv)
 {
-	int i;
-	int command_argc;
-	char **command_argv;
+	FILE *f;
+	bool ok, wait = false;
+	int status;
 
 	if (argc == 1) {
 		usage(argv[0], EXIT_FAILURE);
@@ -449,32 +486,33 @@ int main(int argc, char **argv)
 			version();
 	}
 
-	init_xcb(&conn);
-
-	/* argc - program name - command to send */
-	command_argc = argc - 2;
-	command_argv = argv + 2;
-
-	i = 0;
-	while (i < NR_IPC_COMMANDS && strcmp(argv[1], c[i].string_command) != 0)
-		i++;
-
-	if (i < NR_IPC_COMMANDS) {
-		if (c[i].argc != -1) {
-			if (command_argc < c[i].argc)
-				errx(EXIT_FAILURE, "not enough arguments");
-			else if (command_argc > c[i].argc)
-				warnx("too many arguments");
-		}
-		if (c[i].argc == -1 || command_argc == c[i].argc)
-			send_command(&c[i], command_argc, command_argv);
-
+	if (strcmp(argv[1], "-") == 0) {
+		ok = send_batch(stdin, "stdin");
+	} else if (strcmp(argv[1], "-f") == 0) {
+		if (argc != 3)
+			usage(argv[0], EXIT_FAILURE);
+		f = fopen(argv[2], "r");
+		if (f == NULL)
+			err(EXIT_FAILURE, "%s", argv[2]);
+		ok = send_batch(f, argv[2]);
+		fclose(f);
 	} else {
-		errx(EXIT_FAILURE, "no such command");
+		if (strcmp(argv[1], "-w") == 0 || strcmp(argv[1], "--wait") == 0) {
+			if (argc == 2)
+				usage(argv[0], EXIT_FAILURE);
+			wait = true;
+			argc--;
+			argv++;
+		}
+		/* program name is not part of the command */
+		status = send_command(argc - 1, argv + 1, wait);
+		if (conn != NULL)
+			xcb_disconnect(conn);
+		return status;
 	}
 
 	if (conn != NULL)
 		xcb_disconnect(conn);
 
-	return 0;
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
 }
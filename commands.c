@@ -0,0 +1,1055 @@
+/* Copyright (c) 2016-2019 Tudor Ioan Roman. All rights reserved. */
+/* Licensed under the ISC License. See the LICENSE file in the project root for full license information. */
+
+#include <xcb/xcb.h>
+#include <X11/keysym.h>
+#include <X11/XF86keysym.h>
+
+#include <ctype.h>
+#include <err.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "commands.h"
+#include "ipc.h"
+#include "types.h"
+
+static bool fn_offset(uint32_t *, int, char **);
+static bool fn_naturals(uint32_t *, int, char **);
+static bool fn_bool(uint32_t *, int, char **);
+static bool fn_config(uint32_t *, int, char **);
+static bool fn_hex(uint32_t *, int, char **);
+static bool fn_position(uint32_t *, int, char **);
+static bool fn_gap(uint32_t *, int, char **);
+static bool fn_direction(uint32_t *, int, char **);
+static bool fn_pac(uint32_t *, int, char **);
+static bool fn_mod(uint32_t *, int, char **);
+static bool fn_hide_mode(uint32_t *, int, char **);
+static bool fn_button(uint32_t *, int, char **);
+static bool fn_hack(uint32_t *, int, char **);
+static bool fn_events(uint32_t *, int, char **);
+static bool fn_opt_bool(uint32_t *, int, char **);
+static bool parse_target(uint32_t *, char *);
+static bool fn_layout(uint32_t *, int, char **);
+static bool parse_key(struct key *, char *);
+static bool parse_chain(uint32_t *, char *);
+static bool fn_bind(uint32_t *, int, char **);
+static bool fn_unbind(uint32_t *, int, char **);
+static bool fn_spawn(uint32_t *, int, char **);
+static bool fn_rule(uint32_t *, int, char **);
+static int command_words(uint32_t *);
+
+/* vim-tabularize is cool, i swear */
+struct Command commands[] = {
+	{ "window_move"               , IPCWindowMove            ,  2 , fn_offset   } ,
+	{ "window_move_absolute"      , IPCWindowMoveAbsolute    ,  2 , fn_offset   } ,
+	{ "window_resize"             , IPCWindowResize          ,  2 , fn_offset   } ,
+	{ "window_resize_absolute"    , IPCWindowResizeAbsolute  ,  2 , fn_naturals } ,
+	{ "window_maximize"           , IPCWindowMaximize        ,  0 , NULL        } ,
+	{ "window_unmaximize"         , IPCWindowUnmaximize      ,  0 , NULL        } ,
+	{ "window_hor_maximize"       , IPCWindowHorMaximize     ,  0 , NULL        } ,
+	{ "window_ver_maximize"       , IPCWindowVerMaximize     ,  0 , NULL        } ,
+	{ "window_monocle"            , IPCWindowMonocle         ,  0 , NULL        } ,
+	{ "window_close"              , IPCWindowClose           ,  0 , NULL        } ,
+	{ "window_put_in_grid"        , IPCWindowPutInGrid       ,  6 , fn_hack     } ,
+	{ "window_move_in_grid"       , IPCWindowMoveInGrid      ,  2 , fn_offset   } ,
+	{ "window_resize_in_grid"     , IPCWindowResizeInGrid    ,  2 , fn_offset   } ,
+	{ "window_snap"               , IPCWindowSnap            ,  1 , fn_position } ,
+	{ "window_cycle"              , IPCWindowCycle           ,  0 , NULL        } ,
+	{ "window_rev_cycle"          , IPCWindowRevCycle        ,  0 , NULL        } ,
+	{ "window_cycle_in_group"     , IPCWindowCycleInGroup    ,  0 , NULL        } ,
+	{ "window_rev_cycle_in_group" , IPCWindowRevCycleInGroup ,  0 , NULL        } ,
+	{ "window_cardinal_focus"     , IPCWindowCardinalFocus   ,  1 , fn_direction} ,
+	{ "window_focus"              , IPCWindowFocus           ,  1 , fn_hex      } ,
+	{ "window_focus_last"         , IPCWindowFocusLast       ,  0 , NULL        } ,
+	{ "group_add_window"          , IPCGroupAddWindow        ,  1 , fn_naturals } ,
+	{ "group_remove_window"       , IPCGroupRemoveWindow     ,  0 , NULL        } ,
+	{ "group_remove_all_windows"  , IPCGroupRemoveAllWindows ,  1 , fn_naturals } ,
+	{ "group_activate"            , IPCGroupActivate         ,  1 , fn_naturals } ,
+	{ "group_deactivate"          , IPCGroupDeactivate       ,  1 , fn_naturals } ,
+	{ "group_toggle"              , IPCGroupToggle           ,  1 , fn_naturals } ,
+	{ "group_activate_specific"   , IPCGroupActivateSpecific ,  1 , fn_naturals } ,
+	{ "wm_quit"                   , IPCWMQuit                ,  1 , fn_naturals } ,
+	{ "wm_config"                 , IPCWMConfig              , -1 , fn_config   },
+	{ "wm_stats"                  , IPCWMStats               ,  0 , NULL        },
+	{ "subscribe"                 , IPCSubscribe             , -1 , fn_events   },
+	{ "query_focused"             , IPCQueryFocused          ,  0 , NULL        },
+	{ "query_clients"             , IPCQueryClients          ,  0 , NULL        },
+	{ "query_monitors"            , IPCQueryMonitors         ,  0 , NULL        },
+	{ "query_groups"              , IPCQueryGroups           ,  0 , NULL        },
+	{ "query_focus_history"       , IPCQueryFocusHistory     ,  0 , NULL        },
+	{ "transaction_begin"         , IPCTransactionBegin      , -1 , fn_opt_bool },
+	{ "transaction_commit"        , IPCTransactionCommit     ,  0 , NULL        },
+	{ "transaction_abort"         , IPCTransactionAbort      ,  0 , NULL        },
+	{ "window_layout"             , IPCWindowLayout          , -1 , fn_layout   },
+	{ "bind"                      , IPCBind                  , -1 , fn_bind     },
+	{ "unbind"                    , IPCUnbind                , -1 , fn_unbind   },
+	{ "spawn"                     , IPCSpawn                 , -1 , fn_spawn    },
+	{ "rule"                      , IPCRule                  , -1 , fn_rule     },
+	{ "unrule"                    , IPCUnrule                ,  0 , NULL        },
+};
+
+struct ConfigEntry configs[] = {
+	{ "border_width"        , IPCConfigBorderWidth       , 1 , fn_naturals },
+	{ "color_focused"       , IPCConfigColorFocused      , 1 , fn_hex      },
+	{ "color_unfocused"     , IPCConfigColorUnfocused    , 1 , fn_hex      },
+	{ "internal_border_width", IPCConfigInternalBorderWidth, 1 , fn_naturals },
+	{ "internal_color_focused", IPCConfigInternalColorFocused, 1 , fn_hex },
+	{ "internal_color_unfocused", IPCConfigInternalColorUnfocused, 1 , fn_hex },
+	{ "gap_width"           , IPCConfigGapWidth          , 2 , fn_gap      },
+	{ "grid_gap_width"      , IPCConfigGridGapWidth      , 1 , fn_naturals },
+	{ "cursor_position"     , IPCConfigCursorPosition    , 1 , fn_position },
+	{ "groups_nr"           , IPCConfigGroupsNr          , 1 , fn_naturals },
+	{ "enable_sloppy_focus" , IPCConfigEnableSloppyFocus , 1 , fn_bool     },
+	{ "enable_resize_hints" , IPCConfigEnableResizeHints , 1 , fn_bool     },
+	{ "sticky_windows"      , IPCConfigStickyWindows     , 1 , fn_bool     },
+	{ "enable_borders"      , IPCConfigEnableBorders     , 1 , fn_bool     },
+	{ "enable_last_window_focusing", IPCConfigEnableLastWindowFocusing, 1 , fn_bool },
+	{ "apply_settings"      , IPCConfigApplySettings     , 1 , fn_bool     },
+	{ "replay_click_on_focus" , IPCConfigReplayClickOnFocus, 1, fn_bool    },
+	{ "pointer_actions"     , IPCConfigPointerActions    , 3 , fn_pac      },
+	{ "pointer_modifier"    , IPCConfigPointerModifier   , 1 , fn_mod      },
+	{ "click_to_focus"      , IPCConfigClickToFocus      , 1 , fn_button   },
+	{ "enable_frame_pacing" , IPCConfigEnableFramePacing , 1 , fn_bool     },
+	{ "hide_mode"           , IPCConfigHideMode          , 1 , fn_hide_mode },
+};
+
+static struct {
+	char *name;
+	uint16_t mask;
+} modifier_names[] = {
+	{ "shift"   , XCB_MOD_MASK_SHIFT   },
+	{ "lock"    , XCB_MOD_MASK_LOCK    },
+	{ "ctrl"    , XCB_MOD_MASK_CONTROL },
+	{ "control" , XCB_MOD_MASK_CONTROL },
+	{ "alt"     , XCB_MOD_MASK_1       },
+	{ "mod1"    , XCB_MOD_MASK_1       },
+	{ "mod2"    , XCB_MOD_MASK_2       },
+	{ "mod3"    , XCB_MOD_MASK_3       },
+	{ "super"   , XCB_MOD_MASK_4       },
+	{ "mod4"    , XCB_MOD_MASK_4       },
+	{ "mod5"    , XCB_MOD_MASK_5       },
+};
+
+/* keys whose names aren't a single character or F1 to F35 */
+static struct {
+	char *name;
+	xcb_keysym_t keysym;
+} keysym_names[] = {
+	{ "Return"               , XK_Return                  },
+	{ "Escape"               , XK_Escape                  },
+	{ "Tab"                  , XK_Tab                     },
+	{ "space"                , XK_space                   },
+	{ "BackSpace"            , XK_BackSpace               },
+	{ "Delete"               , XK_Delete                  },
+	{ "Insert"               , XK_Insert                  },
+	{ "Home"                 , XK_Home                    },
+	{ "End"                  , XK_End                     },
+	{ "Prior"                , XK_Prior                   },
+	{ "Page_Up"              , XK_Page_Up                 },
+	{ "Next"                 , XK_Next                    },
+	{ "Page_Down"            , XK_Page_Down               },
+	{ "Left"                 , XK_Left                    },
+	{ "Right"                , XK_Right                   },
+	{ "Up"                   , XK_Up                      },
+	{ "Down"                 , XK_Down                    },
+	{ "Print"                , XK_Print                   },
+	{ "Pause"                , XK_Pause                   },
+	{ "Menu"                 , XK_Menu                    },
+	{ "minus"                , XK_minus                   },
+	{ "plus"                 , XK_plus                    },
+	{ "equal"                , XK_equal                   },
+	{ "comma"                , XK_comma                   },
+	{ "period"               , XK_period                  },
+	{ "colon"                , XK_colon                   },
+	{ "semicolon"            , XK_semicolon               },
+	{ "slash"                , XK_slash                   },
+	{ "backslash"            , XK_backslash               },
+	{ "apostrophe"           , XK_apostrophe              },
+	{ "grave"                , XK_grave                   },
+	{ "bracketleft"          , XK_bracketleft             },
+	{ "bracketright"         , XK_bracketright            },
+	{ "XF86AudioRaiseVolume" , XF86XK_AudioRaiseVolume    },
+	{ "XF86AudioLowerVolume" , XF86XK_AudioLowerVolume    },
+	{ "XF86AudioMute"        , XF86XK_AudioMute           },
+	{ "XF86AudioPlay"        , XF86XK_AudioPlay           },
+	{ "XF86AudioStop"        , XF86XK_AudioStop           },
+	{ "XF86AudioNext"        , XF86XK_AudioNext           },
+	{ "XF86AudioPrev"        , XF86XK_AudioPrev           },
+	{ "XF86MonBrightnessUp"  , XF86XK_MonBrightnessUp     },
+	{ "XF86MonBrightnessDown", XF86XK_MonBrightnessDown   },
+};
+
+/* in the order of enum IPCWindowType */
+static char *window_type_names[] = {
+	"normal",
+	"dialog",
+	"utility",
+	"splash",
+	"menu",
+	"notification",
+};
+
+static struct {
+	char *name;
+	enum IPCWindowState state;
+} rule_states[] = {
+	{ "maximized"  , IPCStateMaxed    },
+	{ "hmaximized" , IPCStateHMaxed   },
+	{ "vmaximized" , IPCStateVMaxed   },
+	{ "monocle"    , IPCStateMonocled },
+};
+
+char *event_names[] = {
+	"focus",
+	"map",
+	"unmap",
+	"destroy",
+	"geometry",
+	"group_activate",
+	"group_deactivate",
+	"monitor_add",
+	"monitor_remove",
+};
+
+/*
+ * An offset is a pair of two signed integers.
+ *
+ * data[0], data[1] - if 1, then the number in negative
+ * data[2], data[3] - the actual numbers, unsigned
+ */
+static bool
+fn_offset(uint32_t *data, int argc, char **argv)
+{
+	int i = 0;
+	do {
+		errno = 0;
+		int c = strtol(argv[i], NULL, 10);
+		if (c >= 0)
+			data[i] = IPC_MUL_PLUS;
+		else
+			data[i] = IPC_MUL_MINUS;
+		data[i + 2] = abs(c);
+		i++;
+	} while (i < argc && errno == 0);
+
+	if (errno != 0)
+		return false;
+	else
+		return true;
+}
+
+static bool
+fn_naturals(uint32_t *data, int argc, char **argv)
+{
+	int i = 0;
+	do {
+		errno = 0;
+		data[i] = strtol(argv[i], NULL, 10);
+		i++;
+	} while (i < argc && errno == 0);
+
+	if (errno != 0)
+		return false;
+	return true;
+}
+
+static bool
+fn_bool(uint32_t *data, int argc, char **argv) {
+	int i = 0;
+	char *arg;
+	do {
+		arg = argv[i];
+		if (strcasecmp(argv[i], "true")       == 0
+					|| strcasecmp(arg, "yes") == 0
+					|| strcasecmp(arg, "t")   == 0
+					|| strcasecmp(arg, "y")   == 0
+					|| strcasecmp(arg, "1")   == 0)
+				data[i] = true;
+		else
+			data[i] = false;
+		i++;
+	} while (i < argc);
+
+	return true;
+}
+
+/*
+ * Commands that act on a window, the focused one unless a target is given.
+ */
+bool
+command_takes_target(uint32_t command)
+{
+	switch (command) {
+	case IPCWindowMove:
+	case IPCWindowMoveAbsolute:
+	case IPCWindowResize:
+	case IPCWindowResizeAbsolute:
+	case IPCWindowMaximize:
+	case IPCWindowUnmaximize:
+	case IPCWindowHorMaximize:
+	case IPCWindowVerMaximize:
+	case IPCWindowMonocle:
+	case IPCWindowClose:
+	case IPCWindowPutInGrid:
+	case IPCWindowMoveInGrid:
+	case IPCWindowResizeInGrid:
+	case IPCWindowSnap:
+	case IPCGroupAddWindow:
+	case IPCGroupRemoveWindow:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * A target is @<window id>, @group:<group_nr>, @all or @focused.
+ *
+ * data[0] - IPCTarget
+ * data[1] - window id or group number
+ */
+static bool
+parse_target(uint32_t *data, char *arg)
+{
+	char *end;
+
+	if (strcasecmp(arg, "@focused") == 0) {
+		data[0] = IPCTargetFocused;
+		return true;
+	} else if (strcasecmp(arg, "@all") == 0) {
+		data[0] = IPCTargetAll;
+		return true;
+	} else if (strncasecmp(arg, "@group:", 7) == 0) {
+		data[0] = IPCTargetGroup;
+		arg += 7;
+	} else {
+		data[0] = IPCTargetWindow;
+		arg += 1;
+	}
+
+	errno = 0;
+	data[1] = strtoul(arg, &end, 0);
+	return errno == 0 && *arg != '\0' && *end == '\0';
+}
+
+/*
+ * Groups of six words: window id, x, y, width, height and flags.
+ *
+ * data[0] - number of records
+ * data[1...] - the records, IPC_LAYOUT_RECORD words each
+ */
+static bool
+fn_layout(uint32_t *data, int argc, char **argv)
+{
+	char *end;
+	int i;
+
+	if (argc % IPC_LAYOUT_RECORD != 0
+			|| argc / IPC_LAYOUT_RECORD > IPC_MAX_LAYOUT_RECORDS)
+		return false;
+
+	data[0] = argc / IPC_LAYOUT_RECORD;
+	for (i = 0; i < argc; i++) {
+		errno = 0;
+		/* ids and flags may be hexadecimal */
+		if (i % IPC_LAYOUT_RECORD == 0 || i % IPC_LAYOUT_RECORD == 5)
+			data[i + 1] = strtoul(argv[i], &end, 0);
+		else
+			data[i + 1] = strtol(argv[i], &end, 10);
+		if (errno != 0 || *argv[i] == '\0' || *end != '\0')
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * A key is modifiers and a key name joined with +, like super+shift+Return.
+ * Key names are single characters, F1 to F35, the names in keysym_names
+ * or keysyms in hexadecimal.
+ */
+static bool
+parse_key(struct key *key, char *arg)
+{
+	char *name, *end;
+	size_t i;
+	unsigned long n;
+
+	key->modifiers = 0;
+	while ((end = strchr(arg, '+')) != NULL && end[1] != '\0') {
+		*end = '\0';
+		for (i = 0; i < sizeof(modifier_names) / sizeof(modifier_names[0]); i++)
+			if (strcasecmp(arg, modifier_names[i].name) == 0)
+				break;
+		if (i == sizeof(modifier_names) / sizeof(modifier_names[0]))
+			return false;
+		key->modifiers |= modifier_names[i].mask;
+		arg = end + 1;
+	}
+	name = arg;
+
+	if (name[0] != '\0' && name[1] == '\0' && isgraph((unsigned char)name[0])) {
+		/* keys are looked up unshifted */
+		key->keysym = tolower((unsigned char)name[0]);
+		return true;
+	}
+	if ((name[0] == 'F' || name[0] == 'f') && isdigit((unsigned char)name[1])) {
+		errno = 0;
+		n = strtoul(name + 1, &end, 10);
+		if (errno == 0 && *end == '\0' && n >= 1 && n <= 35) {
+			key->keysym = XK_F1 + n - 1;
+			return true;
+		}
+	}
+	for (i = 0; i < sizeof(keysym_names) / sizeof(keysym_names[0]); i++) {
+		if (strcasecmp(name, keysym_names[i].name) == 0) {
+			key->keysym = keysym_names[i].keysym;
+			return true;
+		}
+	}
+	if (strncasecmp(name, "0x", 2) == 0) {
+		errno = 0;
+		key->keysym = strtoul(name, &end, 16);
+		return errno == 0 && name[2] != '\0' && *end == '\0' && key->keysym != 0;
+	}
+
+	return false;
+}
+
+/*
+ * A chain is keys separated by commas, pressed one after the other. The
+ * keys before a colon instead of a comma are the lock of the binding.
+ *
+ * data[0] - number of keys
+ * data[1] - lock
+ * data[2...] - modifiers and keysym of every key
+ */
+static bool
+parse_chain(uint32_t *data, char *arg)
+{
+	struct key key;
+	char buf[128], sep;
+	size_t len;
+
+	data[0] = data[1] = 0;
+	do {
+		len = strcspn(arg, ",:");
+		sep = arg[len];
+		if (len == 0 || len >= sizeof(buf) || data[0] == IPC_MAX_CHORD)
+			return false;
+		memcpy(buf, arg, len);
+		buf[len] = '\0';
+		if (!parse_key(&key, buf))
+			return false;
+
+		data[2 + 2 * data[0]] = key.modifiers;
+		data[3 + 2 * data[0]] = key.keysym;
+		data[0]++;
+		if (sep == ':') {
+			if (data[1] != 0)
+				return false;
+			data[1] = data[0];
+		}
+		arg += len + (sep != '\0');
+	} while (sep != '\0');
+
+	/* a lock needs keys to repeat after it */
+	return data[1] < data[0];
+}
+
+/*
+ * A chain and the command it runs, encoded like a command line.
+ *
+ * data[0...IPC_BIND_HEADER - 1] - the chain
+ * data[IPC_BIND_HEADER] - number of words of the command
+ * data[IPC_BIND_HEADER + 1...] - the command and its arguments
+ */
+static bool
+fn_bind(uint32_t *data, int argc, char **argv)
+{
+	uint32_t command[COMMAND_WORDS];
+	int words;
+
+	if (argc < 2 || !parse_chain(data, argv[0])) {
+		if (argc > 0)
+			warnx("malformed key chain: %s", argv[0]);
+		return false;
+	}
+
+	words = encode_command(command, argc - 1, argv + 1);
+	if (words == 0)
+		return false;
+	if (command[0] == IPCBind || command[0] == IPCUnbind) {
+		warnx("bindings can't bind keys");
+		return false;
+	}
+	if (words > IPC_MAX_ARGS - IPC_BIND_HEADER - 1) {
+		warnx("bound command too long");
+		return false;
+	}
+
+	data[IPC_BIND_HEADER] = words;
+	memcpy(data + IPC_BIND_HEADER + 1, command, words * sizeof(uint32_t));
+	return true;
+}
+
+/*
+ * A chain, or nothing to remove every binding. Encoded like bind without
+ * a command.
+ */
+static bool
+fn_unbind(uint32_t *data, int argc, char **argv)
+{
+	if (argc == 0) {
+		data[0] = 0;
+		return true;
+	}
+
+	return argc == 1 && parse_chain(data, argv[0]);
+}
+
+/*
+ * A shell command, the arguments joined with spaces.
+ *
+ * data[0] - length in bytes
+ * data[1...] - the command, padded with zeroes
+ */
+static bool
+fn_spawn(uint32_t *data, int argc, char **argv)
+{
+	char *cmd = (char *)(data + 1);
+	size_t len = 0, max = (IPC_MAX_ARGS - 1) * sizeof(uint32_t) - 1;
+	size_t n;
+	int i;
+
+	if (argc == 0)
+		return false;
+
+	for (i = 0; i < argc; i++) {
+		n = strlen(argv[i]);
+		if (len + (i > 0) + n > max) {
+			warnx("command too long");
+			return false;
+		}
+		if (i > 0)
+			cmd[len++] = ' ';
+		memcpy(cmd + len, argv[i], n);
+		len += n;
+	}
+
+	data[0] = len;
+	return true;
+}
+
+/*
+ * Properties to match and actions, each as key=value. Matched: class,
+ * instance, role, type and transient. Actions: group, geometry as
+ * WxH+X+Y, grid as the arguments of window_put_in_grid separated by
+ * commas, state and focus. See enum IPCRuleWord for the encoding.
+ */
+static bool
+fn_rule(uint32_t *data, int argc, char **argv)
+{
+	char *strings[3] = { "", "", "" };
+	char *key, *value, *end, *dst;
+	size_t i, len, bytes = 0;
+	uint32_t grid[6];
+	int n, j;
+
+	memset(data, 0, IPC_RULE_HEADER * sizeof(uint32_t));
+	for (j = 0; j < argc; j++) {
+		key = argv[j];
+		value = strchr(key, '=');
+		if (value == NULL || value[1] == '\0') {
+			warnx("expected key=value: %s", key);
+			return false;
+		}
+		*value++ = '\0';
+
+		if (strcmp(key, "class") == 0) {
+			data[IPCRuleWordMatch] |= IPCRuleClass;
+			strings[0] = value;
+		} else if (strcmp(key, "instance") == 0) {
+			data[IPCRuleWordMatch] |= IPCRuleInstance;
+			strings[1] = value;
+		} else if (strcmp(key, "role") == 0) {
+			data[IPCRuleWordMatch] |= IPCRuleRole;
+			strings[2] = value;
+		} else if (strcmp(key, "type") == 0) {
+			for (i = 0; i < NR_IPC_WINDOW_TYPES; i++)
+				if (strcasecmp(value, window_type_names[i]) == 0)
+					break;
+			if (i == NR_IPC_WINDOW_TYPES)
+				return false;
+			data[IPCRuleWordMatch] |= IPCRuleType;
+			data[IPCRuleWordType] = i;
+		} else if (strcmp(key, "transient") == 0) {
+			data[IPCRuleWordMatch] |= IPCRuleTransient;
+			fn_bool(data + IPCRuleWordTransient, 1, &value);
+		} else if (strcmp(key, "group") == 0) {
+			errno = 0;
+			data[IPCRuleWordGroup] = strtoul(value, &end, 10);
+			if (errno != 0 || *end != '\0' || data[IPCRuleWordGroup] == 0)
+				return false;
+			data[IPCRuleWordActions] |= IPCRuleGroup;
+		} else if (strcmp(key, "geometry") == 0) {
+			n = 0;
+			if (sscanf(value, "%ux%u%d%d%n", &data[IPCRuleWordGeometry + 2],
+						&data[IPCRuleWordGeometry + 3],
+						(int *)&data[IPCRuleWordGeometry],
+						(int *)&data[IPCRuleWordGeometry + 1], &n) != 4
+					|| value[n] != '\0')
+				return false;
+			data[IPCRuleWordActions] |= IPCRuleGeometry;
+		} else if (strcmp(key, "grid") == 0) {
+			/* the span defaults to one cell */
+			grid[4] = grid[5] = 1;
+			for (i = 0; i < 6; i++) {
+				errno = 0;
+				grid[i] = strtoul(value, &end, 10);
+				if (errno != 0 || end == value)
+					return false;
+				value = end;
+				if (*value == '\0')
+					break;
+				if (*value++ != ',')
+					return false;
+			}
+			if ((i != 3 && i != 5) || grid[0] == 0 || grid[1] == 0
+					|| grid[2] >= grid[0] || grid[3] >= grid[1])
+				return false;
+			memcpy(data + IPCRuleWordGrid, grid, sizeof(grid));
+			data[IPCRuleWordActions] |= IPCRuleGrid;
+		} else if (strcmp(key, "state") == 0) {
+			for (i = 0; i < sizeof(rule_states) / sizeof(rule_states[0]); i++)
+				if (strcasecmp(value, rule_states[i].name) == 0)
+					break;
+			if (i == sizeof(rule_states) / sizeof(rule_states[0]))
+				return false;
+			data[IPCRuleWordState] = rule_states[i].state;
+			data[IPCRuleWordActions] |= IPCRuleState;
+		} else if (strcmp(key, "focus") == 0) {
+			fn_bool(data + IPCRuleWordFocus, 1, &value);
+			data[IPCRuleWordActions] |= IPCRuleFocus;
+		} else {
+			warnx("unknown rule key: %s", key);
+			return false;
+		}
+	}
+
+	if (data[IPCRuleWordActions] == 0) {
+		warnx("a rule needs an action");
+		return false;
+	}
+
+	dst = (char *)(data + IPC_RULE_HEADER);
+	for (i = 0; i < 3; i++) {
+		len = strlen(strings[i]) + 1;
+		if (bytes + len > (IPC_MAX_ARGS - IPC_RULE_HEADER) * sizeof(uint32_t)) {
+			warnx("rule too long");
+			return false;
+		}
+		memcpy(dst + bytes, strings[i], len);
+		bytes += len;
+	}
+	data[IPCRuleWordStrings] = (bytes + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+	return true;
+}
+
+/*
+ * A single optional boolean, false if missing.
+ */
+static bool
+fn_opt_bool(uint32_t *data, int argc, char **argv)
+{
+	if (argc == 0) {
+		data[0] = false;
+		return true;
+	}
+
+	return argc == 1 && fn_bool(data, argc, argv);
+}
+
+static bool
+fn_config(uint32_t *data, int argc, char **argv) {
+	char *key;
+	bool status;
+	int i;
+
+	if (argc < 1) {
+		warnx("missing config key");
+		return false;
+	}
+	key = argv[0];
+
+	i = 0;
+	while (i < NR_IPC_CONFIGS && strcmp(key, configs[i].key) != 0)
+		i++;
+
+	if (i < NR_IPC_CONFIGS) {
+		if (configs[i].argc != argc - 1) {
+			warnx("too many or not enough arguments. Want: %d", configs[i].argc);
+			return false;
+		}
+		data[0] = configs[i].config;
+		status = (configs[i].handler)(data + 1, argc - 1, argv + 1);
+	} else {
+		warnx("no such config key");
+		return false;
+	}
+	return status;
+}
+
+static bool
+fn_hex(uint32_t *data, int argc, char **argv)
+{
+	int i = 0;
+	do {
+		errno = 0;
+		data[i] = strtol(argv[i], NULL, 16);
+		i++;
+	} while (i < argc && errno == 0);
+
+	if (errno != 0)
+		return false;
+	else
+		return true;
+}
+
+static bool
+fn_direction(uint32_t *data, int argc, char **argv)
+{
+	char *pos = argv[0];
+	enum direction dir_sel;
+
+	if (strcasecmp(pos, "up") == 0 || strcasecmp(pos, "north") == 0)
+		dir_sel = NORTH;
+	else if (strcasecmp(pos, "down") == 0 || strcasecmp(pos, "south") == 0)
+		dir_sel = SOUTH;
+	else if (strcasecmp(pos, "left") == 0 || strcasecmp(pos, "west") == 0)
+		dir_sel = WEST;
+	else if (strcasecmp(pos, "right") == 0 || strcasecmp(pos, "east") == 0)
+		dir_sel = EAST;
+	else
+		return false;
+
+	(void)(argc);
+	data[0] = dir_sel;
+
+	return true;
+}
+
+static bool
+fn_pac(uint32_t *data, int argc, char **argv)
+{
+	for (int i = 0; i < argc; i++) {
+		char *pac = argv[i];
+		if (strcasecmp(pac, "nothing") == 0)
+			data[i] = POINTER_ACTION_NOTHING;
+		else if (strcasecmp(pac, "focus") == 0)
+			data[i] = POINTER_ACTION_FOCUS;
+		else if (strcasecmp(pac, "move") == 0)
+			data[i] = POINTER_ACTION_MOVE;
+		else if (strcasecmp(pac, "resize_corner") == 0)
+			data[i] = POINTER_ACTION_RESIZE_CORNER;
+		else if (strcasecmp(pac, "resize_side") == 0)
+			data[i] = POINTER_ACTION_RESIZE_SIDE;
+		else
+			return false;
+	}
+
+	return true;
+}
+static bool
+fn_mod(uint32_t *data, int argc, char **argv)
+{
+	(void)(argc);
+	if (strcasecmp(argv[0], "alt") == 0)
+		data[0] = XCB_MOD_MASK_1;
+	else if (strcasecmp(argv[0], "super") == 0)
+		data[0] = XCB_MOD_MASK_4;
+	else
+		return false;
+
+	return true;
+}
+static bool
+fn_hide_mode(uint32_t *data, int argc, char **argv)
+{
+	(void)(argc);
+	if (strcasecmp(argv[0], "unmap") == 0)
+		data[0] = HIDE_UNMAP;
+	else if (strcasecmp(argv[0], "offscreen") == 0)
+		data[0] = HIDE_OFFSCREEN;
+	else
+		return false;
+
+	return true;
+}
+static bool
+fn_button(uint32_t *data, int argc, char **argv)
+{
+	char *btn = argv[0];
+	(void)(argc);
+
+	if (strcasecmp(btn, "left") == 0)
+		data[0] = 1;
+	else if (strcasecmp(btn, "middle") == 0)
+		data[0] = 2;
+	else if (strcasecmp(btn, "right") == 0)
+		data[0] = 3;
+	else if (strcasecmp(btn, "none") == 0)
+		data[0] = UINT32_MAX;
+	else if (strcasecmp(btn, "any") == 0)
+		data[0] = 0;
+	else
+		return false;
+
+	return true;
+}
+
+/*
+ * Event classes to subscribe to. No class means all of them.
+ *
+ * data[0] - mask of 1 << IPCEvent bits
+ */
+static bool
+fn_events(uint32_t *data, int argc, char **argv)
+{
+	int i, j;
+
+	if (argc == 0) {
+		data[0] = (1 << NR_IPC_EVENTS) - 1;
+		return true;
+	}
+
+	data[0] = 0;
+	for (i = 0; i < argc; i++) {
+		if (strcasecmp(argv[i], "all") == 0) {
+			data[0] |= (1 << NR_IPC_EVENTS) - 1;
+		} else if (strcasecmp(argv[i], "group") == 0) {
+			data[0] |= 1 << IPCEventGroupActivate | 1 << IPCEventGroupDeactivate;
+		} else if (strcasecmp(argv[i], "monitor") == 0) {
+			data[0] |= 1 << IPCEventMonitorAdd | 1 << IPCEventMonitorRemove;
+		} else {
+			for (j = 0; j < NR_IPC_EVENTS; j++)
+				if (strcasecmp(argv[i], event_names[j]) == 0)
+					break;
+			if (j == NR_IPC_EVENTS)
+				return false;
+			data[0] |= 1 << j;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Kinda like fn_naturals, but each two numbers are put as 16-bit numbers
+ * in one uint32_t.
+ */
+static bool
+fn_hack(uint32_t *data, int argc, char **argv)
+{
+	int i = 0, j = 0;
+	unsigned long d;
+	do {
+		errno = 0;
+		d = strtoul(argv[i], NULL, 10);
+		if (i % 2 == 0) {
+			data[j] = d << 16U;
+		} else {
+			data[j] |= d;
+			j++;
+		}
+		i++;
+	} while (i < argc && errno == 0);
+
+	if (i % 2 == 1 || errno != 0)
+		return false;
+	return true;
+}
+
+static bool
+fn_position(uint32_t *data, int argc, char **argv)
+{
+	char *pos = argv[0];
+	enum position snap_pos;
+
+	if (strcasecmp(pos, "topleft") == 0)
+		snap_pos = TOP_LEFT;
+	else if (strcasecmp(pos, "topright") == 0)
+		snap_pos = TOP_RIGHT;
+	else if (strcasecmp(pos, "bottomleft") == 0)
+		snap_pos = BOTTOM_LEFT;
+	else if (strcasecmp(pos, "bottomright") == 0)
+		snap_pos = BOTTOM_RIGHT;
+	else if (strcasecmp(pos, "middle") == 0 ||
+			strcasecmp(pos, "center") == 0 ||
+			strcasecmp(pos, "centre") == 0)
+		snap_pos = CENTER;
+	else if (strcasecmp(pos, "left") == 0)
+		snap_pos = LEFT;
+	else if (strcasecmp(pos, "bottom") == 0)
+		snap_pos = BOTTOM;
+	else if (strcasecmp(pos, "top") == 0)
+		snap_pos = TOP;
+	else if (strcasecmp(pos, "right") == 0)
+		snap_pos = RIGHT;
+	else if (strcasecmp(pos, "all") == 0)
+		snap_pos = ALL;
+	else
+		return false;
+
+	(void)(argc);
+	data[0] = snap_pos;
+
+	return true;
+}
+
+static bool
+fn_gap(uint32_t *data, int argc, char **argv)
+{
+	(void)(argc);
+	bool status = true;
+
+	status = status && fn_position(data, 1, argv);
+	status = status && fn_naturals(data + 1, 1, argv + 1);
+
+	return status;
+}
+
+/*
+ * Turn a command line into the words sent to windowchef: the command
+ * number followed by its arguments and its target, COMMAND_WORDS at most.
+ * Returns the number of words, or 0 after complaining on stderr if the
+ * line is wrong.
+ */
+
+int
+encode_command(uint32_t *data, int argc, char **argv)
+{
+	uint32_t target[IPC_TARGET_ARGS] = { IPCTargetFocused, 0 };
+	int i, command_argc;
+
+	if (argc > 0 && argv[0][0] == '@') {
+		if (!parse_target(target, argv[0])) {
+			warnx("malformed target: %s", argv[0]);
+			return 0;
+		}
+		argc--;
+		argv++;
+	}
+	if (argc == 0) {
+		warnx("no command");
+		return 0;
+	}
+	command_argc = argc - 1;
+
+	i = 0;
+	while (i < NR_IPC_COMMANDS && strcmp(argv[0], commands[i].string_command) != 0)
+		i++;
+
+	if (i == NR_IPC_COMMANDS) {
+		/* config keys may be given without wm_config */
+		for (i = 0; i < NR_IPC_CONFIGS; i++) {
+			if (strcmp(argv[0], configs[i].key) == 0) {
+				if (target[0] != IPCTargetFocused) {
+					warnx("%s takes no target", argv[0]);
+					return 0;
+				}
+				memset(data, 0, COMMAND_WORDS * sizeof(uint32_t));
+				data[0] = IPCWMConfig;
+				return fn_config(data + 1, argc, argv) ? MIN_COMMAND_WORDS : 0;
+			}
+		}
+		warnx("no such command: %s", argv[0]);
+		return 0;
+	}
+
+	if (commands[i].argc != -1) {
+		if (command_argc < commands[i].argc) {
+			warnx("not enough arguments");
+			return 0;
+		} else if (command_argc > commands[i].argc) {
+			warnx("too many arguments");
+			return 0;
+		}
+	}
+
+	if (target[0] != IPCTargetFocused && !command_takes_target(commands[i].command)) {
+		warnx("%s takes no target", argv[0]);
+		return 0;
+	}
+
+	memset(data, 0, COMMAND_WORDS * sizeof(uint32_t));
+	data[0] = commands[i].command;
+	memcpy(data + 1 + IPC_MIN_ARGS, target, sizeof(target));
+	if (commands[i].handler != NULL && !(commands[i].handler)(data + 1, command_argc, argv + 1)) {
+		warnx("malformed input");
+		return 0;
+	}
+
+	return command_words(data);
+}
+
+/*
+ * Words an encoded command takes, at least MIN_COMMAND_WORDS.
+ */
+static int
+command_words(uint32_t *data)
+{
+	uint32_t words;
+
+	switch (data[0]) {
+	case IPCWindowLayout:
+		words = 2 + data[1] * IPC_LAYOUT_RECORD;
+		break;
+	case IPCBind:
+		words = 2 + IPC_BIND_HEADER + data[1 + IPC_BIND_HEADER];
+		break;
+	case IPCUnbind:
+		words = 1 + IPC_BIND_HEADER;
+		break;
+	case IPCRule:
+		words = 1 + IPC_RULE_HEADER + data[1 + IPCRuleWordStrings];
+		break;
+	case IPCSpawn:
+		/* and the terminating zero */
+		words = 2 + (data[1] + sizeof(uint32_t)) / sizeof(uint32_t);
+		break;
+	default:
+		words = 0;
+		break;
+	}
+
+	return words > MIN_COMMAND_WORDS ? words : MIN_COMMAND_WORDS;
+}
+
+/*
+ * Split a command line into words in place. A word starting with # begins
+ * a comment, so a # inside a word, like in a spawned shell command, is
+ * kept. Returns the number of words.
+ */
+
+int
+split_line(char *line, char **argv, int max)
+{
+	char *tok;
+	int argc = 0;
+
+	for (tok = strtok(line, " \t\r\n"); tok != NULL && argc < max;
+			tok = strtok(NULL, " \t\r\n")) {
+		if (tok[0] == '#')
+			break;
+		argv[argc++] = tok;
+	}
+
+	return argc;
+}
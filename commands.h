@@ -0,0 +1,41 @@
+/* Copyright (c) 2016-2019 Tudor Ioan Roman. All rights reserved. */
+/* Licensed under the ISC License. See the LICENSE file in the project root for full license information. */
+
+#ifndef WM_COMMANDS_H
+#define WM_COMMANDS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ipc.h"
+
+/* words in a command line: target, command and arguments */
+#define MAX_COMMAND_ARGS (2 + IPC_MAX_ARGS)
+/* room encode_command may fill: the command and its argument words */
+#define COMMAND_WORDS (1 + IPC_MAX_ARGS)
+/* words encode_command fills at least: the command, its arguments and its target */
+#define MIN_COMMAND_WORDS (1 + IPC_MIN_ARGS + IPC_TARGET_ARGS)
+
+struct Command {
+	char *string_command;
+	enum IPCCommand command;
+	int argc;
+	bool (*handler)(uint32_t *, int , char **);
+};
+
+struct ConfigEntry {
+	char *key;
+	enum IPCConfig config;
+	int argc;
+	bool (*handler)(uint32_t *, int, char **);
+};
+
+extern struct Command commands[NR_IPC_COMMANDS];
+extern struct ConfigEntry configs[NR_IPC_CONFIGS];
+extern char *event_names[NR_IPC_EVENTS];
+
+bool command_takes_target(uint32_t);
+int encode_command(uint32_t *, int, char **);
+int split_line(char *, char **, int);
+
+#endif
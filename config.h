@@ -59,4 +59,12 @@
    1, 2, 3 for left-click, middle-click, right-click */
 #define CLICK_TO_FOCUS_BUTTON 0
 
+/* if true, don't move or resize windows with the pointer more often than
+   the monitor under the pointer refreshes */
+#define FRAME_PACING false
+
+/* how windows of deactivated groups are hidden. HIDE_OFFSCREEN moves them
+   out of sight instead of unmapping them, so they don't redraw when shown */
+#define HIDE_MODE HIDE_UNMAP
+
 #endif
@@ -10,5 +10,5 @@ MANDIR    ?= $(MANPREFIX)/man1
 DOCPREFIX ?= $(PREFIX)/share/doc
 XSESSIONS ?= $(PREFIX)/share/xsessions
 
-CFLAGS += -std=c99 -Wall -Wextra -O2
+CFLAGS += -std=c99 -D_POSIX_C_SOURCE=200809L -Wall -Wextra -O2
 LDFLAGS += -lm -lxcb -lxcb-ewmh -lxcb-icccm -lxcb-randr -lxcb-keysyms
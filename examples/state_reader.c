@@ -0,0 +1,80 @@
+/* Copyright (c) 2016-2019 Tudor Ioan Roman. All rights reserved. */
+/* Licensed under the ISC License. See the LICENSE file in the project root for full license information. */
+
+/*
+ * Print the windows managed by windowchef from its state table, without
+ * talking to X or to windowchef.
+ *
+ * cc -I.. -o state_reader state_reader.c
+ */
+
+#include <err.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "ipc.h"
+
+/*
+ * Copy a consistent snapshot of the table.
+ */
+
+static void
+read_state(const struct ipc_state *table, struct ipc_state *copy)
+{
+	uint32_t seq;
+
+	for (;;) {
+		seq = __atomic_load_n(&table->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+		memcpy(copy, table, sizeof(*copy));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&table->seq, __ATOMIC_RELAXED) == seq)
+			return;
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	const struct ipc_state *table;
+	struct ipc_state st;
+	const char *path;
+	uint32_t i;
+	int fd;
+
+	path = argc > 1 ? argv[1] : getenv(IPC_STATE_ENV);
+	if (path == NULL)
+		errx(EXIT_FAILURE, "usage: %s <state file>", argv[0]);
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1)
+		err(EXIT_FAILURE, "%s", path);
+	table = mmap(NULL, sizeof(*table), PROT_READ, MAP_SHARED, fd, 0);
+	if (table == MAP_FAILED)
+		err(EXIT_FAILURE, "%s", path);
+	close(fd);
+
+	read_state(table, &st);
+	if (st.magic != IPC_STATE_MAGIC || st.version != IPC_STATE_VERSION
+			|| st.size != sizeof(st))
+		errx(EXIT_FAILURE, "%s: unknown state table", path);
+
+	printf("focused 0x%08x\n", st.focused);
+	for (i = 0; i < st.nr_monitors; i++)
+		printf("monitor %s %ux%u+%d+%d\n", st.monitors[i].name,
+				st.monitors[i].width, st.monitors[i].height,
+				st.monitors[i].x, st.monitors[i].y);
+	for (i = 0; i < st.nr_clients; i++)
+		printf("window 0x%08x %ux%u+%d+%d group %d%s\n", st.clients[i].window,
+				st.clients[i].width, st.clients[i].height,
+				st.clients[i].x, st.clients[i].y, (int)st.clients[i].group,
+				st.clients[i].mapped ? "" : " unmapped");
+
+	return EXIT_SUCCESS;
+}
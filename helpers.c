@@ -1,11 +1,26 @@
 /* Copyright (c) 2016-2018 Tudor Ioan Roman. All rights reserved. */
 /* Licensed under the ISC License. See the LICENSE file in the project root for full license information. */
 
+#ifdef __linux__
+/* struct ucred */
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
 
+#include "common.h"
 #include "helpers.h"
+#include "ipc.h"
 
 int
 asprintf(char **buf, const char *fmt, ...)
@@ -131,6 +146,658 @@ list_delete_all_items(struct list_item **list, bool can_free_data)
 	}
 }
 
+/*
+ * Hash table slot for a key. Multiplicative hashing spreads the
+ * sequential resource IDs handed out by the X server. The low bits of the
+ * product only depend on the low bits of the key, which are the same for
+ * windows of different clients, so the slot is taken from the high bits.
+ */
+
+static uint32_t
+htable_slot(struct htable *table, uint32_t key)
+{
+	return (key * 2654435769U) >> (32 - __builtin_ctz(table->size));
+}
+
+/*
+ * Rehash all entries into a table of the given size (a power of two).
+ */
+
+static bool
+htable_resize(struct htable *table, uint32_t size)
+{
+	struct htable new;
+
+	new.keys = calloc(size, sizeof(uint32_t));
+	new.values = calloc(size, sizeof(void *));
+	new.size = size;
+	new.count = 0;
+	if (new.keys == NULL || new.values == NULL) {
+		free(new.keys);
+		free(new.values);
+		return false;
+	}
+
+	for (uint32_t i = 0; i < table->size; i++)
+		if (table->keys[i] != 0)
+			htable_put(&new, table->keys[i], table->values[i]);
+
+	free(table->keys);
+	free(table->values);
+	*table = new;
+
+	return true;
+}
+
+/*
+ * Look up the value stored under key. Returns NULL if it isn't there.
+ */
+
+void *
+htable_get(struct htable *table, uint32_t key)
+{
+	uint32_t i;
+
+	if (table->size == 0 || key == 0)
+		return NULL;
+
+	for (i = htable_slot(table, key); table->keys[i] != 0;
+			i = (i + 1) & (table->size - 1))
+		if (table->keys[i] == key)
+			return table->values[i];
+
+	return NULL;
+}
+
+/*
+ * Insert or replace the value stored under key.
+ * The table grows to keep the load factor under 1/2, so only inserting a
+ * new key can fail.
+ */
+
+bool
+htable_put(struct htable *table, uint32_t key, void *value)
+{
+	uint32_t i;
+
+	if (key == 0)
+		return false;
+
+	if (table->size != 0) {
+		for (i = htable_slot(table, key); table->keys[i] != 0;
+				i = (i + 1) & (table->size - 1)) {
+			if (table->keys[i] == key) {
+				table->values[i] = value;
+				return true;
+			}
+		}
+	}
+
+	if ((table->count + 1) * 2 > table->size
+			&& !htable_resize(table, table->size ? table->size * 2 : 64))
+		return false;
+
+	for (i = htable_slot(table, key); table->keys[i] != 0;
+			i = (i + 1) & (table->size - 1))
+		;
+
+	table->keys[i] = key;
+	table->values[i] = value;
+	table->count++;
+
+	return true;
+}
+
+/*
+ * Remove key from the table and return its value.
+ * Following entries of the probe chain are shifted back
+ * so lookups never need tombstones.
+ */
+
+void *
+htable_delete(struct htable *table, uint32_t key)
+{
+	uint32_t i, j, home;
+	uint32_t mask = table->size - 1;
+	void *value;
+
+	if (table->size == 0 || key == 0)
+		return NULL;
+
+	for (i = htable_slot(table, key); table->keys[i] != key; i = (i + 1) & mask)
+		if (table->keys[i] == 0)
+			return NULL;
+
+	value = table->values[i];
+	table->count--;
+
+	for (j = (i + 1) & mask; table->keys[j] != 0; j = (j + 1) & mask) {
+		home = htable_slot(table, table->keys[j]);
+		/* leave the entry alone if its home slot is in (i, j] */
+		if (((j - home) & mask) < ((j - i) & mask))
+			continue;
+		table->keys[i] = table->keys[j];
+		table->values[i] = table->values[j];
+		i = j;
+	}
+	table->keys[i] = 0;
+	table->values[i] = NULL;
+
+	return value;
+}
+
+/*
+ * Free the table's storage. Values must be freed manually.
+ */
+
+void
+htable_free(struct htable *table)
+{
+	free(table->keys);
+	free(table->values);
+	table->keys = NULL;
+	table->values = NULL;
+	table->size = table->count = 0;
+}
+
+/*
+ * FNV-1a hash of a string, usable as an htable key: never 0.
+ */
+
+uint32_t
+hash_string(const char *s)
+{
+	uint32_t hash = 2166136261U;
+
+	for (; *s != '\0'; s++) {
+		hash ^= (unsigned char)*s;
+		hash *= 16777619U;
+	}
+
+	return hash != 0 ? hash : 1;
+}
+
+/*
+ * FNV-1a hash of len bytes, usable as an htable key: never 0.
+ */
+
+uint32_t
+hash_bytes(const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	uint32_t hash = 2166136261U;
+
+	for (; len > 0; len--, p++) {
+		hash ^= *p;
+		hash *= 16777619U;
+	}
+
+	return hash != 0 ? hash : 1;
+}
+
+/*
+ * Milliseconds of the monotonic clock.
+ */
+
+static uint64_t
+loop_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Watch fd for events. handler is called with the returned events.
+ */
+
+bool
+loop_add_fd(struct loop *loop, int fd, short events, void (*handler)(int, short))
+{
+	struct loop_fd *fds;
+
+	if (loop->fds_len == loop->fds_size) {
+		fds = realloc(loop->fds, (loop->fds_size ? loop->fds_size * 2 : 8)
+				* sizeof(struct loop_fd));
+		if (fds == NULL)
+			return false;
+		loop->fds = fds;
+		loop->fds_size = loop->fds_size ? loop->fds_size * 2 : 8;
+	}
+
+	loop->fds[loop->fds_len].fd = fd;
+	loop->fds[loop->fds_len].events = events;
+	loop->fds[loop->fds_len].handler = handler;
+	loop->fds_len++;
+
+	return true;
+}
+
+/*
+ * Change the events watched on fd.
+ */
+
+void
+loop_set_fd_events(struct loop *loop, int fd, short events)
+{
+	for (uint32_t i = 0; i < loop->fds_len; i++)
+		if (loop->fds[i].fd == fd)
+			loop->fds[i].events = events;
+}
+
+/*
+ * Stop watching fd. Safe to call from a handler; the slot is
+ * reclaimed before the next poll.
+ */
+
+void
+loop_remove_fd(struct loop *loop, int fd)
+{
+	for (uint32_t i = 0; i < loop->fds_len; i++) {
+		if (loop->fds[i].fd == fd) {
+			loop->fds[i].fd = -1;
+			loop->fds[i].handler = NULL;
+		}
+	}
+}
+
+/*
+ * Call handler with data once, after ms milliseconds.
+ * Returns an id for loop_cancel_timer, or 0 on failure.
+ */
+
+uint32_t
+loop_add_timer(struct loop *loop, uint32_t ms, void (*handler)(void *), void *data)
+{
+	struct loop_timer *timers;
+
+	if (loop->timers_len == loop->timers_size) {
+		timers = realloc(loop->timers, (loop->timers_size ?
+				loop->timers_size * 2 : 8) * sizeof(struct loop_timer));
+		if (timers == NULL)
+			return 0;
+		loop->timers = timers;
+		loop->timers_size = loop->timers_size ? loop->timers_size * 2 : 8;
+	}
+
+	if (++loop->last_timer_id == 0)
+		loop->last_timer_id = 1;
+
+	loop->timers[loop->timers_len].id = loop->last_timer_id;
+	loop->timers[loop->timers_len].deadline = loop_now() + ms;
+	loop->timers[loop->timers_len].handler = handler;
+	loop->timers[loop->timers_len].data = data;
+	loop->timers_len++;
+
+	return loop->last_timer_id;
+}
+
+/*
+ * Forget a timer that hasn't fired yet.
+ */
+
+void
+loop_cancel_timer(struct loop *loop, uint32_t id)
+{
+	for (uint32_t i = 0; i < loop->timers_len; i++) {
+		if (loop->timers[i].id == id) {
+			loop->timers[i] = loop->timers[--loop->timers_len];
+			return;
+		}
+	}
+}
+
+/*
+ * Fire the expired timers, earliest first. Handlers may add or cancel
+ * timers.
+ */
+
+void
+loop_run_timers(struct loop *loop)
+{
+	struct loop_timer timer;
+	uint64_t now = loop_now();
+	uint32_t i, first;
+
+	for (;;) {
+		first = loop->timers_len;
+		for (i = 0; i < loop->timers_len; i++)
+			if (loop->timers[i].deadline <= now && (first == loop->timers_len
+						|| loop->timers[i].deadline < loop->timers[first].deadline))
+				first = i;
+		if (first == loop->timers_len)
+			return;
+
+		timer = loop->timers[first];
+		loop->timers[first] = loop->timers[--loop->timers_len];
+		timer.handler(timer.data);
+	}
+}
+
+/*
+ * Wait until a file descriptor is ready or the next timer is due, then
+ * call the handlers of the ready descriptors. Doesn't wait if block is
+ * false. Returns the number of ready descriptors or -1 on error.
+ */
+
+int
+loop_poll(struct loop *loop, bool block)
+{
+	struct pollfd *pfds;
+	uint64_t now, deadline = UINT64_MAX;
+	uint32_t i, j, n;
+	int timeout = -1, ready;
+
+	/* reclaim the slots of removed descriptors */
+	for (i = j = 0; i < loop->fds_len; i++)
+		if (loop->fds[i].fd != -1)
+			loop->fds[j++] = loop->fds[i];
+	loop->fds_len = n = j;
+
+	for (i = 0; i < loop->timers_len; i++)
+		if (loop->timers[i].deadline < deadline)
+			deadline = loop->timers[i].deadline;
+
+	if (!block) {
+		timeout = 0;
+	} else if (deadline != UINT64_MAX) {
+		now = loop_now();
+		timeout = deadline <= now ? 0
+			: deadline - now > INT32_MAX ? INT32_MAX : (int)(deadline - now);
+	}
+
+	pfds = malloc((n ? n : 1) * sizeof(struct pollfd));
+	if (pfds == NULL)
+		return -1;
+	for (i = 0; i < n; i++) {
+		pfds[i].fd = loop->fds[i].fd;
+		pfds[i].events = loop->fds[i].events;
+		pfds[i].revents = 0;
+	}
+
+	ready = poll(pfds, n, timeout);
+	if (ready < 0) {
+		free(pfds);
+		return errno == EINTR ? 0 : -1;
+	}
+
+	/* handlers may add descriptors, so only look at the first n */
+	for (i = 0; i < n; i++) {
+		if (pfds[i].revents == 0)
+			continue;
+		if (loop->fds[i].fd == pfds[i].fd && loop->fds[i].handler != NULL)
+			loop->fds[i].handler(pfds[i].fd, pfds[i].revents);
+	}
+
+	free(pfds);
+	return ready;
+}
+
+/*
+ * Free the loop's storage. File descriptors are not closed.
+ */
+
+void
+loop_free(struct loop *loop)
+{
+	free(loop->fds);
+	free(loop->timers);
+	loop->fds = NULL;
+	loop->timers = NULL;
+	loop->fds_len = loop->fds_size = loop->timers_len = loop->timers_size = 0;
+}
+
+/*
+ * Append len bytes of data to the buffer.
+ */
+
+bool
+buffer_append(struct buffer *buf, const void *data, size_t len)
+{
+	size_t size = buf->size ? buf->size : 256;
+	char *new;
+
+	while (size < buf->len + len)
+		size *= 2;
+	if (size != buf->size) {
+		new = realloc(buf->data, size);
+		if (new == NULL)
+			return false;
+		buf->data = new;
+		buf->size = size;
+	}
+
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+
+	return true;
+}
+
+/*
+ * Append formatted text, without the terminating null byte.
+ */
+
+bool
+buffer_printf(struct buffer *buf, const char *fmt, ...)
+{
+	va_list args;
+	char *text;
+	int len;
+	bool ok;
+
+	va_start(args, fmt);
+	len = vasprintf(&text, fmt, args);
+	va_end(args);
+	if (len < 0)
+		return false;
+
+	ok = buffer_append(buf, text, len);
+	free(text);
+
+	return ok;
+}
+
+/*
+ * Drop the first len bytes of the buffer.
+ */
+
+void
+buffer_consume(struct buffer *buf, size_t len)
+{
+	if (len >= buf->len) {
+		buf->len = 0;
+		return;
+	}
+
+	memmove(buf->data, buf->data + len, buf->len - len);
+	buf->len -= len;
+}
+
+void
+buffer_free(struct buffer *buf)
+{
+	free(buf->data);
+	buf->data = NULL;
+	buf->len = buf->size = 0;
+}
+
+/*
+ * Path of a per-display file of windowchef. The variable env_name wins,
+ * then $XDG_RUNTIME_DIR, then /tmp. Returns false if the path doesn't fit.
+ */
+
+static bool
+get_runtime_path(char *path, size_t len, const char *env_name, const char *suffix)
+{
+	char display[MAXLEN];
+	char *env, *c;
+	int n;
+
+	env = getenv(env_name);
+	if (env != NULL && env[0] != '\0') {
+		n = snprintf(path, len, "%s", env);
+		return n >= 0 && (size_t)n < len;
+	}
+
+	env = getenv("DISPLAY");
+	snprintf(display, sizeof(display), "%s", env != NULL ? env : "");
+	/* DISPLAY may be a path on some systems */
+	for (c = display; *c != '\0'; c++)
+		if (*c == '/')
+			*c = '_';
+
+	env = getenv("XDG_RUNTIME_DIR");
+	if (env != NULL && env[0] != '\0')
+		n = snprintf(path, len, "%s/%s-%s.%s", env, __NAME__, display, suffix);
+	else
+		n = snprintf(path, len, "/tmp/%s-%u-%s.%s", __NAME__,
+				(unsigned int)getuid(), display, suffix);
+
+	return n >= 0 && (size_t)n < len;
+}
+
+bool
+get_ipc_socket_path(char *path, size_t len)
+{
+	return get_runtime_path(path, len, IPC_SOCKET_ENV, "sock");
+}
+
+bool
+get_ipc_state_path(char *path, size_t len)
+{
+	return get_runtime_path(path, len, IPC_STATE_ENV, "state");
+}
+
+/*
+ * Remember the sequence number of a request about a window and the kinds
+ * of events it causes.
+ */
+
+void
+ignore_ring_add(struct ignore_ring *ring, uint32_t window, uint32_t sequence,
+		uint32_t kinds)
+{
+	uint32_t i;
+
+	if (ring->len == IGNORE_RING_SIZE) {
+		ring->first = (ring->first + 1) % IGNORE_RING_SIZE;
+		ring->len--;
+	}
+
+	i = (ring->first + ring->len++) % IGNORE_RING_SIZE;
+	ring->requests[i].sequence = sequence;
+	ring->requests[i].window = window;
+	ring->requests[i].kinds = kinds;
+}
+
+/*
+ * Forget the requests older than an event. Events come in sequence order,
+ * so the events of those requests already came.
+ */
+
+void
+ignore_ring_expire(struct ignore_ring *ring, uint32_t sequence)
+{
+	while (ring->len > 0 && (int32_t)(sequence
+				- ring->requests[ring->first].sequence) > 0) {
+		ring->first = (ring->first + 1) % IGNORE_RING_SIZE;
+		ring->len--;
+	}
+}
+
+/*
+ * Tell if an event of the given kind and sequence number was caused by a
+ * request about window, or about any window if it is 0. An event carries
+ * the sequence of the last request handled, not of the one that caused it,
+ * so an event of another client's request can have the same sequence: the
+ * kind tells them apart.
+ */
+
+bool
+ignore_ring_match(struct ignore_ring *ring, uint32_t sequence, uint32_t window,
+		enum ignore_kind kind)
+{
+	uint32_t i, j;
+
+	ignore_ring_expire(ring, sequence);
+	for (i = 0; i < ring->len; i++) {
+		j = (ring->first + i) % IGNORE_RING_SIZE;
+		if (ring->requests[j].sequence == sequence
+				&& (ring->requests[j].kinds & kind)
+				&& (window == 0 || ring->requests[j].window == window))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Copy a new state into the shared table under its seqlock. seq is odd
+ * while the table is written, readers retry until they copied it while it
+ * was even and unchanged.
+ */
+
+void
+ipc_state_write(struct ipc_state *table, const struct ipc_state *next)
+{
+	/* everything after seq, whatever follows it */
+	const size_t body = offsetof(struct ipc_state, seq) + sizeof(table->seq);
+	uint32_t seq = table->seq;
+
+	__atomic_store_n(&table->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(table, next, offsetof(struct ipc_state, seq));
+	memcpy((char *)table + body, (const char *)next + body, sizeof(*next) - body);
+	__atomic_store_n(&table->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/*
+ * Remove a regular file or a socket that we left at path, so it can be
+ * created again. Returns false if something else, or a file of another
+ * user, is there.
+ */
+
+bool
+remove_stale_file(const char *path, bool socket)
+{
+	struct stat st;
+
+	if (lstat(path, &st) == -1)
+		return errno == ENOENT;
+	if (!(socket ? S_ISSOCK(st.st_mode) : S_ISREG(st.st_mode))
+			|| st.st_uid != getuid())
+		return false;
+
+	return unlink(path) == 0 || errno == ENOENT;
+}
+
+/*
+ * Tell if the process at the other end of a unix socket runs as our user.
+ */
+
+bool
+is_peer_ours(int fd)
+{
+#ifdef SO_PEERCRED
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == -1)
+		return false;
+
+	return cred.uid == getuid();
+#else
+	uid_t uid;
+	gid_t gid;
+
+	if (getpeereid(fd, &uid, &gid) == -1)
+		return false;
+
+	return uid == getuid();
+#endif
+}
+
 uint32_t
 get_color_pixel(uint32_t color)
 {
@@ -6,6 +6,7 @@
 
 #include <stdbool.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdint.h>
 
 int asprintf(char **, const char *, ...);
@@ -22,6 +23,99 @@ struct list_item* list_add_item(struct list_item **);
 void list_delete_item(struct list_item **, struct list_item *);
 void list_delete_all_items(struct list_item **, bool);
 
+/* open-addressing hash table with 32-bit keys. key 0 is reserved. */
+struct htable {
+	uint32_t *keys;
+	void **values;
+	uint32_t size;
+	uint32_t count;
+};
+
+void *htable_get(struct htable *, uint32_t);
+bool htable_put(struct htable *, uint32_t, void *);
+void *htable_delete(struct htable *, uint32_t);
+void htable_free(struct htable *);
+uint32_t hash_string(const char *);
+uint32_t hash_bytes(const void *, size_t);
+
+/*
+ * Requests whose events don't need handling, oldest first. The oldest one
+ * is forgotten when the ring is full.
+ */
+#define IGNORE_RING_SIZE 1024
+
+/* kinds of events a request causes, as a mask */
+enum ignore_kind {
+	IGNORE_UNMAP = 1 << 0,
+	IGNORE_CONFIGURE = 1 << 1,
+	IGNORE_CROSSING = 1 << 2,
+};
+
+struct ignore_ring {
+	struct {
+		uint32_t sequence;
+		uint32_t window;
+		uint32_t kinds;
+	} requests[IGNORE_RING_SIZE];
+	uint32_t first, len;
+};
+
+void ignore_ring_add(struct ignore_ring *, uint32_t, uint32_t, uint32_t);
+void ignore_ring_expire(struct ignore_ring *, uint32_t);
+bool ignore_ring_match(struct ignore_ring *, uint32_t, uint32_t, enum ignore_kind);
+
+/* file descriptor watched by an event loop */
+struct loop_fd {
+	int fd;
+	short events;
+	/* NULL if the loop only needs to wake up */
+	void (*handler)(int, short);
+};
+
+/* one-shot timer. deadline is in milliseconds of the monotonic clock */
+struct loop_timer {
+	uint32_t id;
+	uint64_t deadline;
+	void (*handler)(void *);
+	void *data;
+};
+
+/* poll(2) based event loop */
+struct loop {
+	struct loop_fd *fds;
+	uint32_t fds_len, fds_size;
+	struct loop_timer *timers;
+	uint32_t timers_len, timers_size;
+	uint32_t last_timer_id;
+};
+
+bool loop_add_fd(struct loop *, int, short, void (*)(int, short));
+void loop_set_fd_events(struct loop *, int, short);
+void loop_remove_fd(struct loop *, int);
+uint32_t loop_add_timer(struct loop *, uint32_t, void (*)(void *), void *);
+void loop_cancel_timer(struct loop *, uint32_t);
+void loop_run_timers(struct loop *);
+int loop_poll(struct loop *, bool);
+void loop_free(struct loop *);
+
+/* growable byte buffer */
+struct buffer {
+	char *data;
+	size_t len, size;
+};
+
+bool buffer_append(struct buffer *, const void *, size_t);
+bool buffer_printf(struct buffer *, const char *, ...);
+void buffer_consume(struct buffer *, size_t);
+void buffer_free(struct buffer *);
+
+bool get_ipc_socket_path(char *, size_t);
+bool get_ipc_state_path(char *, size_t);
+struct ipc_state;
+void ipc_state_write(struct ipc_state *, const struct ipc_state *);
+bool remove_stale_file(const char *, bool);
+bool is_peer_ours(int);
+
 uint32_t get_color_pixel(uint32_t);
 
 #endif
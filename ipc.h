@@ -4,8 +4,36 @@
 #ifndef WM_IPC_H
 #define WM_IPC_H
 
+#include <stdint.h>
+
 #define ATOM_COMMAND "__WM_IPC_COMMAND"
 
+/* overrides the path of the ipc socket */
+#define IPC_SOCKET_ENV "WINDOWCHEF_SOCKET"
+/* overrides the path of the state table */
+#define IPC_STATE_ENV "WINDOWCHEF_STATE"
+/* words of a window_layout record: window, x, y, width, height, flags */
+#define IPC_LAYOUT_RECORD 6
+#define IPC_MAX_LAYOUT_RECORDS 256
+/* most argument words a socket request may carry, a full window_layout */
+#define IPC_MAX_ARGS (1 + IPC_LAYOUT_RECORD * IPC_MAX_LAYOUT_RECORDS)
+/* argument words handlers may read; missing ones are zero */
+#define IPC_MIN_ARGS 4
+/*
+ * Window commands take two more words after their arguments, a target and
+ * its value. Both are zero, the focused window, if the request is shorter.
+ */
+#define IPC_TARGET_ARGS 2
+/* keys in the chain of a key binding */
+#define IPC_MAX_CHORD 4
+/*
+ * Words of bind and unbind before the bound command: the number of keys,
+ * the lock and a modifier mask and a keysym for every key.
+ */
+#define IPC_BIND_HEADER (2 + 2 * IPC_MAX_CHORD)
+/* reply id of the messages sent to subscribers */
+#define IPC_EVENT_ID 0xffffffff
+
 #define IPC_MUL_PLUS 0
 #define IPC_MUL_MINUS 1
 
@@ -40,6 +68,22 @@ enum IPCCommand {
 	IPCGroupActivateSpecific,
 	IPCWMQuit,
 	IPCWMConfig,
+	IPCWMStats,
+	IPCSubscribe,
+	IPCQueryFocused,
+	IPCQueryClients,
+	IPCQueryMonitors,
+	IPCQueryGroups,
+	IPCQueryFocusHistory,
+	IPCTransactionBegin,
+	IPCTransactionCommit,
+	IPCTransactionAbort,
+	IPCWindowLayout,
+	IPCBind,
+	IPCUnbind,
+	IPCSpawn,
+	IPCRule,
+	IPCUnrule,
 	NR_IPC_COMMANDS
 };
 
@@ -64,7 +108,204 @@ enum IPCConfig {
 	IPCConfigPointerActions,
 	IPCConfigPointerModifier,
 	IPCConfigClickToFocus,
+	IPCConfigEnableFramePacing,
+	IPCConfigHideMode,
 	NR_IPC_CONFIGS
 };
 
+enum IPCStatus {
+	IPCStatusOk,
+	IPCStatusUnknownCommand,
+	IPCStatusBadArguments,
+	IPCStatusNoWindow,
+	IPCStatusFailed,
+	NR_IPC_STATUSES
+};
+
+enum IPCTarget {
+	IPCTargetFocused,
+	/* the value is a window id */
+	IPCTargetWindow,
+	/* the value is a group number */
+	IPCTargetGroup,
+	IPCTargetAll,
+	NR_IPC_TARGETS
+};
+
+/* flags of a window_layout record */
+enum {
+	IPCLayoutRaise       = 1 << 0,
+	/* don't round the size to the resize increments of the window */
+	IPCLayoutIgnoreHints = 1 << 1,
+};
+
+/*
+ * A rule applies to windows that match all of its properties when they are
+ * first mapped. Its arguments are the IPCRuleWord words, followed by the
+ * class, instance and role matched, each ended by a zero byte, in
+ * IPCRuleWordStrings words.
+ */
+
+enum IPCRuleWord {
+	/* IPCRuleMatch bits */
+	IPCRuleWordMatch,
+	/* an IPCWindowType */
+	IPCRuleWordType,
+	/* 1 if the window must be transient, 0 if it must not */
+	IPCRuleWordTransient,
+	/* IPCRuleAction bits */
+	IPCRuleWordActions,
+	/* numbered like in the group commands */
+	IPCRuleWordGroup,
+	/* x, y, width and height */
+	IPCRuleWordGeometry,
+	/* like the arguments of window_put_in_grid, one per word */
+	IPCRuleWordGrid = IPCRuleWordGeometry + 4,
+	/* an IPCWindowState */
+	IPCRuleWordState = IPCRuleWordGrid + 6,
+	IPCRuleWordFocus,
+	IPCRuleWordStrings,
+	IPC_RULE_HEADER
+};
+
+enum IPCRuleMatch {
+	IPCRuleClass     = 1 << 0,
+	IPCRuleInstance  = 1 << 1,
+	IPCRuleRole      = 1 << 2,
+	IPCRuleType      = 1 << 3,
+	IPCRuleTransient = 1 << 4,
+};
+
+enum IPCRuleAction {
+	IPCRuleGroup    = 1 << 0,
+	IPCRuleGeometry = 1 << 1,
+	IPCRuleGrid     = 1 << 2,
+	IPCRuleState    = 1 << 3,
+	IPCRuleFocus    = 1 << 4,
+};
+
+/* _NET_WM_WINDOW_TYPE values rules can match */
+enum IPCWindowType {
+	IPCWindowTypeNormal,
+	IPCWindowTypeDialog,
+	IPCWindowTypeUtility,
+	IPCWindowTypeSplash,
+	IPCWindowTypeMenu,
+	IPCWindowTypeNotification,
+	NR_IPC_WINDOW_TYPES
+};
+
+/*
+ * Events streamed to subscribers. The subscribe command takes a mask with
+ * bit 1 << event set for every event wanted.
+ */
+
+enum IPCEvent {
+	IPCEventFocus,
+	IPCEventMap,
+	IPCEventUnmap,
+	IPCEventDestroy,
+	IPCEventGeometry,
+	IPCEventGroupActivate,
+	IPCEventGroupDeactivate,
+	IPCEventMonitorAdd,
+	IPCEventMonitorRemove,
+	NR_IPC_EVENTS
+};
+
+/*
+ * Messages on the ipc socket start with a header of 32-bit words in host
+ * byte order. A request is followed by length argument words, a reply by
+ * length bytes of payload.
+ */
+
+struct ipc_request_header {
+	uint32_t length;
+	uint32_t id;
+	uint32_t command;
+};
+
+struct ipc_reply_header {
+	uint32_t length;
+	uint32_t id;
+	uint32_t status;
+};
+
+/*
+ * Payload of an event, sent with a reply header whose id is IPC_EVENT_ID
+ * and whose status is the event. dropped counts the events that didn't fit
+ * in the queue of the subscriber since the previous one it got.
+ */
+
+struct ipc_event {
+	uint32_t dropped;
+	uint32_t id;
+	int32_t x, y;
+	uint32_t width, height;
+};
+
+/*
+ * State table, a file windowchef keeps mapped and rewrites at the end of
+ * every event batch that changed it. Readers map it read-only and copy it
+ * out under the seqlock in seq: seq is odd while the table is written, and
+ * a copy is consistent if seq was even and didn't change while copying.
+ * Load seq with acquire semantics, and put an acquire fence between the
+ * copy and the second load.
+ */
+
+#define IPC_STATE_MAGIC 0x66656863 /* "chef" */
+#define IPC_STATE_VERSION 1
+#define IPC_STATE_MAX_CLIENTS 512
+#define IPC_STATE_MAX_MONITORS 16
+#define IPC_STATE_MAX_GROUPS 64
+#define IPC_STATE_NAME_LEN 32
+
+enum IPCWindowState {
+	IPCStateNormal,
+	IPCStateMaxed,
+	IPCStateHMaxed,
+	IPCStateVMaxed,
+	IPCStateMonocled,
+	IPCStateGridded,
+};
+
+struct ipc_state_client {
+	uint32_t window;
+	int32_t x, y;
+	uint32_t width, height;
+	/* 0xffffffff if the window is in no group */
+	uint32_t group;
+	/* index in monitors, 0xffffffff if unknown */
+	uint32_t monitor;
+	uint8_t state;
+	uint8_t mapped;
+	uint8_t pad[2];
+};
+
+struct ipc_state_monitor {
+	uint32_t output;
+	int32_t x, y;
+	uint32_t width, height;
+	/* in millihertz, 0 if unknown */
+	uint32_t refresh_rate;
+	char name[IPC_STATE_NAME_LEN];
+};
+
+struct ipc_state {
+	uint32_t magic;
+	uint32_t version;
+	/* size of the table in bytes */
+	uint32_t size;
+	uint32_t seq;
+	/* 0 if no window is focused */
+	uint32_t focused;
+	/* the lists are cut to the maximum, the totals are not */
+	uint32_t nr_clients, total_clients;
+	uint32_t nr_monitors, total_monitors;
+	uint32_t nr_groups, last_group;
+	uint8_t active_groups[IPC_STATE_MAX_GROUPS];
+	struct ipc_state_monitor monitors[IPC_STATE_MAX_MONITORS];
+	struct ipc_state_client clients[IPC_STATE_MAX_CLIENTS];
+};
+
 #endif
@@ -0,0 +1,77 @@
+/* Copyright (c) 2016-2019 Tudor Ioan Roman. All rights reserved. */
+/* Licensed under the ISC License. See the LICENSE file in the project root for full license information. */
+
+/*
+ * Check the ring of requests whose events windowchef ignores.
+ *
+ * make check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../helpers.h"
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		failed++; \
+	} \
+} while (0)
+
+static int failed = 0;
+
+int
+main(void)
+{
+	static struct ignore_ring ring;
+	uint32_t i;
+
+	/* an event of a request, about its window or about any window */
+	ignore_ring_add(&ring, 10, 100, IGNORE_CONFIGURE | IGNORE_CROSSING);
+	CHECK(ignore_ring_match(&ring, 100, 10, IGNORE_CONFIGURE));
+	CHECK(!ignore_ring_match(&ring, 100, 11, IGNORE_CONFIGURE));
+	CHECK(ignore_ring_match(&ring, 100, 0, IGNORE_CROSSING));
+
+	/* another client unmapped the window after our configure */
+	CHECK(!ignore_ring_match(&ring, 100, 10, IGNORE_UNMAP));
+
+	/* an event that came before the request was handled */
+	ignore_ring_add(&ring, 11, 102, IGNORE_CONFIGURE | IGNORE_CROSSING);
+	CHECK(!ignore_ring_match(&ring, 101, 11, IGNORE_CONFIGURE));
+	CHECK(ring.len == 1);
+
+	/* a request can cause several events, until a newer event comes */
+	CHECK(ignore_ring_match(&ring, 102, 11, IGNORE_CONFIGURE));
+	CHECK(ignore_ring_match(&ring, 102, 0, IGNORE_CROSSING));
+	ignore_ring_expire(&ring, 103);
+	CHECK(ring.len == 0);
+	CHECK(!ignore_ring_match(&ring, 102, 11, IGNORE_CONFIGURE));
+
+	/* sequence numbers wrap around */
+	ignore_ring_add(&ring, 1, 0xfffffffe, IGNORE_CONFIGURE | IGNORE_CROSSING);
+	ignore_ring_add(&ring, 2, 0xffffffff, IGNORE_CONFIGURE | IGNORE_CROSSING);
+	ignore_ring_add(&ring, 3, 0, IGNORE_CONFIGURE | IGNORE_CROSSING);
+	ignore_ring_add(&ring, 4, 1, IGNORE_CONFIGURE | IGNORE_CROSSING);
+	CHECK(ignore_ring_match(&ring, 0xffffffff, 2, IGNORE_CONFIGURE));
+	CHECK(ring.len == 3);
+	CHECK(ignore_ring_match(&ring, 1, 4, IGNORE_CONFIGURE));
+	CHECK(ring.len == 1);
+	ignore_ring_expire(&ring, 2);
+
+	/* a full ring forgets the oldest requests */
+	for (i = 0; i < IGNORE_RING_SIZE + 10; i++)
+		ignore_ring_add(&ring, 1000 + i, 1000 + i,
+				IGNORE_CONFIGURE | IGNORE_CROSSING);
+	CHECK(ring.len == IGNORE_RING_SIZE);
+	CHECK(!ignore_ring_match(&ring, 1009, 1009, IGNORE_CONFIGURE));
+	CHECK(ignore_ring_match(&ring, 1010, 1010, IGNORE_CONFIGURE));
+	CHECK(ignore_ring_match(&ring, 1000 + IGNORE_RING_SIZE + 9, 0,
+			IGNORE_CROSSING));
+	CHECK(ring.len == 1);
+
+	if (failed == 0)
+		printf("ignore ring: ok\n");
+
+	return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,33 @@
+#!/bin/sh
+# With sloppy focus, a window that windowchef moves and raises under the
+# pointer must not take the focus: the enter event is its own doing.
+
+. bench/xvfb.sh
+
+start_x
+write_rc "enable_sloppy_focus true" "cursor_position center"
+start_wm
+start_windows 2
+a=$(sed -n 1p "$tmp/ids")
+b=$(sed -n 2p "$tmp/ids")
+
+# focus a and bring the pointer to its center, at 100 75
+./waitron --wait window_focus "$a"
+./waitron --wait @"$a" window_move_absolute 0 0
+
+# move b over the pointer and raise it
+./waitron --wait window_layout "$b" 0 0 200 150 1
+# the enter event reaches windowchef after the reply
+sleep 0.5
+
+status=0
+if ! ./waitron query_focused | grep -q "\"window\":\"$a\""; then
+	echo "sloppy_focus: $b took the focus when it was moved under the pointer"
+	status=1
+fi
+if ./waitron wm_stats | awk '{ exit !($3 == 0) }'; then
+	echo "sloppy_focus: no event was ignored"
+	status=1
+fi
+[ "$status" -eq 0 ] && echo "sloppy_focus: ok"
+exit "$status"
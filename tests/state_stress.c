@@ -0,0 +1,150 @@
+/* Copyright (c) 2016-2019 Tudor Ioan Roman. All rights reserved. */
+/* Licensed under the ISC License. See the LICENSE file in the project root for full license information. */
+
+/*
+ * Stress the seqlock of the state table. A child process publishes states
+ * with ipc_state_write, like windowchef does, while the parent copies them
+ * like examples/state_reader.c and checks that no copy mixes two states.
+ *
+ * make check
+ * tests/state_stress [<writes>]
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../helpers.h"
+#include "../ipc.h"
+
+#define WRITES 200000
+
+/*
+ * Fill every field of a state from its number, so a copy that mixes two
+ * states can be told apart.
+ */
+
+static void
+make_state(struct ipc_state *st, uint32_t k)
+{
+	uint32_t i;
+
+	st->magic = IPC_STATE_MAGIC;
+	st->version = IPC_STATE_VERSION;
+	st->size = sizeof(*st);
+	st->focused = k;
+	st->nr_clients = st->total_clients = IPC_STATE_MAX_CLIENTS;
+	st->nr_monitors = st->total_monitors = IPC_STATE_MAX_MONITORS;
+	st->nr_groups = IPC_STATE_MAX_GROUPS;
+	st->last_group = k % IPC_STATE_MAX_GROUPS;
+	for (i = 0; i < IPC_STATE_MAX_GROUPS; i++)
+		st->active_groups[i] = (k + i) & 1;
+	for (i = 0; i < IPC_STATE_MAX_MONITORS; i++) {
+		st->monitors[i].output = k + i;
+		st->monitors[i].x = k;
+		st->monitors[i].y = -(int32_t)k;
+		st->monitors[i].width = st->monitors[i].height = k ^ i;
+		st->monitors[i].refresh_rate = k;
+		snprintf(st->monitors[i].name, sizeof(st->monitors[i].name), "%u", k);
+	}
+	for (i = 0; i < IPC_STATE_MAX_CLIENTS; i++) {
+		st->clients[i].window = k + i;
+		st->clients[i].x = k;
+		st->clients[i].y = -(int32_t)k;
+		st->clients[i].width = st->clients[i].height = k ^ i;
+		st->clients[i].group = st->clients[i].monitor = k;
+		st->clients[i].state = k;
+		st->clients[i].mapped = k & 1;
+	}
+}
+
+/*
+ * Copy a consistent snapshot of the table, counting the failed attempts.
+ */
+
+static void
+read_state(const struct ipc_state *table, struct ipc_state *copy,
+		unsigned long *retries)
+{
+	uint32_t seq;
+
+	for (;;) {
+		seq = __atomic_load_n(&table->seq, __ATOMIC_ACQUIRE);
+		if (!(seq & 1)) {
+			memcpy(copy, table, sizeof(*copy));
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&table->seq, __ATOMIC_RELAXED) == seq)
+				return;
+		}
+		(*retries)++;
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	static struct ipc_state next, copy, expected;
+	struct ipc_state *table;
+	char path[] = "/tmp/state_stress.XXXXXX";
+	unsigned long reads = 0, retries = 0, bad = 0, changes = 0;
+	uint32_t writes, k, last = 0;
+	int fd, status;
+	pid_t pid;
+
+	writes = argc > 1 ? strtoul(argv[1], NULL, 10) : WRITES;
+
+	/* shared like the real table, but gone when the test ends */
+	fd = mkstemp(path);
+	if (fd == -1)
+		err(EXIT_FAILURE, "mkstemp");
+	unlink(path);
+	if (ftruncate(fd, sizeof(*table)) == -1)
+		err(EXIT_FAILURE, "ftruncate");
+	table = mmap(NULL, sizeof(*table), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (table == MAP_FAILED)
+		err(EXIT_FAILURE, "mmap");
+	make_state(&next, 0);
+	ipc_state_write(table, &next);
+
+	pid = fork();
+	if (pid == -1)
+		err(EXIT_FAILURE, "fork");
+	if (pid == 0) {
+		for (k = 1; k <= writes; k++) {
+			make_state(&next, k);
+			ipc_state_write(table, &next);
+		}
+		_exit(EXIT_SUCCESS);
+	}
+
+	do {
+		read_state(table, &copy, &retries);
+		reads++;
+		k = copy.focused;
+		if (k != last)
+			changes++;
+		last = k;
+
+		make_state(&expected, k);
+		expected.seq = copy.seq;
+		if (memcmp(&copy, &expected, sizeof(copy)) != 0 || copy.seq != 2 * (k + 1)) {
+			if (bad++ < 10)
+				fprintf(stderr, "state %u (seq %u) is torn\n", k, copy.seq);
+		}
+	} while (last != writes);
+
+	if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status)
+			|| WEXITSTATUS(status) != EXIT_SUCCESS)
+		errx(EXIT_FAILURE, "the writer failed");
+
+	printf("%u writes, %lu reads of %lu states, %lu retries, %lu torn\n",
+			writes, reads, changes, retries, bad);
+
+	return bad == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
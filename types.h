@@ -7,6 +7,12 @@
 #include <xcb/randr.h>
 #include <stdbool.h>
 
+#include "helpers.h"
+#include "ipc.h"
+
+/* room for the JSON in WINDOWCHEF_STATUS */
+#define STATUS_MAXLEN 512
+
 enum position {
 	BOTTOM_LEFT,
 	BOTTOM_RIGHT,
@@ -41,6 +47,13 @@ enum pointer_action {
 	POINTER_ACTION_RESIZE_SIDE,
 };
 
+/* how windows of inactive groups are hidden */
+enum hide_mode {
+	HIDE_UNMAP,
+	/* left mapped, moved to the left of the screen */
+	HIDE_OFFSCREEN,
+};
+
 enum resize_handle {
 	HANDLE_LEFT,
 	HANDLE_BOTTOM,
@@ -69,6 +82,116 @@ struct grid {
 	int16_t sx, sy;
 };
 
+/* configure request queued until the end of the event batch */
+struct pending_configure {
+	uint16_t mask;
+	int16_t x, y;
+	uint16_t width, height;
+	uint16_t border_width;
+	uint8_t stack_mode;
+	/* the client asked for it and expects a ConfigureNotify */
+	bool notify;
+};
+
+/* window state as last sent to the server, to drop redundant requests */
+struct window_shadow {
+	bool mapped;
+	/* the last stack mode sent, valid until an unmanaged window is restacked */
+	bool stack_known;
+	uint8_t stack_mode;
+	int16_t x, y;
+	uint16_t width, height, border_width;
+	/* XCB_CW_BORDER_PIXEL, XCB_CW_BORDER_PIXMAP or 0 if unknown */
+	uint32_t border_attr;
+	uint32_t border_value;
+	/* number of atoms in _NET_WM_STATE, or -1 if unknown */
+	int8_t wm_state_len;
+	xcb_atom_t wm_state[4];
+};
+
+/* requests sent for a window that is about to be managed */
+struct adoption {
+	xcb_window_t window;
+	bool map;
+	xcb_get_property_cookie_t type;
+	xcb_get_geometry_cookie_t geometry;
+	xcb_get_property_cookie_t hints;
+	xcb_get_property_cookie_t protocols;
+	xcb_get_property_cookie_t class;
+	xcb_get_property_cookie_t transient;
+	xcb_get_property_cookie_t role;
+};
+
+struct adoption_array {
+	struct adoption *items;
+	uint32_t len, size;
+};
+
+/* a client of the ipc socket */
+/* requests held back until the transaction of a connection is committed */
+struct ipc_transaction {
+	bool active, grab;
+	/* per request: the command word, the number of arguments and the arguments */
+	struct buffer requests;
+	/* aborts a transaction left open */
+	uint32_t timer;
+};
+
+struct ipc_connection {
+	int fd;
+	struct buffer in, out;
+	/* events wanted, as 1 << IPCEvent bits, and events lost since the last one sent */
+	uint32_t events, dropped;
+	struct ipc_transaction transaction;
+	/* the peer is gone; close once the replies are sent */
+	bool closing;
+	/* too many replies are queued; requests wait until they are sent */
+	bool paused;
+	struct list_item *item;
+};
+
+struct key {
+	uint16_t modifiers;
+	xcb_keysym_t keysym;
+};
+
+/*
+ * A key binding runs command when the keys of chain are pressed one after
+ * the other. After a locked binding ran, the first lock keys stay pressed,
+ * so the rest of the chain can be repeated.
+ */
+
+struct binding {
+	struct key chain[IPC_MAX_CHORD];
+	uint32_t nr_keys, lock;
+	/* the bound command and its argument words */
+	uint32_t command, nr_args;
+	uint32_t *args;
+	struct list_item *item;
+};
+
+/*
+ * A window rule, see enum IPCRuleWord. Rules are chained by the hash of
+ * their class, or in one chain if they don't match a class, in the order
+ * they were added.
+ */
+
+struct rule {
+	uint32_t match;
+	char *class_name, *instance_name, *role;
+	uint32_t type;
+	bool transient;
+	uint32_t actions;
+	uint32_t group;
+	int32_t x, y;
+	uint32_t width, height;
+	uint32_t grid[6];
+	uint32_t state;
+	bool focus;
+	uint32_t order;
+	struct rule *next;
+};
+
 struct client {
 	xcb_window_t window;
 	struct window_geom geom;
@@ -84,6 +207,38 @@ struct client {
 	bool mapped;
 	uint32_t group;
 	uint8_t depth;
+	uint8_t dirty;
+	struct pending_configure configure;
+	struct window_shadow shadow;
+	/* read once when the window is adopted */
+	bool delete_window;
+	xcb_window_t transient_for;
+	/* set by a rule: don't focus the window when it is mapped */
+	bool no_focus;
+	/* moved out of sight by hide_window in HIDE_OFFSCREEN mode */
+	bool hidden;
+	char *class_name, *instance_name;
+	/* last value written to WINDOWCHEF_STATUS */
+	char status[STATUS_MAXLEN];
+	uint16_t status_len;
+};
+
+struct border_pixmap {
+	xcb_pixmap_t pixmap;
+	uint16_t width, height;
+	uint8_t depth;
+	uint32_t color, internal_color;
+	int8_t border_width, internal_border_width;
+	uint32_t bytes;
+	/* the border_table key, and the next pixmap with the same one */
+	uint32_t hash;
+	struct border_pixmap *next;
+	struct list_item *item;
+};
+
+struct window_array {
+	xcb_window_t *wins;
+	uint32_t len, size;
 };
 
 struct monitor {
@@ -91,6 +246,8 @@ struct monitor {
 	char *name;
 	int16_t x, y;
 	uint16_t width, height;
+	/* in millihertz, 0 if unknown */
+	uint32_t refresh_rate;
 	struct list_item *item;
 };
 
@@ -110,6 +267,8 @@ struct conf {
 	enum pointer_action pointer_actions[3];
 	uint16_t pointer_modifier;
 	int8_t click_to_focus;
+	bool frame_pacing;
+	enum hide_mode hide_mode;
 };
 
 #endif
@@ -10,17 +10,27 @@
 
 #include <assert.h>
 #include <err.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <tgmath.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 
+#include "commands.h"
 #include "common.h"
 #include "config.h"
 #include "ipc.h"
@@ -32,9 +42,33 @@
 #define LAST_XCB_EVENT XCB_GET_MODIFIER_MAPPING
 #define NULL_GROUP 0xffffffff
 #define PI 3.14159265
+/* memory cap for cached two-colour border pixmaps */
+#define BORDER_CACHE_MAX_BYTES (16 * 1024 * 1024)
+#define MAX_DEPTH 32
+/* queued replies past which a client's requests wait until it reads them */
+#define IPC_MAX_QUEUED (1024 * 1024)
+/* queued output past which events for a subscriber are dropped */
+#define IPC_MAX_QUEUED_EVENTS (64 * 1024)
+/* milliseconds a transaction may stay open before it is aborted */
+#define IPC_TRANSACTION_TIMEOUT 5000
+/* milliseconds to wait for the next key of a chain */
+#define CHORD_TIMEOUT 2000
+/* modifier bits of the state of key events */
+#define KEY_MODIFIERS (XCB_MOD_MASK_SHIFT | XCB_MOD_MASK_LOCK | XCB_MOD_MASK_CONTROL \
+		| XCB_MOD_MASK_1 | XCB_MOD_MASK_2 | XCB_MOD_MASK_3 | XCB_MOD_MASK_4 | XCB_MOD_MASK_5)
 
 /* atoms identifiers */
-enum { WM_DELETE_WINDOW, WINDOWCHEF_ACTIVE_GROUPS, _IPC_ATOM_COMMAND, WINDOWCHEF_STATUS, NR_ATOMS };
+enum { WM_DELETE_WINDOW, WINDOWCHEF_ACTIVE_GROUPS, _IPC_ATOM_COMMAND, WINDOWCHEF_STATUS, WINDOWCHEF_STATS, WM_WINDOW_ROLE, NR_ATOMS };
+
+/* reasons for repainting a client at the end of an event batch */
+enum {
+	DIRTY_GEOMETRY = 1 << 0,
+	DIRTY_FOCUS    = 1 << 1,
+	DIRTY_CONFIG   = 1 << 2,
+	DIRTY_STATUS   = 1 << 3,
+	DIRTY_CONFIGURE = 1 << 4,
+};
+#define DIRTY_BORDERS (DIRTY_GEOMETRY | DIRTY_FOCUS | DIRTY_CONFIG)
 
 /* button identifiers */
 enum { BUTTON_LEFT, BUTTON_MIDDLE, BUTTON_RIGHT, NR_BUTTONS };
@@ -51,10 +85,54 @@ static int scrno;
 static int  randr_base;
 static bool halt;
 static int  exit_code;
+/* descriptors and timers the main loop waits on */
+static struct loop loop;
+/* wakes up the main loop when a signal arrives */
+static int signal_pipe[2] = { -1, -1 };
+static volatile sig_atomic_t got_sigchld = 0, got_sigterm = 0;
+/* event taken from the queue while deciding whether to sleep */
+static xcb_generic_event_t *queued_event = NULL;
+/* listening ipc socket */
+static int ipc_fd = -1;
+static char ipc_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+static struct list_item *ipc_connections = NULL;
+/* connection the running ipc command came from, NULL for client messages */
+static struct ipc_connection *ipc_current = NULL;
+/* client the running window command acts on */
+static struct client *ipc_target = NULL;
+/* state table shared with readers, and the next version of it */
+static char state_path[MAXLEN * 2];
+static struct ipc_state *state_table = NULL;
+static struct ipc_state state_next;
+/* status and reply payload of the running ipc command */
+static enum IPCStatus ipc_status;
+static struct buffer ipc_reply;
 static bool *group_in_use = NULL;
 static int  last_group = 0;
+/* motion events dropped in favour of a newer one while dragging */
+static uint32_t motion_coalesced = 0;
+/* requests dropped because the server already had the state */
+static uint32_t requests_elided = 0;
+/* requests of ours whose events need no handling, oldest first */
+static struct ignore_ring ignored;
+/* a request was remembered since the end of the last batch */
+static bool ignored_pending = false;
+/* events skipped because one of our requests caused them */
+static uint32_t events_ignored = 0;
+/* root properties as last written by us */
+static bool current_desktop_known = false, active_window_known = false;
+static uint32_t current_desktop;
+static xcb_window_t active_window;
 /* keyboard modifiers (for mouse support) */
 static uint16_t num_lock, caps_lock, scroll_lock;
+static xcb_key_symbols_t *keysyms = NULL;
+/* key bindings, and the keys of the chain pressed so far */
+static struct list_item *bindings = NULL;
+static struct key chord[IPC_MAX_CHORD];
+static uint32_t chord_len = 0;
+/* the chord stays at the lock of a binding until a key doesn't match */
+static bool chord_locked = false;
+static uint32_t chord_timer = 0;
 static const xcb_button_index_t mouse_buttons[] = {
 	XCB_BUTTON_INDEX_1,
 	XCB_BUTTON_INDEX_2,
@@ -64,11 +142,32 @@ static const xcb_button_index_t mouse_buttons[] = {
 static struct list_item *win_list   = NULL;
 static struct list_item *mon_list   = NULL;
 static struct list_item *focus_list = NULL;
+/* index of win_list by window id */
+static struct htable win_table;
+/* _NET_CLIENT_LIST in mapping order, _NET_CLIENT_LIST_STACKING bottom to top */
+static struct window_array client_order, client_stack;
+static bool client_list_dirty;
+/* clients with pending dirty flags */
+static struct window_array dirty_clients;
+/* windows whose replies are collected at the end of the event batch */
+static struct adoption_array pending_adoptions;
+/* window rules by the hash of their class, and those without a class */
+static struct htable rule_table;
+static struct rule *generic_rules = NULL;
+static uint32_t nr_rules = 0;
+/* border pixmaps, most recently used first, and chained by hash of their key */
+static struct list_item *border_cache = NULL;
+static struct htable border_table;
+static uint32_t border_cache_bytes = 0;
+/* one graphics context per drawable depth for painting borders */
+static xcb_gcontext_t border_gc[MAX_DEPTH + 1];
 static char *atom_names[NR_ATOMS] = {
 	"WM_DELETE_WINDOW",
 	"WINDOWCHEF_ACTIVE_GROUPS",
 	ATOM_COMMAND,
 	"WINDOWCHEF_STATUS",
+	"WINDOWCHEF_STATS",
+	"WM_WINDOW_ROLE",
 };
 static xcb_atom_t ATOMS[NR_ATOMS];
 /* function handlers for ipc commands */
@@ -78,9 +177,14 @@ static void (*events[LAST_XCB_EVENT + 1])(xcb_generic_event_t *);
 
 static void cleanup(void);
 static int  setup(void);
+static void handle_event(xcb_generic_event_t *);
+static void ignore_request(xcb_window_t, unsigned int, uint32_t);
+static bool is_ignored_event(xcb_generic_event_t *);
+static void end_event_batch(void);
 static int  setup_randr(void);
 static void get_randr(void);
-static void get_outputs(xcb_randr_output_t *, int len, xcb_timestamp_t);
+static void get_outputs(xcb_randr_output_t *, int len, xcb_timestamp_t,
+		xcb_randr_mode_info_t *, int);
 static struct monitor * find_monitor(xcb_randr_output_t);
 static struct monitor * find_monitor_by_coord(int16_t, int16_t);
 static struct monitor * find_clones(xcb_randr_output_t, int16_t, int16_t);
@@ -88,15 +192,40 @@ static struct monitor * add_monitor(xcb_randr_output_t, char *, int16_t, int16_t
 static void free_monitor(struct monitor *);
 static void get_monitor_size(struct client *, int16_t *, int16_t *, uint16_t *, uint16_t *);
 static void arrange_by_monitor(struct monitor *);
-static struct client * setup_window(xcb_window_t);
+static void adopt_begin(xcb_window_t, bool);
+static void adopt_finish_all(void);
+static void adopt_discard(struct adoption *);
+static struct adoption *find_adoption(xcb_window_t);
+static void adopt_existing_windows(void);
+static bool is_ignored_type(xcb_ewmh_get_atoms_reply_t *);
+static struct client * setup_window(struct adoption *, struct rule *);
+static uint32_t window_type(xcb_ewmh_get_atoms_reply_t *, bool);
+static bool rule_matches(struct rule *, struct client *, uint32_t, const char *);
+static void match_rules(struct client *, uint32_t, const char *, struct rule *);
+static void apply_rule(struct client *, struct rule *);
+static void free_rule(struct rule *);
+static void free_rules(void);
+static void place_client(struct client *);
+static void map_client(struct client *);
+static void show_window(struct client *);
+static void hide_window(struct client *);
+static void set_border_attribute(struct client *, uint32_t, uint32_t);
+static void set_net_wm_state(struct client *, xcb_atom_t, int, xcb_atom_t *);
+static void set_current_desktop(uint32_t);
+static void set_active_window(xcb_window_t);
+static void send_configure_notify(struct client *);
 static void set_focused_no_raise(struct client *);
 static void set_focused(struct client *);
+static void refocus(struct client *);
 static void set_focused_last_best();
 static void raise_window(xcb_window_t);
+static void lower_window(xcb_window_t);
+static void restack_client(struct client *, uint8_t);
+static void forget_stacking(void);
 static void close_window(struct client *);
 static void delete_window(xcb_window_t);
 static void teleport_window(xcb_window_t, int16_t, int16_t);
-static void move_window(xcb_window_t , int16_t, int16_t);
+static void move_window(struct client *, int16_t, int16_t);
 static void resize_window_absolute(xcb_window_t, uint16_t, uint16_t);
 static void resize_window(xcb_window_t, int16_t, int16_t);
 static void fit_on_screen(struct client *);
@@ -119,19 +248,26 @@ static bool is_in_valid_direction(uint32_t, float, float);
 static bool is_in_cardinal_direction(uint32_t , struct client *, struct client *);
 static xcb_atom_t get_atom(char *);
 static void update_desktop_viewport(void);
-static bool get_pointer_location(xcb_window_t *, int16_t *, int16_t *);
 static void center_pointer(struct client *);
 static struct client * find_client(xcb_window_t *);
-static bool get_geometry(xcb_window_t *, int16_t *, int16_t *, uint16_t *, uint16_t *, uint8_t *);
 static void set_borders(struct client *client, uint32_t, uint32_t);
-static bool is_mapped(xcb_window_t);
+static xcb_pixmap_t get_border_pixmap(struct client *, uint32_t, uint32_t);
+static void forget_border_pixmap(struct border_pixmap *);
+static void free_border_cache(void);
+static void set_border_width(struct client *, uint16_t);
+static void commit_configure(struct client *);
 static void free_window(struct client *);
 
-static void add_to_client_list(xcb_window_t);
+static void window_array_append(struct window_array *, xcb_window_t);
+static bool window_array_remove(struct window_array *, xcb_window_t);
+static void mark_dirty(struct client *, uint8_t);
+static void commit_dirty_clients(void);
 static void update_client_list(void);
 static void update_wm_desktop(struct client *);
 static void update_current_desktop(struct client *);
 static void update_window_status(struct client *);
+static int  format_window_status(struct client *, char *, size_t);
+static void publish_window_status(struct client *);
 
 static void group_add_window(struct client *, uint32_t);
 static void group_remove_window(struct client *);
@@ -165,6 +301,8 @@ static void event_client_message(xcb_generic_event_t *);
 static void event_focus_in(xcb_generic_event_t *);
 static void event_focus_out(xcb_generic_event_t *);
 static void event_button_press(xcb_generic_event_t *);
+static void event_key_press(xcb_generic_event_t *);
+static void event_mapping_notify(xcb_generic_event_t *);
 
 static void register_ipc_handlers(void);
 static void ipc_window_move(uint32_t *);
@@ -197,6 +335,38 @@ static void ipc_group_toggle(uint32_t *);
 static void ipc_group_activate_specific(uint32_t *);
 static void ipc_wm_quit(uint32_t *);
 static void ipc_wm_config(uint32_t *);
+static void ipc_wm_stats(uint32_t *);
+static void ipc_subscribe(uint32_t *);
+static void reply_client(struct client *);
+static void ipc_query_focused(uint32_t *);
+static void ipc_query_clients(uint32_t *);
+static void ipc_query_monitors(uint32_t *);
+static void ipc_query_groups(uint32_t *);
+static void ipc_query_focus_history(uint32_t *);
+static void ipc_window_layout(uint32_t *);
+static void ipc_bind(uint32_t *);
+static void ipc_unbind(uint32_t *);
+static void ipc_spawn(uint32_t *);
+static void ipc_rule(uint32_t *);
+static void ipc_unrule(uint32_t *);
+static void ipc_transaction_begin(uint32_t *);
+static void ipc_transaction_commit(uint32_t *);
+static void ipc_transaction_abort(uint32_t *);
+static enum IPCStatus transaction_queue(struct ipc_connection *, uint32_t, uint32_t, uint32_t *);
+static void transaction_discard(struct ipc_connection *);
+static void transaction_expire(void *);
+static enum IPCStatus run_ipc_command(uint32_t, uint32_t *);
+static void ipc_listen(void);
+static void ipc_accept(int, short);
+static struct ipc_connection * find_ipc_connection(int);
+static void ipc_close(struct ipc_connection *);
+static void ipc_read(struct ipc_connection *);
+static bool ipc_write(struct ipc_connection *);
+static void ipc_handle(int, short);
+static void ipc_emit(enum IPCEvent, uint32_t, int32_t, int32_t, uint32_t, uint32_t);
+static void ipc_flush(void);
+static void state_open(void);
+static void state_publish(void);
 
 static void pointer_init(void);
 static int16_t pointer_modfield_from_keysym(xcb_keysym_t);
@@ -205,32 +375,89 @@ static void window_grab_button(xcb_window_t, uint8_t, uint16_t);
 static bool pointer_grab(enum pointer_action);
 static enum resize_handle get_handle(struct client *, xcb_point_t, enum pointer_action);
 static void track_pointer(struct client *, enum pointer_action, xcb_point_t);
+static xcb_generic_event_t * newest_motion(xcb_generic_event_t *, xcb_generic_event_t **);
+static int frame_time_left(struct timespec *, uint32_t);
 static void grab_buttons(void);
 static void ungrab_buttons(void);
+static void grab_key(struct key);
+static void grab_keys(void);
+static bool valid_chain(uint32_t *);
+static bool chain_equal(struct binding *, uint32_t *);
+static bool remove_bindings(uint32_t *);
+static void free_binding(struct binding *);
+static void run_binding(struct binding *);
+static void chord_begin(void);
+static void chord_end(void);
+static void chord_expire(void *);
 
 static void usage(char *);
 static void version(void);
 static void load_defaults(void);
 static void load_config(char *);
+static void read_config_file(char *);
+static void setup_signals(void);
+static void handle_signal(int);
+static void read_signals(int, short);
+static void reset_signals(void);
 
 /*
- * Gracefully disconnect.
+ * Gracefully disconnect. This runs at exit, so forked children must leave
+ * with _exit: it would remove the socket and the state table of the
+ * running window manager.
  */
 
 static void
 cleanup(void)
 {
+	struct list_item *item;
+	struct client *client;
+	uint32_t x;
+
+	/* don't leave windows out of sight for the next window manager */
+	for (item = win_list; item != NULL; item = item->next) {
+		client = item->data;
+		if (client->hidden) {
+			x = client->geom.x;
+			xcb_configure_window(conn, client->window, XCB_CONFIG_WINDOW_X, &x);
+		}
+	}
 	xcb_set_input_focus(conn, XCB_NONE, XCB_INPUT_FOCUS_POINTER_ROOT,
 			XCB_CURRENT_TIME);
 	ungrab_buttons();
+	while (bindings != NULL)
+		free_binding(bindings->data);
+	free_rules();
+	if (keysyms != NULL)
+		xcb_key_symbols_free(keysyms);
+	free_border_cache();
 	if (ewmh != NULL)
 		xcb_ewmh_connection_wipe(ewmh);
 	if (win_list != NULL)
 		list_delete_all_items(&win_list, true);
+	htable_free(&win_table);
+	free(client_order.wins);
+	free(client_stack.wins);
+	free(dirty_clients.wins);
+	free(pending_adoptions.items);
+	while (ipc_connections != NULL)
+		ipc_close(ipc_connections->data);
+	if (ipc_fd != -1) {
+		close(ipc_fd);
+		unlink(ipc_path);
+	}
+	buffer_free(&ipc_reply);
+	if (state_table != NULL) {
+		munmap(state_table, sizeof(struct ipc_state));
+		unlink(state_path);
+	}
+	loop_free(&loop);
 	if (focus_list != NULL)
 	    list_delete_all_items(&focus_list, true);
-	if (conn != NULL)
+	if (conn != NULL) {
+		/* disconnecting doesn't send what is still buffered */
+		xcb_flush(conn);
 		xcb_disconnect(conn);
+	}
 }
 
 /*
@@ -272,7 +499,7 @@ setup(void)
 	xcb_ewmh_init_atoms_replies(ewmh, cookie, (void *)0);
 	xcb_ewmh_set_wm_pid(ewmh, scr->root, getpid());
 	xcb_ewmh_set_wm_name(ewmh, scr->root, strlen(__NAME__), __NAME__);
-	xcb_ewmh_set_current_desktop(ewmh, 0, 0);
+	set_current_desktop(0);
 	xcb_ewmh_set_number_of_desktops(ewmh, 0, GROUPS);
 	update_desktop_viewport();
 
@@ -286,12 +513,15 @@ setup(void)
 		ewmh->_NET_WM_WINDOW_TYPE_DOCK     , ewmh->_NET_WM_PID                  ,
 		ewmh->_NET_WM_WINDOW_TYPE_TOOLBAR  , ewmh->_NET_WM_WINDOW_TYPE_DESKTOP  ,
 		ewmh->_NET_SUPPORTING_WM_CHECK     , ewmh->_NET_DESKTOP_VIEWPORT        ,
+		ewmh->_NET_WM_STATE_HIDDEN         ,
 	};
 	xcb_ewmh_set_supported(ewmh, scrno, sizeof(supported_atoms) / sizeof(xcb_atom_t), supported_atoms);
 
 	xcb_ewmh_set_supporting_wm_check(ewmh, scr->root, scr->root);
+	client_list_dirty = true;
 
 	pointer_init();
+	keysyms = xcb_key_symbols_alloc(conn);
 
 	/* send requests */
 	xcb_flush(conn);
@@ -353,9 +583,12 @@ get_randr(void)
 	len = xcb_randr_get_screen_resources_current_outputs_length(r);
 	xcb_randr_output_t *outputs
 		= xcb_randr_get_screen_resources_current_outputs(r);
+	xcb_randr_mode_info_t *modes
+		= xcb_randr_get_screen_resources_current_modes(r);
+	int modes_len = xcb_randr_get_screen_resources_current_modes_length(r);
 
 	/* Request information for all outputs */
-	get_outputs(outputs, len, timestamp);
+	get_outputs(outputs, len, timestamp, modes, modes_len);
 	free(r);
 }
 
@@ -364,7 +597,8 @@ get_randr(void)
  */
 
 static void
-get_outputs(xcb_randr_output_t *outputs, int len, xcb_timestamp_t timestamp)
+get_outputs(xcb_randr_output_t *outputs, int len, xcb_timestamp_t timestamp,
+		xcb_randr_mode_info_t *modes, int modes_len)
 {
 	int name_len;
 	char *name;
@@ -409,7 +643,7 @@ get_outputs(xcb_randr_output_t *outputs, int len, xcb_timestamp_t timestamp)
 
 			mon = find_monitor(outputs[i]);
 			if (mon == NULL) {
-				add_monitor(outputs[i], name, crtc->x, crtc->y,
+				mon = add_monitor(outputs[i], name, crtc->x, crtc->y,
 						crtc->width, crtc->height);
 			} else {
 				mon->x = crtc->x;
@@ -420,6 +654,19 @@ get_outputs(xcb_randr_output_t *outputs, int len, xcb_timestamp_t timestamp)
 				arrange_by_monitor(mon);
 			}
 
+			/* refresh rate of the current mode, for pacing pointer motion */
+			if (mon != NULL) {
+				mon->refresh_rate = 0;
+				for (int j = 0; j < modes_len; j++) {
+					if (modes[j].id == crtc->mode
+							&& modes[j].htotal != 0 && modes[j].vtotal != 0) {
+						mon->refresh_rate = (uint64_t)modes[j].dot_clock * 1000
+							/ ((uint64_t)modes[j].htotal * modes[j].vtotal);
+						break;
+					}
+				}
+			}
+
 			free(crtc);
 		} else {
 			/* Check if the monitor was used before
@@ -550,6 +797,8 @@ add_monitor(xcb_randr_output_t mon, char *name, int16_t x, int16_t y, uint16_t w
 	monitor->y = y;
 	monitor->width = width;
 	monitor->height = height;
+	monitor->refresh_rate = 0;
+	ipc_emit(IPCEventMonitorAdd, mon, x, y, width, height);
 
 	return monitor;
 }
@@ -563,6 +812,8 @@ free_monitor(struct monitor *mon)
 {
 	struct list_item *item = mon->item;
 
+	ipc_emit(IPCEventMonitorRemove, mon->monitor,
+			mon->x, mon->y, mon->width, mon->height);
 	free(mon);
 	list_delete_item(&mon_list, item);
 }
@@ -623,754 +874,1449 @@ run(void)
 	update_group_list();
 	halt = false;
 	exit_code = EXIT_SUCCESS;
+	/* events are read at the top of the loop, poll only wakes us up */
+	loop_add_fd(&loop, xcb_get_file_descriptor(conn), POLLIN, NULL);
 	while (!halt) {
-		xcb_flush(conn);
-		ev = xcb_wait_for_event(conn);
-		if (ev) {
-			DMSG("X Event %d\n", ev->response_type & ~0x80);
-			if (ev->response_type == randr_base + XCB_RANDR_SCREEN_CHANGE_NOTIFY) {
-				get_randr();
-				DMSG("Screen layout changed\n");
-			}
-			if (events[EVENT_MASK(ev->response_type)] != NULL)
-				(events[EVENT_MASK(ev->response_type)])(ev);
+		/* everything already queued is handled as one batch */
+		ev = queued_event != NULL ? queued_event : xcb_poll_for_event(conn);
+		queued_event = NULL;
+		while (ev != NULL) {
+			handle_event(ev);
 			free(ev);
+			ev = xcb_poll_for_event(conn);
+		}
+		loop_run_timers(&loop);
+		end_event_batch();
+
+		if (xcb_connection_has_error(conn)) {
+			warnx("lost the connection to the X server");
+			exit_code = EXIT_FAILURE;
+			break;
 		}
+
+		/* replies read during the batch may have queued more events */
+		queued_event = xcb_poll_for_queued_event(conn);
+		if (!halt && loop_poll(&loop, queued_event == NULL) < 0)
+			err(EXIT_FAILURE, "poll");
 	}
+	free(queued_event);
+	queued_event = NULL;
 }
 
 /*
- * Initialize a window for further work.
+ * Dispatch an event to its handler.
  */
 
-static struct client *
-setup_window(xcb_window_t win)
+static void
+handle_event(xcb_generic_event_t *ev)
 {
-	uint32_t values[2];
-	xcb_ewmh_get_atoms_reply_t win_type;
-	xcb_atom_t atom;
-	struct client *client;
-	struct list_item *item;
-	struct list_item *focus_item;
-	xcb_size_hints_t hints;
-
-	if (xcb_ewmh_get_wm_window_type_reply(ewmh,
-				xcb_ewmh_get_wm_window_type(ewmh, win),
-				&win_type, NULL) == 1) {
-		unsigned int i = 0;
-		/* if the window is a toolbar or a dock, map it and ignore it */
-		while (i < win_type.atoms_len &&
-			(atom = win_type.atoms[i]) != ewmh->_NET_WM_WINDOW_TYPE_TOOLBAR
-			&& atom != ewmh->_NET_WM_WINDOW_TYPE_DOCK
-			&& atom != ewmh->_NET_WM_WINDOW_TYPE_DESKTOP)
-			i++;
-
-		if (i < win_type.atoms_len) {
-			xcb_ewmh_get_atoms_reply_wipe(&win_type);
-			xcb_map_window(conn, win);
-			return NULL;
-		}
-	}
-
-	/* subscribe to events */
-	values[0] = XCB_EVENT_MASK_ENTER_WINDOW | XCB_EVENT_MASK_FOCUS_CHANGE;
-	xcb_change_window_attributes(conn, win, XCB_CW_EVENT_MASK, values);
-
-	/* in case of fire */
-	xcb_change_save_set(conn, XCB_SET_MODE_INSERT, win);
-
-	/* assign to the null group */
-	xcb_ewmh_set_wm_desktop(ewmh, win, NULL_GROUP);
-
-	item = list_add_item(&win_list);
-	if (item == NULL)
-		return NULL;
-
-	focus_item = list_add_item(&focus_list);
-	if (focus_item == NULL)
-	    return NULL;
-
-	client = malloc(sizeof(struct client));
-	if (client == NULL)
-		return NULL;
-
-	/* initialize variables */
-	focus_item->data = client;
-	client->focus_item = focus_item;
-	item->data = client;
-	client->item = item;
-	client->window = win;
-	client->geom.x = client->geom.y = client->geom.width
-				   = client->geom.height
-				   = client->min_width = client->min_height = 0;
-	client->grid.gx = client->grid.gy = client->grid.px
-		= client->grid.py = client->grid.sx = client->grid.sy = 0;
-	client->width_inc = client->height_inc = 1;
-	client->maxed  = client->hmaxed = client->vmaxed
-		= client->monocled = client->gridded = client->geom.set_by_user = false;
-	client->monitor = NULL;
-	client->mapped  = false;
-	client->group   = NULL_GROUP;
-	get_geometry(&client->window, &client->geom.x, &client->geom.y,
-			&client->geom.width, &client->geom.height, &client->depth);
-
-	xcb_icccm_get_wm_normal_hints_reply(conn,
-			xcb_icccm_get_wm_normal_hints_unchecked(conn, win),
-			&hints, NULL);
-
-	if (hints.flags & XCB_ICCCM_SIZE_HINT_US_POSITION)
-		client->geom.set_by_user = true;
-
-	if (hints.flags & XCB_ICCCM_SIZE_HINT_P_MIN_SIZE) {
-		client->min_width = hints.min_width;
-		client->min_height = hints.min_height;
-	}
-
-	if (hints.flags & XCB_ICCCM_SIZE_HINT_P_RESIZE_INC) {
-		client->width_inc  = hints.width_inc;
-		client->height_inc = hints.height_inc;
+	DMSG("X Event %d\n", ev->response_type & ~0x80);
+	if (is_ignored_event(ev))
+		return;
+	if (ev->response_type == randr_base + XCB_RANDR_SCREEN_CHANGE_NOTIFY) {
+		get_randr();
+		DMSG("Screen layout changed\n");
 	}
-
-	update_window_status(client);
-	DMSG("new window was born 0x%08x\n", client->window);
-
-	return client;
+	if (events[EVENT_MASK(ev->response_type)] != NULL)
+		(events[EVENT_MASK(ev->response_type)])(ev);
 }
 
 /*
- * Set focus state to active or inactive without raising the window.
+ * Remember that the notify events of the given kinds caused by a request
+ * of ours on a window need no handling.
  */
 
 static void
-set_focused_no_raise(struct client *client)
+ignore_request(xcb_window_t win, unsigned int sequence, uint32_t kinds)
 {
-	long data[] = {
-		XCB_ICCCM_WM_STATE_NORMAL,
-		XCB_NONE,
-	};
-	if (client == NULL)
-		return;
-
-	/* show window if hidden */
-	xcb_map_window(conn, client->window);
-
-	if (!client->maxed)
-		set_borders(client, conf.focus_color, conf.internal_focus_color);
-
-	/* focus the window */
-	xcb_set_input_focus(conn, XCB_INPUT_FOCUS_POINTER_ROOT,
-			client->window, XCB_CURRENT_TIME);
+	ignore_ring_add(&ignored, win, sequence, kinds);
+	ignored_pending = true;
+}
 
-	/* set ewmh property */
-	xcb_change_property(conn, XCB_PROP_MODE_REPLACE, scr->root,
-			ewmh->_NET_ACTIVE_WINDOW, XCB_ATOM_WINDOW, 32, 1, &client->window);
+/*
+ * Tell if an event was caused by a request of ours, whose effects are
+ * already known. The event must be of a kind the request causes: a client
+ * unmapping its window right before our configure is handled. Unmap and
+ * configure notifies must be about the window of the request. Crossing
+ * events can be about any window: the one that moved under the pointer or
+ * the one it uncovered.
+ */
 
-	/* set window state */
-	xcb_change_property(conn, XCB_PROP_MODE_REPLACE, client->window,
-						ewmh->_NET_WM_STATE, ewmh->_NET_WM_STATE, 32, 2, data);
+static bool
+is_ignored_event(xcb_generic_event_t *ev)
+{
+	xcb_window_t win;
+	enum ignore_kind kind;
 
-	/* set the focus state to inactive on the previously focused window */
-	if (client != focused_win) {
-		if (focused_win != NULL && !focused_win->maxed)
-			set_borders(focused_win, conf.unfocus_color, conf.internal_unfocus_color);
+	/* synthetic events have the high bit set and are never ignored */
+	switch (ev->response_type) {
+	case XCB_UNMAP_NOTIFY:
+		win = ((xcb_unmap_notify_event_t *)ev)->window;
+		kind = IGNORE_UNMAP;
+		break;
+	case XCB_CONFIGURE_NOTIFY:
+		win = ((xcb_configure_notify_event_t *)ev)->window;
+		kind = IGNORE_CONFIGURE;
+		break;
+	case XCB_ENTER_NOTIFY:
+		win = XCB_NONE;
+		kind = IGNORE_CROSSING;
+		break;
+	default:
+		ignore_ring_expire(&ignored, ev->full_sequence);
+		return false;
 	}
 
-	if (client->focus_item != NULL)
-		list_move_to_head(&focus_list, client->focus_item);
-
-	focused_win = client;
+	if (!ignore_ring_match(&ignored, ev->full_sequence, win, kind))
+		return false;
 
-	window_grab_buttons(focused_win->window);
+	events_ignored++;
+	return true;
 }
 
 /*
- * Focus and raise.
+ * Publish the state that changed while handling a batch of events
+ * and send all requests to the server.
  */
 
 static void
-set_focused(struct client *client)
+end_event_batch(void)
 {
-	set_focused_no_raise(client);
-	raise_window(client->window);
+	adopt_finish_all();
+	commit_dirty_clients();
+	update_client_list();
+	state_publish();
+	/*
+	 * Events carry the sequence of our last request the server handled.
+	 * Without a request after ours, the pointer crossings the user causes
+	 * later would look like they came from our last ignored request.
+	 */
+	if (ignored_pending) {
+		xcb_no_operation(conn);
+		ignored_pending = false;
+	}
+	xcb_flush(conn);
+	/* a reply means the requests of the command reached the server */
+	ipc_flush();
 }
 
 /*
- * Focus last best focus (in a valid group, mapped, etc)
+ * Send every request needed to manage a window. The replies are read by
+ * adopt_finish_all at the end of the event batch.
  */
 
 static void
-set_focused_last_best()
+adopt_begin(xcb_window_t win, bool map)
 {
-	struct list_item *focused_item;
-	struct client *client;
-
-	focused_item = focus_list->next;
-	if (focused_item == NULL)
-		focused_item = focus_list;
-
-	while (focused_item != NULL) {
-		client = focused_item->data;
+	struct adoption *a;
+	if (find_adoption(win) != NULL)
+		return;
 
-		if (client != NULL && client->mapped) {
-			set_focused(client);
+	if (pending_adoptions.len == pending_adoptions.size) {
+		a = realloc(pending_adoptions.items, (pending_adoptions.size ?
+				pending_adoptions.size * 2 : 16) * sizeof(struct adoption));
+		if (a == NULL)
 			return;
-		}
-
-		focused_item = focused_item->next;
+		pending_adoptions.items = a;
+		pending_adoptions.size = pending_adoptions.size ?
+			pending_adoptions.size * 2 : 16;
 	}
-}
-
-/*
- * Put window at the top of the window stack.
- */
 
-static void
-raise_window(xcb_window_t win)
-{
-	uint32_t values[1] = { XCB_STACK_MODE_ABOVE };
-	xcb_configure_window(conn, win, XCB_CONFIG_WINDOW_STACK_MODE, values);
+	a = &pending_adoptions.items[pending_adoptions.len++];
+	a->window    = win;
+	a->map       = map;
+	a->type      = xcb_ewmh_get_wm_window_type_unchecked(ewmh, win);
+	a->geometry  = xcb_get_geometry(conn, win);
+	a->hints     = xcb_icccm_get_wm_normal_hints_unchecked(conn, win);
+	a->protocols = xcb_icccm_get_wm_protocols_unchecked(conn, win,
+			ewmh->WM_PROTOCOLS);
+	a->class     = xcb_icccm_get_wm_class_unchecked(conn, win);
+	a->transient = xcb_icccm_get_wm_transient_for_unchecked(conn, win);
+	a->role      = xcb_get_property_unchecked(conn, false, win,
+			ATOMS[WM_WINDOW_ROLE], XCB_ATOM_STRING, 0, 64);
 }
 
 /*
- * Ask window to close gracefully. If the window doesn't respond, kill it.
+ * Collect the replies of every pending adoption and manage the windows.
+ * All requests were sent before the first reply is waited on, so a burst
+ * of new windows costs about one round trip.
  */
 
 static void
-close_window(struct client *client)
+adopt_finish_all(void)
 {
-	if (client == NULL)
+	xcb_query_pointer_reply_t *pointer;
+	struct adoption *a;
+	struct client *client;
+	struct rule rule;
+	uint32_t i;
+	bool hidden;
+
+	if (pending_adoptions.len == 0)
 		return;
 
-	if (conf.last_window_focusing && client != NULL && client == focused_win)
-	    set_focused_last_best();
+	/* sent last, so its reply is the last one to arrive */
+	pointer = xcb_query_pointer_reply(conn,
+			xcb_query_pointer(conn, scr->root), NULL);
 
-	if (focused_win == client)
-		focused_win = NULL;
+	for (i = 0; i < pending_adoptions.len; i++) {
+		a = &pending_adoptions.items[i];
+		if (a->window == XCB_NONE)
+			continue;
+		client = setup_window(a, &rule);
 
-	xcb_window_t win = client->window;
-	xcb_get_property_cookie_t cookie =
-		xcb_icccm_get_wm_protocols_unchecked(conn,
-				win, ewmh->WM_PROTOCOLS);
-	xcb_icccm_get_wm_protocols_reply_t reply;
-	unsigned int i = 0;
-	bool got = false;
-
-	if (xcb_icccm_get_wm_protocols_reply(conn, cookie, &reply, NULL)) {
-		for (i = 0; i < reply.atoms_len; i++) {
-			got = (reply.atoms[i] = ATOMS[WM_DELETE_WINDOW]);
-			if (got)
-				break;
+		/* client is a dock or some kind of window that needs to be ignored */
+		if (client == NULL)
+			continue;
+
+		/* already on screen, leave it where it is */
+		if (!a->map) {
+			client->mapped = true;
+			if (randr_base != -1)
+				client->monitor = find_monitor_by_coord(client->geom.x,
+						client->geom.y);
+			mark_dirty(client, DIRTY_CONFIG);
+			update_window_status(client);
+			continue;
+		}
+
+		if (rule.actions & IPCRuleGeometry) {
+			client->geom.x = rule.x;
+			client->geom.y = rule.y;
+			client->geom.width = rule.width;
+			client->geom.height = rule.height;
+			teleport_window(client->window, client->geom.x, client->geom.y);
+			resize_window_absolute(client->window, client->geom.width, client->geom.height);
+		} else if (!client->geom.set_by_user) {
+			if (pointer != NULL) {
+				client->geom.x = pointer->root_x;
+				client->geom.y = pointer->root_y;
+			} else {
+				client->geom.x = client->geom.y = 0;
+			}
+
+			client->geom.x -= client->geom.width / 2;
+			client->geom.y -= client->geom.height / 2;
+			teleport_window(client->window, client->geom.x, client->geom.y);
+		}
+		/* a window joining a hidden group stays hidden with it */
+		hidden = (rule.actions & IPCRuleGroup) && rule.group - 1 < conf.groups
+			&& !group_in_use[rule.group - 1];
+		if (hidden) {
+			client->group = rule.group - 1;
+			update_wm_desktop(client);
+			update_window_status(client);
+		} else if (rule.actions & IPCRuleGroup) {
+			group_add_window(client, rule.group - 1);
+		} else if (conf.sticky_windows) {
+			group_add_window(client, last_group);
 		}
+		apply_rule(client, &rule);
 
-		xcb_icccm_get_wm_protocols_reply_wipe(&reply);
+		/* group_activate maps it */
+		if (hidden)
+			place_client(client);
+		else
+			map_client(client);
 	}
 
-	if (got)
-		delete_window(win);
-	else
-		xcb_kill_client(conn, win);
+	free(pointer);
+	pending_adoptions.len = 0;
 }
 
 /*
- * Gracefully ask a window to close.
+ * Throw away the replies of an adoption that won't be completed.
  */
 
 static void
-delete_window(xcb_window_t win)
+adopt_discard(struct adoption *a)
 {
-	xcb_client_message_event_t ev;
-
-	ev.response_type = XCB_CLIENT_MESSAGE;
-	ev.sequence = 0;
-	ev.format = 32;
-	ev.window = win;
-	ev.type = ewmh->WM_PROTOCOLS;
-	ev.data.data32[0] = ATOMS[WM_DELETE_WINDOW];
-	ev.data.data32[1] = XCB_CURRENT_TIME;
-
-	xcb_send_event(conn, 0, win, XCB_EVENT_MASK_NO_EVENT, (char *)&ev);
+	xcb_discard_reply(conn, a->type.sequence);
+	xcb_discard_reply(conn, a->geometry.sequence);
+	xcb_discard_reply(conn, a->hints.sequence);
+	xcb_discard_reply(conn, a->protocols.sequence);
+	xcb_discard_reply(conn, a->class.sequence);
+	xcb_discard_reply(conn, a->transient.sequence);
+	xcb_discard_reply(conn, a->role.sequence);
+	a->window = XCB_NONE;
 }
 
 /*
- * Teleports window absolutely to the given coordinates.
+ * Get the pending adoption of a window, if any.
  */
 
-static void
-teleport_window(xcb_window_t win, int16_t x, int16_t y)
+static struct adoption *
+find_adoption(xcb_window_t win)
 {
-	uint32_t values[2] = {x, y};
-
-	if (win == scr->root || win == 0)
-		return;
+	uint32_t i;
 
-	xcb_configure_window(conn, win, XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y, values);
-	update_window_status(find_client(&win));
+	for (i = 0; i < pending_adoptions.len; i++)
+		if (pending_adoptions.items[i].window == win)
+			return &pending_adoptions.items[i];
 
-	xcb_flush(conn);
+	return NULL;
 }
 
 /*
- * Moves the window by a certain amount.
+ * Manage the windows that were mapped before windowchef started.
+ * The attributes and adoption requests of every child of the root are
+ * sent before any reply is read.
  */
 
 static void
-move_window(xcb_window_t win, int16_t x, int16_t y)
+adopt_existing_windows(void)
 {
-	int16_t win_x, win_y;
-	uint16_t win_w, win_h;
+	xcb_query_tree_reply_t *tree;
+	xcb_window_t *children;
+	xcb_get_window_attributes_cookie_t *cookies;
+	xcb_get_window_attributes_reply_t *attr;
+	struct adoption *a;
+	uint32_t first, i, j;
+	int len;
 
-	if (!is_mapped(win) || win == scr->root)
+	tree = xcb_query_tree_reply(conn, xcb_query_tree(conn, scr->root), NULL);
+	if (tree == NULL)
 		return;
 
-	get_geometry(&win, &win_x, &win_y, &win_w, &win_h, NULL);
+	len = xcb_query_tree_children_length(tree);
+	children = xcb_query_tree_children(tree);
+	cookies = malloc(len * sizeof(xcb_get_window_attributes_cookie_t));
+	if (cookies == NULL) {
+		free(tree);
+		return;
+	}
+
+	first = pending_adoptions.len;
+	for (i = 0; i < (uint32_t)len; i++) {
+		cookies[i] = xcb_get_window_attributes(conn, children[i]);
+		adopt_begin(children[i], false);
+	}
 
-	win_x += x;
-	win_y += y;
+	/* adopt_begin may have skipped windows, so match them by id */
+	j = first;
+	for (i = 0; i < (uint32_t)len; i++) {
+		attr = xcb_get_window_attributes_reply(conn, cookies[i], NULL);
+		a = NULL;
+		if (j < pending_adoptions.len && pending_adoptions.items[j].window == children[i])
+			a = &pending_adoptions.items[j++];
+
+		if (a != NULL && (attr == NULL || attr->override_redirect
+					|| attr->map_state != XCB_MAP_STATE_VIEWABLE))
+			adopt_discard(a);
+		free(attr);
+	}
 
-	teleport_window(win, win_x, win_y);
+	free(cookies);
+	free(tree);
+	adopt_finish_all();
+	DMSG("adopted existing windows, %d children of the root\n", len);
 }
 
 /*
- * Resizes window to the given size.
+ * Returns true if the window is a toolbar, a dock or a desktop.
  */
 
-static void
-resize_window_absolute(xcb_window_t win, uint16_t w, uint16_t h)
+static bool
+is_ignored_type(xcb_ewmh_get_atoms_reply_t *win_type)
 {
-	uint32_t val[2];
-	uint32_t mask = XCB_CONFIG_WINDOW_WIDTH
-				  | XCB_CONFIG_WINDOW_HEIGHT;
-
-	val[0] = w;
-	val[1] = h;
+	xcb_atom_t atom;
+	unsigned int i;
+
+	for (i = 0; i < win_type->atoms_len; i++) {
+		atom = win_type->atoms[i];
+		if (atom == ewmh->_NET_WM_WINDOW_TYPE_TOOLBAR
+				|| atom == ewmh->_NET_WM_WINDOW_TYPE_DOCK
+				|| atom == ewmh->_NET_WM_WINDOW_TYPE_DESKTOP)
+			return true;
+	}
 
-	xcb_configure_window(conn, win, mask, val);
-	update_window_status(find_client(&win));
-	refresh_borders();
+	return false;
 }
 
 /*
- * Resizes window by a certain amount.
+ * Reads the replies of an adoption and creates the client.
  */
 
-static void
-resize_window(xcb_window_t win, int16_t w, int16_t h)
+static struct client *
+setup_window(struct adoption *a, struct rule *rule)
 {
+	uint32_t values[2];
+	xcb_window_t win = a->window;
+	xcb_ewmh_get_atoms_reply_t win_type;
+	xcb_get_geometry_reply_t *geom;
+	xcb_icccm_get_wm_protocols_reply_t protocols;
+	xcb_icccm_get_wm_class_reply_t class;
+	xcb_window_t transient_for = XCB_NONE;
 	struct client *client;
-	int32_t aw, ah;
+	struct list_item *item;
+	struct list_item *focus_item;
+	xcb_size_hints_t hints;
+	xcb_get_property_reply_t *role_reply;
+	char role[256];
+	bool ignored = false, delete_window = false, has_class, has_hints, has_type;
+	uint32_t type;
+	unsigned int i;
+	int len;
 
-	client = find_client(&win);
-	if (client == NULL)
-		return;
+	/* read every reply first so none is left behind on early return */
+	has_type = xcb_ewmh_get_wm_window_type_reply(ewmh, a->type, &win_type, NULL) == 1;
+	if (has_type)
+		ignored = is_ignored_type(&win_type);
+	geom = xcb_get_geometry_reply(conn, a->geometry, NULL);
+	has_hints = xcb_icccm_get_wm_normal_hints_reply(conn, a->hints, &hints, NULL);
+	if (xcb_icccm_get_wm_protocols_reply(conn, a->protocols, &protocols, NULL) == 1) {
+		for (i = 0; i < protocols.atoms_len && !delete_window; i++)
+			delete_window = protocols.atoms[i] == ATOMS[WM_DELETE_WINDOW];
+		xcb_icccm_get_wm_protocols_reply_wipe(&protocols);
+	}
+	has_class = xcb_icccm_get_wm_class_reply(conn, a->class, &class, NULL);
+	xcb_icccm_get_wm_transient_for_reply(conn, a->transient, &transient_for, NULL);
+	role[0] = '\0';
+	role_reply = xcb_get_property_reply(conn, a->role, NULL);
+	if (role_reply != NULL && role_reply->format == 8) {
+		len = xcb_get_property_value_length(role_reply);
+		if (len > (int)sizeof(role) - 1)
+			len = sizeof(role) - 1;
+		memcpy(role, xcb_get_property_value(role_reply), len);
+		role[len] = '\0';
+	}
+	free(role_reply);
 
-	aw = client->geom.width;
-	ah = client->geom.height;
+	type = window_type(has_type ? &win_type : NULL, transient_for != XCB_NONE);
+	if (has_type)
+		xcb_ewmh_get_atoms_reply_wipe(&win_type);
+	memset(rule, 0, sizeof(struct rule));
 
-	if (aw + w > 0)
-		aw += w;
-	if (ah + h > 0)
-		ah += h;
+	/* if the window is a toolbar or a dock, map it and ignore it */
+	if (ignored || geom == NULL) {
+		if (ignored && a->map)
+			xcb_map_window(conn, win);
+		free(geom);
+		if (has_class)
+			xcb_icccm_get_wm_class_reply_wipe(&class);
+		return NULL;
+	}
 
-	/* avoid weird stuff */
-	if (aw < 0)
-		aw = 0;
-	if (ah < 0)
-		ah = 0;
+	client = malloc(sizeof(struct client));
+	item = list_add_item(&win_list);
+	focus_item = list_add_item(&focus_list);
+	if (client == NULL || item == NULL || focus_item == NULL
+			|| !htable_put(&win_table, win, client)) {
+		free(client);
+		if (item != NULL)
+			list_delete_item(&win_list, item);
+		if (focus_item != NULL)
+			list_delete_item(&focus_list, focus_item);
+		free(geom);
+		if (has_class)
+			xcb_icccm_get_wm_class_reply_wipe(&class);
+		return NULL;
+	}
 
-	if (client->min_width != 0 && aw < client->min_width)
-		aw = client->min_width;
+	/* subscribe to events */
+	values[0] = XCB_EVENT_MASK_ENTER_WINDOW | XCB_EVENT_MASK_FOCUS_CHANGE;
+	xcb_change_window_attributes(conn, win, XCB_CW_EVENT_MASK, values);
 
-	if (client->min_height != 0 && ah < client->min_height)
-		ah = client->min_height;
+	/* in case of fire */
+	xcb_change_save_set(conn, XCB_SET_MODE_INSERT, win);
 
-	client->geom.width  = aw - conf.resize_hints * (aw % client->width_inc);
-	client->geom.height = ah - conf.resize_hints * (ah % client->height_inc);
+	/* assign to the null group */
+	xcb_ewmh_set_wm_desktop(ewmh, win, NULL_GROUP);
 
-	resize_window_absolute(win, client->geom.width, client->geom.height);
-}
+	window_array_append(&client_order, win);
+	window_array_append(&client_stack, win);
+	client_list_dirty = true;
 
-/*
- * Fit window on screen if too big.
- */
+	/* initialize variables */
+	focus_item->data = client;
+	client->focus_item = focus_item;
+	item->data = client;
+	client->item = item;
+	client->window = win;
+	client->geom.x = geom->x;
+	client->geom.y = geom->y;
+	client->geom.width = geom->width;
+	client->geom.height = geom->height;
+	client->depth = geom->depth;
+	client->min_width = client->min_height = 0;
+	client->grid.gx = client->grid.gy = client->grid.px
+		= client->grid.py = client->grid.sx = client->grid.sy = 0;
+	client->width_inc = client->height_inc = 1;
+	client->max_width = client->max_height = 0;
+	client->status_len = 0;
+	client->configure.mask = 0;
+	client->maxed  = client->hmaxed = client->vmaxed
+		= client->monocled = client->gridded = client->geom.set_by_user = false;
+	client->monitor = NULL;
+	client->mapped  = false;
+	client->group   = NULL_GROUP;
+	client->dirty   = 0;
+	client->configure.notify = false;
+	client->shadow.mapped = !a->map;
+	client->shadow.stack_known = false;
+	client->shadow.x = geom->x;
+	client->shadow.y = geom->y;
+	client->shadow.width = geom->width;
+	client->shadow.height = geom->height;
+	client->shadow.border_width = geom->border_width;
+	client->shadow.border_attr = 0;
+	client->shadow.wm_state_len = -1;
+	client->delete_window = delete_window;
+	client->transient_for = transient_for;
+	client->no_focus = false;
+	client->hidden = false;
+	client->class_name = client->instance_name = NULL;
+	if (has_class) {
+		client->class_name = strdup(class.class_name);
+		client->instance_name = strdup(class.instance_name);
+		xcb_icccm_get_wm_class_reply_wipe(&class);
+	}
+	free(geom);
 
-static void
-fit_on_screen(struct client *client)
-{
-	int16_t mon_x, mon_y;
-	uint16_t mon_width, mon_height;
-	bool will_resize, will_move;
+	if (has_hints && (hints.flags & XCB_ICCCM_SIZE_HINT_US_POSITION))
+		client->geom.set_by_user = true;
 
-	will_resize = will_move = false;
-	client->hmaxed = client->vmaxed = false;
-	get_monitor_size(client, &mon_x, &mon_y, &mon_width, &mon_height);
-	if (client->maxed) {
-		client->maxed = false;
-	} else if (client->geom.width == mon_width && client->geom.height == mon_height) {
-		client->geom.x = mon_x;
-		client->geom.y = mon_y;
-		client->geom.width -= 2 * conf.border_width;
-		client->geom.height -= 2 * conf.border_width;
-		maximize_window(client, mon_x, mon_y, mon_width, mon_height);
-		return;
+	if (has_hints && (hints.flags & XCB_ICCCM_SIZE_HINT_P_MIN_SIZE)) {
+		client->min_width = hints.min_width;
+		client->min_height = hints.min_height;
 	}
 
-	/* Is it outside the display? */
-	if (client->geom.x > mon_x + mon_width || client->geom.y > mon_y + mon_height
-			|| client->geom.x < mon_x || client->geom.y < mon_y) {
-		will_move = true;
-		if (client->geom.x > mon_x + mon_width)
-			client->geom.x = mon_x + mon_width - client->geom.width - 2 * conf.border_width;
-		else if (client->geom.x < mon_x)
-			client->geom.x = mon_x;
-		if (client->geom.y > mon_y + mon_height)
-			client->geom.y = mon_y + mon_height - client->geom.height - 2 * conf.border_width;
-		else if (client->geom.y < mon_y)
-			client->geom.y = mon_y;
+	if (has_hints && (hints.flags & XCB_ICCCM_SIZE_HINT_P_RESIZE_INC)) {
+		client->width_inc  = hints.width_inc;
+		client->height_inc = hints.height_inc;
 	}
 
-	/* Is it smaller than it wants to be? */
-	if (client->min_width != 0 && client->geom.width < client->min_width) {
-		client->geom.width = client->min_width;
-		will_resize = true;
-	}
-	if (client->min_height != 0 && client->geom.height < client->min_height) {
-		client->geom.height = client->min_height;
+	match_rules(client, type, role, rule);
 
-		will_resize = true;
-	}
+	update_window_status(client);
+	DMSG("new window was born 0x%08x\n", client->window);
 
-	/* If the window is larger than the screen or is a bit in the outside,
-	 * move it to the corner and resize it accordingly. */
-	if (client->geom.width + 2 * conf.border_width > mon_width) {
-		client->geom.x = mon_x;
-		client->geom.width = mon_width - 2 * conf.border_width;
-		will_move = will_resize = true;
-	} else if (client->geom.x + client->geom.width + 2 * conf.border_width
-			> mon_x + mon_width) {
-		client->geom.x = mon_x + mon_width - client->geom.width - 2 * conf.border_width;
-		will_move = true;
-	}
+	return client;
+}
 
-	if (client->geom.height + 2 * conf.border_width > mon_height) {
-		client->geom.y = mon_y;
-		client->geom.height = mon_height - 2 * conf.border_width;
-		will_move = will_resize = true;
-	} else if (client->geom.y + client->geom.height + 2 * conf.border_width
-			> mon_y + mon_height) {
-		client->geom.y = mon_y + mon_height - client->geom.height - 2 * conf.border_width;
-		will_move = true;
+/*
+ * The first type of the window that rules know, or the type it has by
+ * default.
+ */
+
+static uint32_t
+window_type(xcb_ewmh_get_atoms_reply_t *win_type, bool transient)
+{
+	xcb_atom_t atom;
+	unsigned int i;
+
+	for (i = 0; win_type != NULL && i < win_type->atoms_len; i++) {
+		atom = win_type->atoms[i];
+		if (atom == ewmh->_NET_WM_WINDOW_TYPE_NORMAL)
+			return IPCWindowTypeNormal;
+		if (atom == ewmh->_NET_WM_WINDOW_TYPE_DIALOG)
+			return IPCWindowTypeDialog;
+		if (atom == ewmh->_NET_WM_WINDOW_TYPE_UTILITY)
+			return IPCWindowTypeUtility;
+		if (atom == ewmh->_NET_WM_WINDOW_TYPE_SPLASH)
+			return IPCWindowTypeSplash;
+		if (atom == ewmh->_NET_WM_WINDOW_TYPE_MENU)
+			return IPCWindowTypeMenu;
+		if (atom == ewmh->_NET_WM_WINDOW_TYPE_NOTIFICATION)
+			return IPCWindowTypeNotification;
 	}
 
-	if (will_move)
-		teleport_window(client->window, client->geom.x, client->geom.y);
-	if (will_resize)
-		resize_window_absolute(client->window, client->geom.width, client->geom.height);
+	/* what ewmh says windows without a type are */
+	return transient ? IPCWindowTypeDialog : IPCWindowTypeNormal;
 }
 
-static void
-maximize_window(struct client *client, int16_t mon_x, int16_t mon_y, uint16_t mon_width, uint16_t mon_height)
+static bool
+rule_matches(struct rule *r, struct client *client, uint32_t type, const char *role)
 {
-	uint32_t values[1];
-	if (client == NULL)
-		return;
+	if ((r->match & IPCRuleClass) && (client->class_name == NULL
+				|| strcmp(r->class_name, client->class_name) != 0))
+		return false;
+	if ((r->match & IPCRuleInstance) && (client->instance_name == NULL
+				|| strcmp(r->instance_name, client->instance_name) != 0))
+		return false;
+	if ((r->match & IPCRuleRole) && strcmp(r->role, role) != 0)
+		return false;
+	if ((r->match & IPCRuleType) && r->type != type)
+		return false;
+	if ((r->match & IPCRuleTransient) && r->transient != (client->transient_for != XCB_NONE))
+		return false;
 
-	if (is_special(client))
-		reset_window(client);
+	return true;
+}
 
-	client->maxed = true;
+/*
+ * Merge the actions of every rule the window matches into applied, later
+ * rules overriding earlier ones. Only the rules chained under the class of
+ * the window and those without a class are looked at.
+ */
 
-	/* maximized windows don't have borders */
-	values[0] = 0;
-	if (client->geom.width != mon_width || client->geom.height != mon_height)
-		client->orig_geom = client->geom;
-	xcb_configure_window(conn, client->window, XCB_CONFIG_WINDOW_BORDER_WIDTH,
-			values);
+static void
+match_rules(struct client *client, uint32_t type, const char *role, struct rule *applied)
+{
+	struct rule *by_class = NULL, *any = generic_rules, *r;
 
-	client->geom.x = mon_x;
-	client->geom.y = mon_y;
-	client->geom.width = mon_width;
-	client->geom.height = mon_height;
+	if (nr_rules == 0)
+		return;
+	if (client->class_name != NULL)
+		by_class = htable_get(&rule_table, hash_string(client->class_name));
 
-	teleport_window(client->window, client->geom.x, client->geom.y);
-	resize_window_absolute(client->window, client->geom.width, client->geom.height);
-	set_focused_no_raise(client);
+	while (by_class != NULL || any != NULL) {
+		if (any == NULL || (by_class != NULL && by_class->order < any->order)) {
+			r = by_class;
+			by_class = by_class->next;
+		} else {
+			r = any;
+			any = any->next;
+		}
+		if (!rule_matches(r, client, type, role))
+			continue;
 
-	update_ewmh_wm_state(client);
-	update_window_status(client);
+		if (r->actions & IPCRuleGroup)
+			applied->group = r->group;
+		if (r->actions & IPCRuleGeometry) {
+			applied->x = r->x;
+			applied->y = r->y;
+			applied->width = r->width;
+			applied->height = r->height;
+		}
+		if (r->actions & IPCRuleGrid)
+			memcpy(applied->grid, r->grid, sizeof(r->grid));
+		if (r->actions & IPCRuleState)
+			applied->state = r->state;
+		if (r->actions & IPCRuleFocus)
+			applied->focus = r->focus;
+		applied->actions |= r->actions;
+		DMSG("rule %u matches 0x%08x\n", r->order, client->window);
+	}
 }
 
+/*
+ * Put a new window in the grid slot and state its rules ask for, before
+ * it is mapped.
+ */
+
 static void
-hmaximize_window(struct client *client, int16_t mon_x, uint16_t mon_width)
+apply_rule(struct client *client, struct rule *rule)
 {
-	if (client == NULL)
-		return;
+	int16_t mon_x, mon_y;
+	uint16_t mon_w, mon_h;
+	uint32_t *g = rule->grid;
 
-	if (is_special(client))
-		reset_window(client);
+	if (rule->actions & IPCRuleFocus)
+		client->no_focus = !rule->focus;
+	if (!(rule->actions & (IPCRuleGrid | IPCRuleState)))
+		return;
 
-	if (client->geom.width != mon_width)
-		client->orig_geom = client->geom;
-	client->geom.x = mon_x + conf.gap_left;
-	client->geom.width = mon_width - conf.gap_left - conf.gap_right - 2 * conf.border_width;
+	if (randr_base != -1) {
+		client->monitor = find_monitor_by_coord(client->geom.x, client->geom.y);
+		if (client->monitor == NULL && mon_list != NULL)
+			client->monitor = mon_list->data;
+	}
 
-	teleport_window(client->window, client->geom.x, client->geom.y);
-	resize_window_absolute(client->window, client->geom.width, client->geom.height);
-	client->hmaxed = true;
+	if (rule->actions & IPCRuleGrid)
+		grid_window(client, g[0], g[1], g[2], g[3], g[4], g[5]);
+	if (!(rule->actions & IPCRuleState))
+		return;
 
-	update_ewmh_wm_state(client);
-	update_window_status(client);
+	get_monitor_size(client, &mon_x, &mon_y, &mon_w, &mon_h);
+	switch (rule->state) {
+	case IPCStateMaxed:
+		maximize_window(client, mon_x, mon_y, mon_w, mon_h);
+		break;
+	case IPCStateHMaxed:
+		hmaximize_window(client, mon_x, mon_w);
+		break;
+	case IPCStateVMaxed:
+		vmaximize_window(client, mon_y, mon_h);
+		break;
+	case IPCStateMonocled:
+		monocle_window(client, mon_x, mon_y, mon_w, mon_h);
+		break;
+	default:
+		break;
+	}
 }
 
 static void
-vmaximize_window(struct client *client, int16_t mon_y, uint16_t mon_height)
+free_rule(struct rule *r)
 {
-	if (client == NULL)
-		return;
-
-	if (is_special(client))
-		reset_window(client);
-
-	if (client->geom.height != mon_height)
-		client->orig_geom = client->geom;
+	free(r->class_name);
+	free(r->instance_name);
+	free(r->role);
+	free(r);
+}
 
-	client->geom.y = mon_y + conf.gap_up;
-	client->geom.height = mon_height - conf.gap_up - conf.gap_down - 2 * conf.border_width;
+static void
+free_rules(void)
+{
+	struct rule *r, *next;
+	uint32_t i;
 
-	teleport_window(client->window, client->geom.x, client->geom.y);
-	resize_window_absolute(client->window, client->geom.width, client->geom.height);
-	client->vmaxed = true;
+	for (i = 0; i <= rule_table.size; i++) {
+		/* the generic chain last */
+		if (i < rule_table.size && rule_table.keys[i] == 0)
+			continue;
+		r = i < rule_table.size ? rule_table.values[i] : generic_rules;
+		for (; r != NULL; r = next) {
+			next = r->next;
+			free_rule(r);
+		}
+	}
 
-	update_ewmh_wm_state(client);
-	update_window_status(client);
+	htable_free(&rule_table);
+	generic_rules = NULL;
+	nr_rules = 0;
 }
 
+/*
+ * Set focus state to active or inactive without raising the window.
+ */
+
 static void
-monocle_window(struct client *client, int16_t mon_x, int16_t mon_y, uint16_t mon_width, uint16_t mon_height)
+set_focused_no_raise(struct client *client)
 {
+	xcb_atom_t data[] = {
+		XCB_ICCCM_WM_STATE_NORMAL,
+		XCB_NONE,
+	};
 	if (client == NULL)
 		return;
 
-	if (is_special(client))
-		reset_window(client);
+	/* show window if hidden */
+	show_window(client);
 
-	client->orig_geom = client->geom;
+	mark_dirty(client, DIRTY_FOCUS);
 
-	client->geom.x = mon_x + conf.gap_left;
-	client->geom.y = mon_y + conf.gap_up;
-	client->geom.width = mon_width - 2 * conf.border_width
-		- conf.gap_left - conf.gap_right;
-	client->geom.height = mon_height - 2 * conf.border_width
-		- conf.gap_up - conf.gap_down;
-	teleport_window(client->window, client->geom.x, client->geom.y);
-	resize_window_absolute(client->window, client->geom.width, client->geom.height);
-	client->monocled = true;
-	set_focused_no_raise(client);
+	/* focus the window */
+	xcb_set_input_focus(conn, XCB_INPUT_FOCUS_POINTER_ROOT,
+			client->window, XCB_CURRENT_TIME);
 
-	update_ewmh_wm_state(client);
-	update_window_status(client);
-}
+	/* set ewmh property */
+	set_active_window(client->window);
 
-static void
-reset_window(struct client *client)
-{
-	xcb_atom_t state[] = {
-		XCB_ICCCM_WM_STATE_NORMAL,
-		XCB_NONE
-	};
-	client->geom.x = client->orig_geom.x;
-	client->geom.y = client->orig_geom.y;
-	client->geom.width = client->orig_geom.width;
-	client->geom.height = client->orig_geom.height;
-	client->maxed = client->hmaxed
-		= client->vmaxed = client->monocled = client->gridded = false;
+	/* set window state */
+	set_net_wm_state(client, ewmh->_NET_WM_STATE, 2, data);
 
-	teleport_window(client->window, client->geom.x, client->geom.y);
-	resize_window_absolute(client->window, client->geom.width, client->geom.height);
-	set_borders(client, conf.unfocus_color, conf.internal_unfocus_color);
+	/* set the focus state to inactive on the previously focused window */
+	if (client != focused_win && focused_win != NULL)
+		mark_dirty(focused_win, DIRTY_FOCUS);
+	if (client != focused_win)
+		ipc_emit(IPCEventFocus, client->window, 0, 0, 0, 0);
 
-	xcb_change_property(conn, XCB_PROP_MODE_REPLACE, client->window,
-			ewmh->_NET_WM_STATE, ewmh->_NET_WM_STATE, 32, 2, state);
-	update_window_status(client);
+	if (client->focus_item != NULL)
+		list_move_to_head(&focus_list, client->focus_item);
+
+	focused_win = client;
+
+	window_grab_buttons(focused_win->window);
 }
 
-static bool
-is_special(struct client *client)
+/*
+ * Focus and raise.
+ */
+
+static void
+set_focused(struct client *client)
 {
-	if (client == NULL)
-		return false;
+	set_focused_no_raise(client);
+	raise_window(client->window);
+}
 
-	return client->maxed
-		|| client->vmaxed
-		|| client->hmaxed
-		|| client->monocled
-		|| client->gridded;
+/*
+ * Give the focus look and stacking back to a window a command changed, if
+ * it is the focused one. Commands aimed at other windows leave the focus
+ * alone.
+ */
+
+static void
+refocus(struct client *client)
+{
+	if (client != NULL && client == focused_win)
+		set_focused(client);
 }
 
+/*
+ * Focus last best focus (in a valid group, mapped, etc)
+ */
+
 static void
-cycle_window(struct client *client)
+set_focused_last_best()
 {
-	struct list_item *item;
-	struct client *data;
+	struct list_item *focused_item;
+	struct client *client;
 
-	item = win_list;
-	if (client != NULL)
-			while (item != NULL && item->data != client)
-				item = item->next;
+	focused_item = focus_list->next;
+	if (focused_item == NULL)
+		focused_item = focus_list;
 
-	/* if item is not found item will be null
-	 * and we'll get a nice segmentation fault. may the debugger be with you */
-	if (item != NULL)
-		do {
-			item = item->next;
-			if (item == NULL)
-				item = win_list;
-			data = item->data;
-		} while (!data->mapped);
+	while (focused_item != NULL) {
+		client = focused_item->data;
 
-	if (item != NULL && item->data != client)
-		set_focused(item->data);
+		if (client != NULL && client->mapped) {
+			set_focused(client);
+			return;
+		}
+
+		focused_item = focused_item->next;
+	}
 }
 
+/*
+ * Put window at the top of the window stack.
+ */
+
 static void
-rcycle_window(struct client *client)
+raise_window(xcb_window_t win)
 {
-	struct list_item *item = NULL;
-	struct list_item *last_item;
-	struct list_item *client_item;
-	struct client *data;
+	uint32_t values[1] = { XCB_STACK_MODE_ABOVE };
+	struct client *client = find_client(&win);
 
-	if (win_list == NULL)
+	if (client == NULL) {
+		xcb_configure_window(conn, win, XCB_CONFIG_WINDOW_STACK_MODE, values);
+		forget_stacking();
 		return;
+	}
 
-	/* find last window */
-	item = win_list;
-	while (item != NULL) {
-		last_item = item;
-		item = item->next;
+	/* already above every managed window, and no unmanaged one since */
+	if (client->shadow.stack_known
+			&& client->shadow.stack_mode == XCB_STACK_MODE_ABOVE
+			&& client_stack.len > 0
+			&& client_stack.wins[client_stack.len - 1] == win) {
+		requests_elided++;
+		return;
 	}
 
-	/* find item of client */
-	item = win_list;
-	while (item != NULL && item->data != client)
-		item = item->next;
+	restack_client(client, XCB_STACK_MODE_ABOVE);
+	if ((client_stack.len == 0
+				|| client_stack.wins[client_stack.len - 1] != win)) {
+		window_array_remove(&client_stack, win);
+		window_array_append(&client_stack, win);
+		client_list_dirty = true;
+	}
+}
 
-	if (item == NULL)
-		item = last_item;
+/*
+ * Put window at the bottom of the window stack.
+ */
 
-	client_item = item;
+static void
+lower_window(xcb_window_t win)
+{
+	uint32_t values[1] = { XCB_STACK_MODE_BELOW };
+	struct client *client = find_client(&win);
 
-	item = client_item;
-	do {
-		item = item->prev;
-		if (item == NULL)
-			item = last_item;
-		data = item->data;
-	} while (!data->mapped);
+	if (client == NULL) {
+		xcb_configure_window(conn, win, XCB_CONFIG_WINDOW_STACK_MODE, values);
+		forget_stacking();
+		return;
+	}
 
-	if (item != NULL && item->data != client)
-		set_focused(item->data);
+	/* already below every managed window, and no unmanaged one since */
+	if (client->shadow.stack_known
+			&& client->shadow.stack_mode == XCB_STACK_MODE_BELOW
+			&& client_stack.len > 0
+			&& client_stack.wins[0] == win) {
+		requests_elided++;
+		return;
+	}
+
+	restack_client(client, XCB_STACK_MODE_BELOW);
+	if ((client_stack.len == 0
+				|| client_stack.wins[0] != win)) {
+		/* grow the array if needed, then shift everything up by one */
+		window_array_remove(&client_stack, win);
+		window_array_append(&client_stack, win);
+		memmove(client_stack.wins + 1, client_stack.wins,
+				(client_stack.len - 1) * sizeof(xcb_window_t));
+		client_stack.wins[0] = win;
+		client_list_dirty = true;
+	}
 }
 
+/*
+ * An unmanaged window was mapped or restacked, maybe above or below every
+ * managed one. The ends of client_stack aren't the ends of the real stack
+ * anymore, so no raise or lower is skipped until it was sent again.
+ */
+
 static void
-cycle_window_in_group(struct client *client)
+forget_stacking(void)
 {
-	struct list_item *item;
-	struct client *data;
-
-	if (client == NULL)
-		return;
-
-	item = win_list;
-	while (item != NULL && item->data != client)
-		item = item->next;
-	if (item != NULL)
-		do {
-			item = item->next;
-			if (item == NULL)
-				item = win_list;
-			data = item->data;
-		} while (!data->mapped || data->group != client->group);
+	struct client *client;
+	uint32_t i;
 
-	if (item != NULL && data != client && data->group == client->group)
-		set_focused(item->data);
+	for (i = 0; i < client_stack.len; i++) {
+		client = find_client(&client_stack.wins[i]);
+		if (client != NULL)
+			client->shadow.stack_known = false;
+	}
 }
 
+/*
+ * Queue a stacking change. Restacked clients are committed in the
+ * order they were restacked, so the last one raised ends up on top.
+ */
+
 static void
-rcycle_window_in_group(struct client *client)
+restack_client(struct client *client, uint8_t stack_mode)
 {
-	struct list_item *item = NULL;
-	struct list_item *last_item;
-	struct list_item *client_item;
-	struct client *data;
+	if (window_array_remove(&dirty_clients, client->window))
+		window_array_append(&dirty_clients, client->window);
 
-	if (win_list == NULL || client == NULL)
-		return;
+	client->configure.mask |= XCB_CONFIG_WINDOW_STACK_MODE;
+	client->configure.stack_mode = stack_mode;
+	mark_dirty(client, DIRTY_CONFIGURE);
+}
 
-	/* find item of client */
-	item = win_list;
-	while (item != NULL && item->data != client)
-		item = item->next;
+/*
+ * Ask window to close gracefully. If the window doesn't respond, kill it.
+ */
 
-	if (item == NULL)
+static void
+close_window(struct client *client)
+{
+	if (client == NULL)
 		return;
 
-	client_item = item;
+	if (conf.last_window_focusing && client != NULL && client == focused_win)
+	    set_focused_last_best();
 
-	/* find last window */
-	item = win_list;
-	while (item != NULL) {
-		last_item = item;
-		item = item->next;
-	}
+	if (focused_win == client)
+		focused_win = NULL;
 
-	item = client_item;
-	do {
-		item = item->prev;
-		if (item == NULL)
-			item = last_item;
-		data = item->data;
-	} while (!data->mapped || data->group != client->group);
+	/*
+	 * WM_PROTOCOLS was read when the window was adopted. Some clients
+	 * only set WM_DELETE_WINDOW after mapping, so read it again before
+	 * killing one.
+	 */
+	if (!client->delete_window) {
+		xcb_get_property_cookie_t cookie =
+			xcb_icccm_get_wm_protocols_unchecked(conn,
+					client->window, ewmh->WM_PROTOCOLS);
+		xcb_icccm_get_wm_protocols_reply_t reply;
+		uint32_t i;
+
+		if (xcb_icccm_get_wm_protocols_reply(conn, cookie, &reply, NULL)) {
+			for (i = 0; i < reply.atoms_len && !client->delete_window; i++)
+				client->delete_window = reply.atoms[i] == ATOMS[WM_DELETE_WINDOW];
+			xcb_icccm_get_wm_protocols_reply_wipe(&reply);
+		}
+	}
 
-	if (item != NULL && data != client && data->group == client->group)
-		set_focused(item->data);
+	if (client->delete_window)
+		delete_window(client->window);
+	else
+		xcb_kill_client(conn, client->window);
 }
 
+/*
+ * Gracefully ask a window to close.
+ */
+
 static void
-cardinal_focus(uint32_t dir)
+delete_window(xcb_window_t win)
 {
-	/* Don't focus if we don't have a current focus! */
-	if (focused_win == NULL)
-		return;
-
-	struct list_item *valid_windows = NULL;
-	struct list_item *desired_window = NULL;
-	struct list_item *valid_window;
-	struct list_item *win;
+	xcb_client_message_event_t ev;
 
-	struct win_position focus_win_pos = get_window_position(CENTER, focused_win);
+	ev.response_type = XCB_CLIENT_MESSAGE;
+	ev.sequence = 0;
+	ev.format = 32;
+	ev.window = win;
+	ev.type = ewmh->WM_PROTOCOLS;
+	ev.data.data32[0] = ATOMS[WM_DELETE_WINDOW];
+	ev.data.data32[1] = XCB_CURRENT_TIME;
 
-	float closest_distance = -1;
+	xcb_send_event(conn, 0, win, XCB_EVENT_MASK_NO_EVENT, (char *)&ev);
+}
 
-	win = win_list;
+/*
+ * Teleports window absolutely to the given coordinates.
+ */
 
-	while(win != NULL) {
-		/* Skip focused window */
-		if (((struct client *)win->data)->window == focused_win->window) {
-			win = win->next;
-			continue;
-		}
+static void
+teleport_window(xcb_window_t win, int16_t x, int16_t y)
+{
+	uint32_t values[2] = {x, y};
+	struct client *client;
 
-		/* Skip unmapped windows */
-		if (!((struct client *)win->data)->mapped) {
-			win = win->next;
-			continue;
-		}
+	if (win == scr->root || win == 0)
+		return;
 
-		struct win_position win_pos = get_window_position(CENTER, (struct client *)win->data);
+	client = find_client(&win);
+	if (client == NULL) {
+		xcb_configure_window(conn, win, XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y, values);
+		return;
+	}
 
-		valid_window = NULL;
+	client->configure.mask |= XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y;
+	client->configure.x = x;
+	client->configure.y = y;
+	mark_dirty(client, DIRTY_CONFIGURE);
+	update_window_status(client);
+}
 
-		switch (dir) {
+/*
+ * Moves the window by a certain amount.
+ */
+
+static void
+move_window(struct client *client, int16_t x, int16_t y)
+{
+	if (!client->mapped)
+		return;
+
+	client->geom.x += x;
+	client->geom.y += y;
+
+	teleport_window(client->window, client->geom.x, client->geom.y);
+}
+
+/*
+ * Resizes window to the given size.
+ */
+
+static void
+resize_window_absolute(xcb_window_t win, uint16_t w, uint16_t h)
+{
+	uint32_t val[2];
+	uint32_t mask = XCB_CONFIG_WINDOW_WIDTH
+				  | XCB_CONFIG_WINDOW_HEIGHT;
+
+	val[0] = w;
+	val[1] = h;
+
+	struct client *client = find_client(&win);
+
+	if (client == NULL) {
+		xcb_configure_window(conn, win, mask, val);
+		return;
+	}
+
+	client->configure.mask |= mask;
+	client->configure.width = w;
+	client->configure.height = h;
+	mark_dirty(client, DIRTY_GEOMETRY | DIRTY_CONFIGURE);
+	update_window_status(client);
+}
+
+/*
+ * Resizes window by a certain amount.
+ */
+
+static void
+resize_window(xcb_window_t win, int16_t w, int16_t h)
+{
+	struct client *client;
+	int32_t aw, ah;
+
+	client = find_client(&win);
+	if (client == NULL)
+		return;
+
+	aw = client->geom.width;
+	ah = client->geom.height;
+
+	if (aw + w > 0)
+		aw += w;
+	if (ah + h > 0)
+		ah += h;
+
+	/* avoid weird stuff */
+	if (aw < 0)
+		aw = 0;
+	if (ah < 0)
+		ah = 0;
+
+	if (client->min_width != 0 && aw < client->min_width)
+		aw = client->min_width;
+
+	if (client->min_height != 0 && ah < client->min_height)
+		ah = client->min_height;
+
+	client->geom.width  = aw - conf.resize_hints * (aw % client->width_inc);
+	client->geom.height = ah - conf.resize_hints * (ah % client->height_inc);
+
+	resize_window_absolute(win, client->geom.width, client->geom.height);
+}
+
+/*
+ * Fit window on screen if too big.
+ */
+
+static void
+fit_on_screen(struct client *client)
+{
+	int16_t mon_x, mon_y;
+	uint16_t mon_width, mon_height;
+	bool will_resize, will_move;
+
+	will_resize = will_move = false;
+	client->hmaxed = client->vmaxed = false;
+	get_monitor_size(client, &mon_x, &mon_y, &mon_width, &mon_height);
+	if (client->maxed) {
+		client->maxed = false;
+	} else if (client->geom.width == mon_width && client->geom.height == mon_height) {
+		client->geom.x = mon_x;
+		client->geom.y = mon_y;
+		client->geom.width -= 2 * conf.border_width;
+		client->geom.height -= 2 * conf.border_width;
+		maximize_window(client, mon_x, mon_y, mon_width, mon_height);
+		return;
+	}
+
+	/* Is it outside the display? */
+	if (client->geom.x > mon_x + mon_width || client->geom.y > mon_y + mon_height
+			|| client->geom.x < mon_x || client->geom.y < mon_y) {
+		will_move = true;
+		if (client->geom.x > mon_x + mon_width)
+			client->geom.x = mon_x + mon_width - client->geom.width - 2 * conf.border_width;
+		else if (client->geom.x < mon_x)
+			client->geom.x = mon_x;
+		if (client->geom.y > mon_y + mon_height)
+			client->geom.y = mon_y + mon_height - client->geom.height - 2 * conf.border_width;
+		else if (client->geom.y < mon_y)
+			client->geom.y = mon_y;
+	}
+
+	/* Is it smaller than it wants to be? */
+	if (client->min_width != 0 && client->geom.width < client->min_width) {
+		client->geom.width = client->min_width;
+		will_resize = true;
+	}
+	if (client->min_height != 0 && client->geom.height < client->min_height) {
+		client->geom.height = client->min_height;
+
+		will_resize = true;
+	}
+
+	/* If the window is larger than the screen or is a bit in the outside,
+	 * move it to the corner and resize it accordingly. */
+	if (client->geom.width + 2 * conf.border_width > mon_width) {
+		client->geom.x = mon_x;
+		client->geom.width = mon_width - 2 * conf.border_width;
+		will_move = will_resize = true;
+	} else if (client->geom.x + client->geom.width + 2 * conf.border_width
+			> mon_x + mon_width) {
+		client->geom.x = mon_x + mon_width - client->geom.width - 2 * conf.border_width;
+		will_move = true;
+	}
+
+	if (client->geom.height + 2 * conf.border_width > mon_height) {
+		client->geom.y = mon_y;
+		client->geom.height = mon_height - 2 * conf.border_width;
+		will_move = will_resize = true;
+	} else if (client->geom.y + client->geom.height + 2 * conf.border_width
+			> mon_y + mon_height) {
+		client->geom.y = mon_y + mon_height - client->geom.height - 2 * conf.border_width;
+		will_move = true;
+	}
+
+	if (will_move)
+		teleport_window(client->window, client->geom.x, client->geom.y);
+	if (will_resize)
+		resize_window_absolute(client->window, client->geom.width, client->geom.height);
+}
+
+static void
+maximize_window(struct client *client, int16_t mon_x, int16_t mon_y, uint16_t mon_width, uint16_t mon_height)
+{
+	if (client == NULL)
+		return;
+
+	if (is_special(client))
+		reset_window(client);
+
+	client->maxed = true;
+
+	/* maximized windows don't have borders */
+	if (client->geom.width != mon_width || client->geom.height != mon_height)
+		client->orig_geom = client->geom;
+	set_border_width(client, 0);
+
+	client->geom.x = mon_x;
+	client->geom.y = mon_y;
+	client->geom.width = mon_width;
+	client->geom.height = mon_height;
+
+	teleport_window(client->window, client->geom.x, client->geom.y);
+	resize_window_absolute(client->window, client->geom.width, client->geom.height);
+	mark_dirty(client, DIRTY_FOCUS);
+
+	update_ewmh_wm_state(client);
+	update_window_status(client);
+}
+
+static void
+hmaximize_window(struct client *client, int16_t mon_x, uint16_t mon_width)
+{
+	if (client == NULL)
+		return;
+
+	if (is_special(client))
+		reset_window(client);
+
+	if (client->geom.width != mon_width)
+		client->orig_geom = client->geom;
+	client->geom.x = mon_x + conf.gap_left;
+	client->geom.width = mon_width - conf.gap_left - conf.gap_right - 2 * conf.border_width;
+
+	teleport_window(client->window, client->geom.x, client->geom.y);
+	resize_window_absolute(client->window, client->geom.width, client->geom.height);
+	client->hmaxed = true;
+
+	update_ewmh_wm_state(client);
+	update_window_status(client);
+}
+
+static void
+vmaximize_window(struct client *client, int16_t mon_y, uint16_t mon_height)
+{
+	if (client == NULL)
+		return;
+
+	if (is_special(client))
+		reset_window(client);
+
+	if (client->geom.height != mon_height)
+		client->orig_geom = client->geom;
+
+	client->geom.y = mon_y + conf.gap_up;
+	client->geom.height = mon_height - conf.gap_up - conf.gap_down - 2 * conf.border_width;
+
+	teleport_window(client->window, client->geom.x, client->geom.y);
+	resize_window_absolute(client->window, client->geom.width, client->geom.height);
+	client->vmaxed = true;
+
+	update_ewmh_wm_state(client);
+	update_window_status(client);
+}
+
+static void
+monocle_window(struct client *client, int16_t mon_x, int16_t mon_y, uint16_t mon_width, uint16_t mon_height)
+{
+	if (client == NULL)
+		return;
+
+	if (is_special(client))
+		reset_window(client);
+
+	client->orig_geom = client->geom;
+
+	client->geom.x = mon_x + conf.gap_left;
+	client->geom.y = mon_y + conf.gap_up;
+	client->geom.width = mon_width - 2 * conf.border_width
+		- conf.gap_left - conf.gap_right;
+	client->geom.height = mon_height - 2 * conf.border_width
+		- conf.gap_up - conf.gap_down;
+	teleport_window(client->window, client->geom.x, client->geom.y);
+	resize_window_absolute(client->window, client->geom.width, client->geom.height);
+	client->monocled = true;
+	mark_dirty(client, DIRTY_FOCUS);
+
+	update_ewmh_wm_state(client);
+	update_window_status(client);
+}
+
+static void
+reset_window(struct client *client)
+{
+	xcb_atom_t state[] = {
+		XCB_ICCCM_WM_STATE_NORMAL,
+		XCB_NONE
+	};
+	client->geom.x = client->orig_geom.x;
+	client->geom.y = client->orig_geom.y;
+	client->geom.width = client->orig_geom.width;
+	client->geom.height = client->orig_geom.height;
+	client->maxed = client->hmaxed
+		= client->vmaxed = client->monocled = client->gridded = false;
+
+	teleport_window(client->window, client->geom.x, client->geom.y);
+	resize_window_absolute(client->window, client->geom.width, client->geom.height);
+	mark_dirty(client, DIRTY_FOCUS);
+
+	set_net_wm_state(client, ewmh->_NET_WM_STATE, 2, state);
+	update_window_status(client);
+}
+
+static bool
+is_special(struct client *client)
+{
+	if (client == NULL)
+		return false;
+
+	return client->maxed
+		|| client->vmaxed
+		|| client->hmaxed
+		|| client->monocled
+		|| client->gridded;
+}
+
+static void
+cycle_window(struct client *client)
+{
+	struct list_item *item;
+	struct client *data;
+
+	item = win_list;
+	if (client != NULL)
+			while (item != NULL && item->data != client)
+				item = item->next;
+
+	/* if item is not found item will be null
+	 * and we'll get a nice segmentation fault. may the debugger be with you */
+	if (item != NULL)
+		do {
+			item = item->next;
+			if (item == NULL)
+				item = win_list;
+			data = item->data;
+		} while (!data->mapped);
+
+	if (item != NULL && item->data != client)
+		set_focused(item->data);
+}
+
+static void
+rcycle_window(struct client *client)
+{
+	struct list_item *item = NULL;
+	struct list_item *last_item;
+	struct list_item *client_item;
+	struct client *data;
+
+	if (win_list == NULL)
+		return;
+
+	/* find last window */
+	item = win_list;
+	while (item != NULL) {
+		last_item = item;
+		item = item->next;
+	}
+
+	/* find item of client */
+	item = win_list;
+	while (item != NULL && item->data != client)
+		item = item->next;
+
+	if (item == NULL)
+		item = last_item;
+
+	client_item = item;
+
+	item = client_item;
+	do {
+		item = item->prev;
+		if (item == NULL)
+			item = last_item;
+		data = item->data;
+	} while (!data->mapped);
+
+	if (item != NULL && item->data != client)
+		set_focused(item->data);
+}
+
+static void
+cycle_window_in_group(struct client *client)
+{
+	struct list_item *item;
+	struct client *data;
+
+	if (client == NULL)
+		return;
+
+	item = win_list;
+	while (item != NULL && item->data != client)
+		item = item->next;
+	if (item != NULL)
+		do {
+			item = item->next;
+			if (item == NULL)
+				item = win_list;
+			data = item->data;
+		} while (!data->mapped || data->group != client->group);
+
+	if (item != NULL && data != client && data->group == client->group)
+		set_focused(item->data);
+}
+
+static void
+rcycle_window_in_group(struct client *client)
+{
+	struct list_item *item = NULL;
+	struct list_item *last_item;
+	struct list_item *client_item;
+	struct client *data;
+
+	if (win_list == NULL || client == NULL)
+		return;
+
+	/* find item of client */
+	item = win_list;
+	while (item != NULL && item->data != client)
+		item = item->next;
+
+	if (item == NULL)
+		return;
+
+	client_item = item;
+
+	/* find last window */
+	item = win_list;
+	while (item != NULL) {
+		last_item = item;
+		item = item->next;
+	}
+
+	item = client_item;
+	do {
+		item = item->prev;
+		if (item == NULL)
+			item = last_item;
+		data = item->data;
+	} while (!data->mapped || data->group != client->group);
+
+	if (item != NULL && data != client && data->group == client->group)
+		set_focused(item->data);
+}
+
+static void
+cardinal_focus(uint32_t dir)
+{
+	/* Don't focus if we don't have a current focus! */
+	if (focused_win == NULL)
+		return;
+
+	struct list_item *valid_windows = NULL;
+	struct list_item *desired_window = NULL;
+	struct list_item *valid_window;
+	struct list_item *win;
+
+	struct win_position focus_win_pos = get_window_position(CENTER, focused_win);
+
+	float closest_distance = -1;
+
+	win = win_list;
+
+	while(win != NULL) {
+		/* Skip focused window */
+		if (((struct client *)win->data)->window == focused_win->window) {
+			win = win->next;
+			continue;
+		}
+
+		/* Skip unmapped windows */
+		if (!((struct client *)win->data)->mapped) {
+			win = win->next;
+			continue;
+		}
+
+		struct win_position win_pos = get_window_position(CENTER, (struct client *)win->data);
+
+		valid_window = NULL;
+
+		switch (dir) {
 			case NORTH:
 				if (win_pos.y < focus_win_pos.y)
 					valid_window = list_add_item(&valid_windows);
@@ -1389,1841 +2335,3459 @@ cardinal_focus(uint32_t dir)
 				break;
 		}
 
-		if (valid_window != NULL)
-			valid_window->data = win->data;
+		if (valid_window != NULL)
+			valid_window->data = win->data;
+
+		win = win->next;
+	}
+
+	win = valid_windows;
+	while(win != NULL) {
+		float cur_distance;
+		float cur_angle;
+
+		cur_distance = get_distance_between_windows(focused_win, (struct client *)win->data);
+		cur_angle = get_angle_between_windows(focused_win, (struct client *)win->data);
+
+		if (is_in_valid_direction(dir, cur_angle, 10)) {
+			if (is_overlapping(focused_win, (struct client *)win->data))
+				cur_distance = cur_distance * 0.1;
+			cur_distance = cur_distance * 0.80;
+		}
+		else if (is_in_valid_direction(dir, cur_angle, 25)) {
+			if (is_overlapping(focused_win, (struct client *)win->data))
+				cur_distance = cur_distance * 0.1;
+			cur_distance = cur_distance * 0.85;
+		}
+		else if (is_in_valid_direction(dir, cur_angle, 35)) {
+			if (is_overlapping(focused_win, (struct client *)win->data))
+				cur_distance = cur_distance * 0.1;
+			cur_distance = cur_distance * 0.9;
+		}
+		else if (is_in_valid_direction(dir, cur_angle, 50)) {
+			if (is_overlapping(focused_win, (struct client *)win->data))
+				cur_distance = cur_distance * 0.1;
+			cur_distance = cur_distance * 3;
+		}
+		else {
+			win = win->next;
+			continue;
+		}
+
+		if (is_in_cardinal_direction(dir, focused_win, (struct client *)win->data))
+			cur_distance = cur_distance * 0.9;
+
+
+		if (closest_distance == -1 || (cur_distance < closest_distance)) {
+			closest_distance = cur_distance;
+			desired_window = win;
+		}
+
+		win = win->next;
+	}
+
+	if (desired_window != NULL)
+		set_focused(desired_window->data);
+
+	if (valid_windows != NULL)
+		list_delete_all_items(&valid_windows, false);
+}
+
+static struct win_position
+get_window_position(uint32_t mode, struct client *win)
+{
+	struct win_position pos;
+	pos.x = 0;
+	pos.y = 0;
+
+	switch (mode) {
+		case CENTER:
+			pos.x = win->geom.x + (win->geom.width / 2);
+			pos.y = win->geom.y + (win->geom.height / 2);
+			break;
+		case TOP_LEFT:
+			pos.x = win->geom.x;
+			pos.y = win->geom.y;
+			break;
+		case TOP_RIGHT:
+			pos.x = win->geom.x + win->geom.width;
+			pos.y = win->geom.y;
+			break;
+		case BOTTOM_RIGHT:
+			pos.x = win->geom.x + win->geom.width;
+			pos.y = win->geom.y + win->geom.height;
+			break;
+		case BOTTOM_LEFT:
+			pos.x = win->geom.x;
+			pos.y = win->geom.y + win->geom.height;
+			break;
+	}
+	return pos;
+}
+
+static bool
+is_in_cardinal_direction(uint32_t direction, struct client *a, struct client *b)
+{
+	struct win_position pos_a_top_left = get_window_position(TOP_LEFT, a);
+	struct win_position pos_a_top_right = get_window_position(TOP_RIGHT, a);
+	struct win_position pos_a_bot_left = get_window_position(BOTTOM_LEFT, a);
+
+	struct win_position pos_b_center = get_window_position(CENTER, b);
+
+	switch(direction) {
+		case NORTH:
+		case SOUTH:
+			return pos_a_top_left.x <= pos_b_center.x && pos_a_top_right.x >= pos_b_center.x;
+
+		case WEST:
+		case EAST:
+			return pos_a_top_left.y <= pos_b_center.y && pos_a_bot_left.y >= pos_b_center.y;
+	}
+
+	return false;
+}
+
+static bool
+is_in_valid_direction(uint32_t direction, float window_direction, float delta)
+{
+	switch((uint32_t)direction) {
+		case NORTH:
+			if (window_direction >= (180 - delta) || window_direction <= (-180 + delta))
+				return true;
+			break;
+		case SOUTH:
+			if (fabs(window_direction) <= ( 0 + delta))
+				return true;
+			break;
+		case EAST:
+			if (window_direction <= (90 + delta) && window_direction > (90 - delta))
+				return true;
+			break;
+		case WEST:
+			if (window_direction <= (-90 + delta) && window_direction >= (-90 - delta))
+				return true;
+			break;
+	}
+
+	return false;
+}
+
+static bool
+is_overlapping(struct client *a, struct client *b)
+{
+	struct win_position pos_a_top_left = get_window_position(TOP_LEFT, a);
+	struct win_position pos_a_top_right = get_window_position(TOP_RIGHT, a);
+	struct win_position pos_a_bot_left = get_window_position(BOTTOM_LEFT, a);
+
+	struct win_position pos_b_top_left = get_window_position(TOP_LEFT, b);
+	struct win_position pos_b_top_right = get_window_position(TOP_RIGHT, b);
+	struct win_position pos_b_bot_left = get_window_position(BOTTOM_LEFT, b);
+
+	bool is_x_top_overlapped = pos_a_top_left.x <= pos_b_top_left.x && pos_a_top_right.x >= pos_b_top_left.x;
+	bool is_x_bot_overlapped = pos_a_top_left.x <= pos_b_top_right.x && pos_a_top_right.x >= pos_b_top_right.x;
+
+	bool is_y_top_overlapped = pos_a_top_left.y <= pos_b_top_left.y && pos_a_bot_left.y >= pos_b_top_left.y;
+	bool is_y_bot_overlapped = pos_a_top_left.y <= pos_b_bot_left.y && pos_a_bot_left.y >= pos_b_bot_left.y;
+
+	return (is_x_top_overlapped || is_x_bot_overlapped) && (is_y_top_overlapped || is_y_bot_overlapped);
+}
+
+static float
+get_angle_between_windows(struct client *a, struct client *b)
+{
+	struct win_position a_pos = get_window_position(CENTER, a);
+	struct win_position b_pos = get_window_position(CENTER, b);
+
+	float dx = (float)(b_pos.x - a_pos.x);
+	float dy = (float)(b_pos.y - a_pos.y);
+
+	if (dx == 0.0 && dy == 0.0)
+		return 0.0;
+
+	return atan2(dx,dy) * (180 / PI);
+}
+
+static float
+get_distance_between_windows(struct client *a, struct client *b)
+{
+	struct win_position a_pos = get_window_position(CENTER, a);
+	struct win_position b_pos = get_window_position(CENTER, b);
+
+	float distance = hypot((float)(b_pos.x - a_pos.x), (float)(b_pos.y - a_pos.y));
+	return distance;
+}
+
+/*
+ * Get atom by name.
+ */
+
+static xcb_atom_t
+get_atom(char *name)
+{
+	xcb_intern_atom_cookie_t cookie = xcb_intern_atom(conn, false, strlen(name), name);
+	xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(conn, cookie, NULL);
+
+	if (!reply)
+		return XCB_ATOM_STRING;
+
+	return reply->atom;
+}
+
+/*
+ * Update _NET_DESKTOP_VIEWPORT root property.
+ */
+
+static void
+update_desktop_viewport(void)
+{
+	xcb_ewmh_coordinates_t coord = {0, 0};
+	xcb_ewmh_set_desktop_viewport(ewmh, scrno, 1, &coord);
+}
+
+static void
+center_pointer(struct client *client)
+{
+	xcb_void_cookie_t cookie;
+	int16_t cur_x, cur_y;
+
+	cur_x = cur_y = 0;
+
+	switch (conf.cursor_position) {
+	case TOP_LEFT:
+		cur_x = -conf.border_width;
+		cur_y = -conf.border_width;
+		break;
+	case TOP_RIGHT:
+		cur_x = client->geom.width + conf.border_width;
+		cur_y = 0 - conf.border_width;
+		break;
+	case BOTTOM_LEFT:
+		cur_x = 0 - conf.border_width;
+		cur_y = client->geom.height + conf.border_width;
+		break;
+	case BOTTOM_RIGHT:
+		cur_x = client->geom.width + conf.border_width;
+		cur_y = client->geom.height + conf.border_width;
+		break;
+	case CENTER:
+		cur_x = client->geom.width / 2;
+		cur_y = client->geom.height / 2;
+		break;
+	default: break;
+	}
+
+	/* the warp is relative to where the window is now */
+	commit_configure(client);
+	cookie = xcb_warp_pointer(conn, XCB_NONE, client->window, 0, 0, 0, 0,
+			cur_x, cur_y);
+	ignore_request(client->window, cookie.sequence, IGNORE_CROSSING);
+}
+
+/*
+ * Get the client instance with a given window id.
+ */
+
+static struct client*
+find_client(xcb_window_t *win)
+{
+	return htable_get(&win_table, *win);
+}
+
+/*
+ * Set the color of the border.
+ */
+
+static void
+set_borders(struct client *client, uint32_t color, uint32_t internal_color)
+{
+	if (client == NULL || conf.borders == false)
+		return;
+	xcb_pixmap_t pixmap;
+
+	color = get_color_pixel(color);
+	internal_color = get_color_pixel(internal_color);
+
+	set_border_width(client, conf.border_width);
+
+	if (conf.internal_border_width == 0)
+		set_border_attribute(client, XCB_CW_BORDER_PIXEL, color);
+
+	if (conf.internal_border_width != 0) {
+		pixmap = get_border_pixmap(client, color, internal_color);
+		if (pixmap != XCB_NONE)
+			set_border_attribute(client, XCB_CW_BORDER_PIXMAP, pixmap);
+		else
+			set_border_attribute(client, XCB_CW_BORDER_PIXEL, color);
+	}
+}
+
+/*
+ * Get a pixmap with the two-colour border of a window. Pixmaps are cached
+ * by size, depth, colours and border widths, so focus changes between
+ * already seen window sizes don't paint anything.
+ * Returns XCB_NONE if there's no memory for a new cache entry.
+ */
+
+static xcb_pixmap_t
+get_border_pixmap(struct client *client, uint32_t color, uint32_t internal_color)
+{
+	struct list_item *item, *last, *win;
+	struct border_pixmap *bp;
+	struct client *other;
+	uint32_t values[1];
+	uint16_t width = client->geom.width + (conf.border_width * 2);
+	uint16_t height = client->geom.height + (conf.border_width * 2);
+	uint32_t key[] = {
+		width, height, client->depth, color, internal_color,
+		conf.border_width, conf.internal_border_width,
+	};
+	uint32_t hash = hash_bytes(key, sizeof(key));
+
+	for (bp = htable_get(&border_table, hash); bp != NULL; bp = bp->next) {
+		if (bp->width == width && bp->height == height
+				&& bp->depth == client->depth
+				&& bp->color == color
+				&& bp->internal_color == internal_color
+				&& bp->border_width == conf.border_width
+				&& bp->internal_border_width == conf.internal_border_width) {
+			list_move_to_head(&border_cache, bp->item);
+			return bp->pixmap;
+		}
+	}
+
+	bp = malloc(sizeof(struct border_pixmap));
+	if (bp == NULL)
+		return XCB_NONE;
+	bp->next = htable_get(&border_table, hash);
+	item = list_add_item(&border_cache);
+	if (item == NULL || !htable_put(&border_table, hash, bp)) {
+		if (item != NULL)
+			list_delete_item(&border_cache, item);
+		free(bp);
+		return XCB_NONE;
+	}
+
+	uint32_t calc_iborder = conf.border_width - conf.internal_border_width;
+	xcb_rectangle_t rect_inner[] = {
+		{
+			client->geom.width,
+			0,
+			conf.border_width - calc_iborder,
+			client->geom.height + conf.border_width - calc_iborder
+		},
+		{
+			client->geom.width + conf.border_width + calc_iborder,
+			0,
+			conf.border_width - calc_iborder,
+			client->geom.height + conf.border_width - calc_iborder
+		},
+		{
+			0,
+			client->geom.height,
+			client->geom.width + conf.border_width - calc_iborder,
+			conf.border_width - calc_iborder
+		},
+		{
+			0,
+			client->geom.height + conf.border_width + calc_iborder,
+			client->geom.width + conf.border_width - calc_iborder,
+			conf.border_width - calc_iborder
+		},
+		{
+			client->geom.width + conf.border_width + calc_iborder,
+			conf.border_width + client->geom.height + calc_iborder,
+			conf.border_width,
+			conf.border_width
+		}
+	};
+
+	xcb_rectangle_t rect_outer[] = {
+		{
+			client->geom.width + conf.border_width - calc_iborder,
+			0,
+			calc_iborder,
+			client->geom.height + conf.border_width * 2
+		},
+		{
+			client->geom.width + conf.border_width,
+			0,
+			calc_iborder,
+			client->geom.height + conf.border_width * 2
+		},
+		{
+			0,
+			client->geom.height + conf.border_width - calc_iborder,
+			client->geom.width + conf.border_width * 2,
+			calc_iborder
+		},
+		{
+			0,
+			client->geom.height + conf.border_width,
+			client->geom.width + conf.border_width * 2,
+			calc_iborder
+		},
+		{
+			1,1,1,1
+		}
+	};
+
+	xcb_pixmap_t pmap = xcb_generate_id(conn);
+	xcb_create_pixmap(conn, client->depth, pmap, scr->root, width, height);
+
+	xcb_gcontext_t gc = border_gc[client->depth];
+	if (gc == XCB_NONE) {
+		gc = border_gc[client->depth] = xcb_generate_id(conn);
+		xcb_create_gc(conn, gc, pmap, 0, NULL);
+	}
+
+	values[0] = color;
+	xcb_change_gc(conn, gc, XCB_GC_FOREGROUND, &values[0]);
+	xcb_poly_fill_rectangle(conn, pmap, gc, 5, rect_outer);
+
+	values[0] = internal_color;
+	xcb_change_gc(conn, gc, XCB_GC_FOREGROUND, &values[0]);
+	xcb_poly_fill_rectangle(conn, pmap, gc, 5, rect_inner);
+
+	item->data = bp;
+	bp->item = item;
+	bp->hash = hash;
+	bp->pixmap = pmap;
+	bp->width = width;
+	bp->height = height;
+	bp->depth = client->depth;
+	bp->color = color;
+	bp->internal_color = internal_color;
+	bp->border_width = conf.border_width;
+	bp->internal_border_width = conf.internal_border_width;
+	bp->bytes = width * height * (client->depth > 16 ? 4 : client->depth > 8 ? 2 : 1);
+	border_cache_bytes += bp->bytes;
+
+	/* evict least recently used pixmaps, but never the one we return */
+	while (border_cache_bytes > BORDER_CACHE_MAX_BYTES && border_cache->next != NULL) {
+		for (last = border_cache; last->next != NULL; last = last->next)
+			;
+		bp = last->data;
+		border_cache_bytes -= bp->bytes;
+		/* the id may be reused, so forget who uses it */
+		for (win = win_list; win != NULL; win = win->next) {
+			other = win->data;
+			if (other->shadow.border_attr == XCB_CW_BORDER_PIXMAP
+					&& other->shadow.border_value == bp->pixmap)
+				other->shadow.border_attr = 0;
+		}
+		xcb_free_pixmap(conn, bp->pixmap);
+		forget_border_pixmap(bp);
+		free(bp);
+		list_delete_item(&border_cache, last);
+	}
+
+	return pmap;
+}
+
+/*
+ * Take a pixmap out of its border_table chain.
+ */
+
+static void
+forget_border_pixmap(struct border_pixmap *bp)
+{
+	struct border_pixmap *prev = htable_get(&border_table, bp->hash);
+
+	if (prev == bp) {
+		/* replacing the value of a key can't fail */
+		if (bp->next != NULL)
+			htable_put(&border_table, bp->hash, bp->next);
+		else
+			htable_delete(&border_table, bp->hash);
+		return;
+	}
+
+	while (prev->next != bp)
+		prev = prev->next;
+	prev->next = bp->next;
+}
+
+/*
+ * Free all cached border pixmaps and their graphics contexts.
+ */
+
+static void
+free_border_cache(void)
+{
+	struct border_pixmap *bp;
+
+	while (border_cache != NULL) {
+		bp = border_cache->data;
+		if (conn != NULL)
+			xcb_free_pixmap(conn, bp->pixmap);
+		free(bp);
+		list_delete_item(&border_cache, border_cache);
+	}
+	htable_free(&border_table);
+	border_cache_bytes = 0;
+
+	for (int i = 0; i <= MAX_DEPTH; i++) {
+		if (border_gc[i] != XCB_NONE && conn != NULL)
+			xcb_free_gc(conn, border_gc[i]);
+		border_gc[i] = XCB_NONE;
+	}
+}
+
+/*
+ * Queue a border width change.
+ */
+
+static void
+set_border_width(struct client *client, uint16_t width)
+{
+	client->configure.mask |= XCB_CONFIG_WINDOW_BORDER_WIDTH;
+	client->configure.border_width = width;
+	mark_dirty(client, DIRTY_CONFIGURE);
+}
+
+/*
+ * Send the queued geometry, border and stacking changes of a client
+ * as a single configure request.
+ */
+
+static void
+commit_configure(struct client *client)
+{
+	struct pending_configure *c = &client->configure;
+	struct window_shadow *sh = &client->shadow;
+	xcb_void_cookie_t cookie;
+	uint32_t values[7];
+	int i = 0;
+
+	/* hidden windows keep their geometry, just left of the screen */
+	if (client->hidden) {
+		c->mask |= XCB_CONFIG_WINDOW_X;
+		c->x = -((c->mask & XCB_CONFIG_WINDOW_WIDTH ? c->width : sh->width)
+				+ 2 * (c->mask & XCB_CONFIG_WINDOW_BORDER_WIDTH ?
+					c->border_width : sh->border_width));
+	}
+
+	/* drop the fields the server already has */
+	if ((c->mask & XCB_CONFIG_WINDOW_X) && c->x == sh->x)
+		c->mask &= ~XCB_CONFIG_WINDOW_X;
+	if ((c->mask & XCB_CONFIG_WINDOW_Y) && c->y == sh->y)
+		c->mask &= ~XCB_CONFIG_WINDOW_Y;
+	if ((c->mask & XCB_CONFIG_WINDOW_WIDTH) && c->width == sh->width)
+		c->mask &= ~XCB_CONFIG_WINDOW_WIDTH;
+	if ((c->mask & XCB_CONFIG_WINDOW_HEIGHT) && c->height == sh->height)
+		c->mask &= ~XCB_CONFIG_WINDOW_HEIGHT;
+	if ((c->mask & XCB_CONFIG_WINDOW_BORDER_WIDTH)
+			&& c->border_width == sh->border_width)
+		c->mask &= ~XCB_CONFIG_WINDOW_BORDER_WIDTH;
+
+	if (c->mask == 0) {
+		/* ICCCM wants a synthetic event when a request changes nothing */
+		if (c->notify) {
+			send_configure_notify(client);
+			requests_elided++;
+		}
+		c->notify = false;
+		return;
+	}
+
+	if (c->mask & XCB_CONFIG_WINDOW_X)
+		values[i++] = sh->x = c->x;
+	if (c->mask & XCB_CONFIG_WINDOW_Y)
+		values[i++] = sh->y = c->y;
+	if (c->mask & XCB_CONFIG_WINDOW_WIDTH)
+		values[i++] = sh->width = c->width;
+	if (c->mask & XCB_CONFIG_WINDOW_HEIGHT)
+		values[i++] = sh->height = c->height;
+	if (c->mask & XCB_CONFIG_WINDOW_BORDER_WIDTH)
+		values[i++] = sh->border_width = c->border_width;
+	if (c->mask & XCB_CONFIG_WINDOW_STACK_MODE) {
+		values[i++] = c->stack_mode;
+		sh->stack_known = true;
+		sh->stack_mode = c->stack_mode;
+	}
+
+	cookie = xcb_configure_window(conn, client->window, c->mask, values);
+	/* the configure notify and the crossings it causes are handled here */
+	ignore_request(client->window, cookie.sequence,
+			IGNORE_CONFIGURE | IGNORE_CROSSING);
+	if (!client->hidden && (c->mask & (XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y
+				| XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT))) {
+		client->monitor = find_monitor_by_coord(client->geom.x, client->geom.y);
+		update_current_desktop(client);
+		ipc_emit(IPCEventGeometry, client->window,
+				sh->x, sh->y, sh->width, sh->height);
+	}
+	c->mask = 0;
+	c->notify = false;
+}
+
+/*
+ * Tell a client its current geometry, for configure requests that didn't
+ * change anything.
+ */
+
+static void
+send_configure_notify(struct client *client)
+{
+	xcb_configure_notify_event_t ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.response_type = XCB_CONFIGURE_NOTIFY;
+	ev.event = ev.window = client->window;
+	ev.above_sibling = XCB_NONE;
+	ev.x = client->shadow.x;
+	ev.y = client->shadow.y;
+	ev.width = client->shadow.width;
+	ev.height = client->shadow.height;
+	ev.border_width = client->shadow.border_width;
+	ev.override_redirect = false;
+	xcb_send_event(conn, false, client->window,
+			XCB_EVENT_MASK_STRUCTURE_NOTIFY, (char *)&ev);
+}
+
+/*
+ * Map a managed window unless it is already mapped. A window hidden
+ * offscreen is moved back instead.
+ */
+
+static void
+show_window(struct client *client)
+{
+	xcb_void_cookie_t cookie;
+
+	if (client->hidden) {
+		client->hidden = false;
+		client->configure.mask |= XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y;
+		client->configure.x = client->geom.x;
+		client->configure.y = client->geom.y;
+		mark_dirty(client, DIRTY_CONFIGURE);
+		update_ewmh_wm_state(client);
+		if (client->shadow.mapped) {
+			client->mapped = true;
+			ipc_emit(IPCEventMap, client->window, 0, 0, 0, 0);
+			update_window_status(client);
+		}
+	}
+
+	if (client->shadow.mapped) {
+		requests_elided++;
+		return;
+	}
+
+	cookie = xcb_map_window(conn, client->window);
+	ignore_request(client->window, cookie.sequence, IGNORE_CROSSING);
+	client->shadow.mapped = true;
+}
+
+/*
+ * Unmap a managed window unless it is already unmapped.
+ */
+
+static void
+hide_window(struct client *client)
+{
+	xcb_void_cookie_t cookie;
+
+	if (!client->shadow.mapped || client->hidden) {
+		requests_elided++;
+		return;
+	}
+
+	/*
+	 * The unmap notify, if any, is ignored: do its bookkeeping here. The
+	 * focus is moved once by the caller. An offscreen window is moved by
+	 * commit_configure, with the other requests of the batch. It stays
+	 * mapped, so pagers are told it's hidden with _NET_WM_STATE.
+	 */
+	if (conf.hide_mode == HIDE_OFFSCREEN) {
+		client->hidden = true;
+		mark_dirty(client, DIRTY_CONFIGURE);
+		update_ewmh_wm_state(client);
+	} else {
+		cookie = xcb_unmap_window(conn, client->window);
+		ignore_request(client->window, cookie.sequence,
+				IGNORE_UNMAP | IGNORE_CROSSING);
+		client->shadow.mapped = false;
+	}
+
+	client->mapped = false;
+	ipc_emit(IPCEventUnmap, client->window, 0, 0, 0, 0);
+	update_window_status(client);
+}
+
+/*
+ * Set the border pixel or pixmap of a window if it changed.
+ */
+
+static void
+set_border_attribute(struct client *client, uint32_t attr, uint32_t value)
+{
+	if (client->shadow.border_attr == attr
+			&& client->shadow.border_value == value) {
+		requests_elided++;
+		return;
+	}
+
+	xcb_change_window_attributes(conn, client->window, attr, &value);
+	client->shadow.border_attr = attr;
+	client->shadow.border_value = value;
+}
+
+/*
+ * Write _NET_WM_STATE on a window if it changed.
+ */
+
+static void
+set_net_wm_state(struct client *client, xcb_atom_t type, int len, xcb_atom_t *atoms)
+{
+	struct window_shadow *sh = &client->shadow;
+
+	if (sh->wm_state_len == len
+			&& memcmp(sh->wm_state, atoms, len * sizeof(xcb_atom_t)) == 0) {
+		requests_elided++;
+		return;
+	}
+
+	xcb_change_property(conn, XCB_PROP_MODE_REPLACE, client->window,
+			ewmh->_NET_WM_STATE, type, 32, len, atoms);
+
+	if (len <= (int)(sizeof(sh->wm_state) / sizeof(xcb_atom_t))) {
+		memcpy(sh->wm_state, atoms, len * sizeof(xcb_atom_t));
+		sh->wm_state_len = len;
+	} else {
+		sh->wm_state_len = -1;
+	}
+}
+
+/*
+ * Write _NET_CURRENT_DESKTOP if it changed.
+ */
+
+static void
+set_current_desktop(uint32_t desktop)
+{
+	if (current_desktop_known && current_desktop == desktop) {
+		requests_elided++;
+		return;
+	}
+
+	xcb_ewmh_set_current_desktop(ewmh, 0, desktop);
+	current_desktop = desktop;
+	current_desktop_known = true;
+}
+
+/*
+ * Write _NET_ACTIVE_WINDOW if it changed.
+ */
+
+static void
+set_active_window(xcb_window_t win)
+{
+	if (active_window_known && active_window == win) {
+		requests_elided++;
+		return;
+	}
+
+	xcb_change_property(conn, XCB_PROP_MODE_REPLACE, scr->root,
+			ewmh->_NET_ACTIVE_WINDOW, XCB_ATOM_WINDOW, 32, 1, &win);
+	active_window = win;
+	active_window_known = true;
+}
+
+/*
+ * Deletes and frees a client from the list.
+ */
+
+static void
+free_window(struct client *client)
+{
+	struct list_item *item;
+	struct list_item *focus_item;
+
+	DMSG("freeing 0x%08x\n", client->window);
+	item = client->item;
+	focus_item = client->focus_item;
+
+	htable_delete(&win_table, client->window);
+	window_array_remove(&client_order, client->window);
+	window_array_remove(&client_stack, client->window);
+	window_array_remove(&dirty_clients, client->window);
+	client_list_dirty = true;
+	free(client->class_name);
+	free(client->instance_name);
+	free(client);
+	list_delete_item(&win_list, item);
+	list_delete_item(&focus_list, focus_item);
+}
+
+/*
+ * Append window to the end of a window array.
+ */
+
+static void
+window_array_append(struct window_array *array, xcb_window_t win)
+{
+	xcb_window_t *wins;
+
+	if (array->len == array->size) {
+		wins = realloc(array->wins,
+				(array->size ? array->size * 2 : 32) * sizeof(xcb_window_t));
+		if (wins == NULL)
+			return;
+		array->wins = wins;
+		array->size = array->size ? array->size * 2 : 32;
+	}
+
+	array->wins[array->len++] = win;
+}
+
+/*
+ * Remove window from a window array, keeping the order of the rest.
+ */
+
+static bool
+window_array_remove(struct window_array *array, xcb_window_t win)
+{
+	uint32_t i = 0;
+
+	while (i < array->len && array->wins[i] != win)
+		i++;
+
+	if (i == array->len)
+		return false;
+
+	memmove(array->wins + i, array->wins + i + 1,
+			(array->len - i - 1) * sizeof(xcb_window_t));
+	array->len--;
+
+	return true;
+}
+
+/*
+ * Remember that a client needs work at the end of the event batch.
+ */
+
+static void
+mark_dirty(struct client *client, uint8_t flags)
+{
+	if (client->dirty == 0)
+		window_array_append(&dirty_clients, client->window);
+	client->dirty |= flags;
+}
+
+/*
+ * Repaint the borders, publish the status and send the configure request
+ * of the clients that changed during the event batch.
+ * Solid borders don't depend on the window size, so a geometry change
+ * alone only matters for two-colour borders.
+ */
+
+static void
+commit_dirty_clients(void)
+{
+	struct client *client;
+	uint8_t flags;
+
+	for (uint32_t i = 0; i < dirty_clients.len; i++) {
+		client = find_client(&dirty_clients.wins[i]);
+		if (client == NULL)
+			continue;
+
+		/* flags stay set while committing, so nothing is queued twice */
+		flags = client->dirty;
+
+		if (flags & DIRTY_STATUS)
+			publish_window_status(client);
+
+		if (conf.internal_border_width == 0)
+			flags &= ~DIRTY_GEOMETRY;
+		if ((flags & DIRTY_BORDERS) != 0 && !client->maxed) {
+			if (client == focused_win)
+				set_borders(client, conf.focus_color, conf.internal_focus_color);
+			else
+				set_borders(client, conf.unfocus_color, conf.internal_unfocus_color);
+		}
+
+		commit_configure(client);
+		client->dirty = 0;
+	}
+	dirty_clients.len = 0;
+}
+
+/*
+ * Write the ewmh client lists if they changed since the last write.
+ */
+
+static void
+update_client_list(void)
+{
+	if (!client_list_dirty)
+		return;
+
+	xcb_ewmh_set_client_list(ewmh, scrno, client_order.len, client_order.wins);
+	xcb_ewmh_set_client_list_stacking(ewmh, scrno, client_stack.len, client_stack.wins);
+	client_list_dirty = false;
+}
+
+static void
+update_wm_desktop(struct client *client)
+{
+	if (client != NULL)
+		xcb_ewmh_set_wm_desktop(ewmh, client->window, client->group);
+}
+
+static void
+update_current_desktop(struct client *client)
+{
+	if (client != NULL)
+		set_current_desktop(client->group);
+}
+
+/*
+ * Publish the window status at the end of the event batch.
+ */
+
+static void
+update_window_status(struct client *client)
+{
+	/* it really shouldn't happen */
+	if (client == NULL)
+		return;
+
+	mark_dirty(client, DIRTY_STATUS);
+}
+
+/*
+ * Serialize the status of a window as JSON.
+ * Returns the length of the string, like snprintf.
+ */
+
+static int
+format_window_status(struct client *client, char *buf, size_t len)
+{
+	char *state;
+	if (client->maxed) state = "maxed";
+	else if (client->hmaxed) state = "hmaxed";
+	else if (client->vmaxed) state = "vmaxed";
+	else if (client->monocled) state = "monocled";
+	else if (client->gridded) state = "gridded";
+	else state = "normal";
+	/* this is going to be fun */
+#define _BOOL_VALUE(value) ((value) ? "true" : "false")
+	return snprintf(buf, len,
+	"{"
+		"\"window\":\"0x%08x\","
+		"\"geom\":{"
+			"\"x\":%d,"
+			"\"y\":%d,"
+			"\"width\":%d,"
+			"\"height\":%d,"
+			"\"set_by_user\":%s"
+		"},"
+		"\"state\":\"%s\","
+		"\"min_width\":%d,"
+		"\"min_height\":%d,"
+		"\"max_width\":%d,"
+		"\"max_height\":%d,"
+		"\"width_inc\":%d,"
+		"\"height_inc\":%d,"
+		"\"mapped\":%s,"
+		"\"group\":%d"
+	"}", client->window, client->geom.x, client->geom.y, client->geom.width,
+	client->geom.height, _BOOL_VALUE(client->geom.set_by_user), state,
+	client->min_width, client->min_height, client->max_width, client->max_height,
+	client->width_inc, client->height_inc, _BOOL_VALUE(client->mapped), client->group);
+#undef _BOOL_VALUE
+}
+
+/*
+ * Write the WINDOWCHEF_STATUS property if it differs from the last write.
+ */
+
+static void
+publish_window_status(struct client *client)
+{
+	char buf[STATUS_MAXLEN];
+	int size;
+
+	size = format_window_status(client, buf, sizeof(buf));
+	if (size < 0 || size >= STATUS_MAXLEN) {
+		DMSG("couldn't format status of 0x%08x\n", client->window);
+		return;
+	}
+
+	if (size == client->status_len && memcmp(buf, client->status, size) == 0)
+		return;
+
+	memcpy(client->status, buf, size);
+	client->status_len = size;
+	xcb_change_property(conn, XCB_PROP_MODE_REPLACE, client->window,
+			ATOMS[WINDOWCHEF_STATUS], XCB_ATOM_STRING, 8, size, client->status);
+}
+
+static void
+group_add_window(struct client *client, uint32_t group)
+{
+	if (client != NULL && group < conf.groups) {
+		client->group = group;
+		group_in_use[group] = true;
+		update_wm_desktop(client);
+		update_group_list();
+		update_current_desktop(client);
+		update_window_status(client);
+	}
+}
+
+static void
+group_remove_window(struct client *client)
+{
+	if (client != NULL) {
+		client->group = NULL_GROUP;
+		update_wm_desktop(client);
+		update_group_list();
+		update_current_desktop(client);
+		update_window_status(client);
+	}
+}
 
-		win = win->next;
+static void
+group_remove_all_windows(uint32_t group)
+{
+	if (group >= conf.groups)
+		return;
+
+	struct list_item *item;
+	struct client *client;
+
+	for (item = win_list; item != NULL; item = item->next) {
+		client = item->data;
+		if (client != NULL && client->group == group) {
+			group_remove_window(client);
+		}
 	}
 
-	win = valid_windows;
-	while(win != NULL) {
-		float cur_distance;
-		float cur_angle;
+	group_in_use[group] = false;
+}
 
-		cur_distance = get_distance_between_windows(focused_win, (struct client *)win->data);
-		cur_angle = get_angle_between_windows(focused_win, (struct client *)win->data);
+static void
+group_activate(uint32_t group) {
+	if (group >= conf.groups)
+		return;
 
-		if (is_in_valid_direction(dir, cur_angle, 10)) {
-			if (is_overlapping(focused_win, (struct client *)win->data))
-				cur_distance = cur_distance * 0.1;
-			cur_distance = cur_distance * 0.80;
+	struct list_item *item;
+	struct client *client;
+
+	for (item = win_list; item != NULL; item = item->next) {
+		client = item->data;
+		if (client->group == group) {
+			show_window(client);
+			set_focused(client);
 		}
-		else if (is_in_valid_direction(dir, cur_angle, 25)) {
-			if (is_overlapping(focused_win, (struct client *)win->data))
-				cur_distance = cur_distance * 0.1;
-			cur_distance = cur_distance * 0.85;
+	}
+	group_in_use[group] = true;
+	last_group = group;
+	update_group_list();
+	ipc_emit(IPCEventGroupActivate, group, 0, 0, 0, 0);
+}
+
+static void
+group_deactivate(uint32_t group)
+{
+	if (group >= conf.groups)
+		return;
+
+	struct list_item *item;
+	struct client *client;
+
+	for (item = win_list; item != NULL; item = item->next) {
+		client = item->data;
+		if (client->group == group)
+			hide_window(client);
+	}
+
+	/* the unmap notifies are ignored, the focus is moved only once */
+	if (focused_win != NULL && !focused_win->mapped) {
+		focused_win = NULL;
+		if (conf.last_window_focusing)
+			set_focused_last_best();
+		if (focused_win == NULL)
+			xcb_set_input_focus(conn, XCB_INPUT_FOCUS_POINTER_ROOT,
+					XCB_INPUT_FOCUS_POINTER_ROOT, XCB_CURRENT_TIME);
+	}
+	group_in_use[group] = false;
+	update_group_list();
+	ipc_emit(IPCEventGroupDeactivate, group, 0, 0, 0, 0);
+}
+
+static void
+group_toggle(uint32_t group)
+{
+	if (group >= conf.groups)
+		return;
+
+	if (group_in_use[group])
+		group_deactivate(group);
+	else
+		group_activate(group);
+	last_group = group;
+	update_group_list();
+}
+
+static void
+group_activate_specific(uint32_t group)
+{
+	if (group >= conf.groups)
+		return;
+
+	for (unsigned int i = 0; i < conf.groups; i++) {
+		if (i == group)
+			group_activate(i);
+		else
+			group_deactivate(i);
+	}
+	update_group_list();
+}
+
+static void update_group_list(void)
+{
+	struct list_item *item;
+	struct client *client;
+	bool first = true;
+	uint32_t data[1];
+
+	for (unsigned int i = 0; i < conf.groups; i++) {
+		/* deactivate group if no window in group */
+		item = win_list;
+		while (item != NULL && (client = item->data)->group != i)
+			item = item->next;
+		if (item == NULL)
+			group_in_use[i] = false;
+
+		if (group_in_use[i]) {
+			uint8_t mode = XCB_PROP_MODE_APPEND;
+			data[0] = i + 1;
+			if (first) {
+				mode = XCB_PROP_MODE_REPLACE;
+				first = false;
+			}
+			xcb_change_property(conn, mode, scr->root, ATOMS[WINDOWCHEF_ACTIVE_GROUPS], XCB_ATOM_INTEGER, 32, 1, data);
 		}
-		else if (is_in_valid_direction(dir, cur_angle, 35)) {
-			if (is_overlapping(focused_win, (struct client *)win->data))
-				cur_distance = cur_distance * 0.1;
-			cur_distance = cur_distance * 0.9;
+	}
+
+	if (first) {
+		data[0] = 0;
+		xcb_change_property(conn, XCB_PROP_MODE_REPLACE, scr->root, ATOMS[WINDOWCHEF_ACTIVE_GROUPS], XCB_ATOM_INTEGER, 32, 1, data);
+	}
+}
+
+static void
+change_nr_of_groups(uint32_t groups)
+{
+	bool *copy = malloc(groups * sizeof(bool));
+	uint32_t until = groups < conf.groups ? groups : conf.groups;
+	struct list_item *item;
+	struct client *client;
+
+	for (uint32_t i = 0; i < until; i++)
+		copy[i] = group_in_use[i];
+
+	if (groups < conf.groups)
+		for (item = win_list; item != NULL; item = item->next) {
+			client = item->data;
+			if (client->group != NULL_GROUP && client->group >= groups) {
+				group_activate(client->group);
+				client->group = NULL_GROUP;
+				update_wm_desktop(client);
+			}
 		}
-		else if (is_in_valid_direction(dir, cur_angle, 50)) {
-			if (is_overlapping(focused_win, (struct client *)win->data))
-				cur_distance = cur_distance * 0.1;
-			cur_distance = cur_distance * 3;
+
+	conf.groups = groups;
+	free(group_in_use);
+	group_in_use = copy;
+}
+
+/*
+ * Repaint the borders of all windows after a border setting changed.
+ */
+
+static void
+refresh_borders(void)
+{
+	if (!conf.apply_settings)
+		return;
+
+	struct list_item *item;
+
+	for (item = win_list; item != NULL; item = item->next)
+		mark_dirty(item->data, DIRTY_CONFIG);
+}
+
+static void
+update_ewmh_wm_state(struct client *client)
+{
+	int i;
+	xcb_atom_t values[12];
+
+	if (client == NULL)
+		return;
+#define HANDLE_WM_STATE(s) \
+	values[i] = ewmh->_NET_WM_STATE_##s; \
+	i++; \
+	DMSG("ewmh net_wm_state %s present\n", #s);
+
+	i = 0;
+	if (client->maxed) {
+		HANDLE_WM_STATE(FULLSCREEN);
+	}
+	if (client->vmaxed) {
+		HANDLE_WM_STATE(MAXIMIZED_VERT);
+	}
+	if (client->hmaxed) {
+		HANDLE_WM_STATE(MAXIMIZED_HORZ);
+	}
+	/* still mapped, but out of sight */
+	if (client->hidden) {
+		HANDLE_WM_STATE(HIDDEN);
+	}
+
+	set_net_wm_state(client, XCB_ATOM_ATOM, i, values);
+}
+
+/*
+ * Maximize / unmaximize windows based on ewmh requests.
+ */
+
+static void
+handle_wm_state(struct client *client, xcb_atom_t state, unsigned int action)
+{
+	int16_t mon_x, mon_y;
+	uint16_t mon_w, mon_h;
+
+	get_monitor_size(client, &mon_x, &mon_y, &mon_w, &mon_h);
+
+	if (state == ewmh->_NET_WM_STATE_FULLSCREEN) {
+		if (action == XCB_EWMH_WM_STATE_ADD) {
+			maximize_window(client, mon_x, mon_y, mon_w, mon_h);
+			set_focused_no_raise(client);
+		} else if (action == XCB_EWMH_WM_STATE_REMOVE && client->maxed) {
+			reset_window(client);
+			set_focused(client);
+		} else if (action == XCB_EWMH_WM_STATE_TOGGLE) {
+			if (client->maxed) {
+				reset_window(client);
+				set_focused(client);
+			} else {
+				maximize_window(client, mon_x, mon_y, mon_w, mon_h);
+				set_focused_no_raise(client);
+			}
 		}
-		else {
-			win = win->next;
-			continue;
+	} else if (state == ewmh->_NET_WM_STATE_MAXIMIZED_VERT) {
+		if (action == XCB_EWMH_WM_STATE_ADD) {
+			vmaximize_window(client, mon_y, mon_h);
+		} else if (action == XCB_EWMH_WM_STATE_REMOVE) {
+			if (client->vmaxed)
+				reset_window(client);
+		} else if (action == XCB_EWMH_WM_STATE_TOGGLE) {
+			if (client->vmaxed)
+				reset_window(client);
+			else
+				vmaximize_window(client, mon_y, mon_h);
 		}
+	} else if (state == ewmh->_NET_WM_STATE_MAXIMIZED_HORZ) {
+		if (action == XCB_EWMH_WM_STATE_ADD) {
+			hmaximize_window(client, mon_y, mon_h);
+		} else if (action == XCB_EWMH_WM_STATE_REMOVE) {
+			if (client->hmaxed)
+				reset_window(client);
+		} else if (action == XCB_EWMH_WM_STATE_TOGGLE) {
+			if (client->hmaxed)
+				reset_window(client);
+			else
+				hmaximize_window(client, mon_x, mon_w);
+		}
+	}
+}
 
-		if (is_in_cardinal_direction(dir, focused_win, (struct client *)win->data))
-			cur_distance = cur_distance * 0.9;
+/*
+ * Snap window in corner.
+ */
 
+static void
+snap_window(struct client *client, enum position pos)
+{
+	int16_t mon_x, mon_y, win_x, win_y;
+	uint16_t mon_w, mon_h, win_w, win_h;
 
-		if (closest_distance == -1 || (cur_distance < closest_distance)) {
-			closest_distance = cur_distance;
-			desired_window = win;
-		}
+	if (client == NULL)
+		return;
 
-		win = win->next;
+	if (is_special(client)) {
+		reset_window(client);
+		refocus(client);
 	}
 
-	if (desired_window != NULL)
-		set_focused(desired_window->data);
+	fit_on_screen(client);
 
-	if (valid_windows != NULL)
-		list_delete_all_items(&valid_windows, false);
-}
+	win_x = client->geom.x;
+	win_y = client->geom.y;
+	win_w = client->geom.width + 2 * conf.border_width;
+	win_h = client->geom.height + 2 * conf.border_width;
 
-static struct win_position
-get_window_position(uint32_t mode, struct client *win)
-{
-	struct win_position pos;
-	pos.x = 0;
-	pos.y = 0;
+	get_monitor_size(client, &mon_x, &mon_y, &mon_w, &mon_h);
 
-	switch (mode) {
-		case CENTER:
-			pos.x = win->geom.x + (win->geom.width / 2);
-			pos.y = win->geom.y + (win->geom.height / 2);
-			break;
+	switch (pos) {
 		case TOP_LEFT:
-			pos.x = win->geom.x;
-			pos.y = win->geom.y;
+			win_x = mon_x + conf.gap_left;
+			win_y = mon_y + conf.gap_up;
 			break;
+
 		case TOP_RIGHT:
-			pos.x = win->geom.x + win->geom.width;
-			pos.y = win->geom.y;
+			win_x = mon_x + mon_w - conf.gap_right - win_w;
+			win_y = mon_y + conf.gap_up;
+			break;
+
+		case BOTTOM_LEFT:
+			win_x = mon_x + conf.gap_left;
+			win_y = mon_y + mon_h - conf.gap_down - win_h;
 			break;
+
 		case BOTTOM_RIGHT:
-			pos.x = win->geom.x + win->geom.width;
-			pos.y = win->geom.y + win->geom.height;
+			win_x = mon_x + mon_w - conf.gap_right - win_w;
+			win_y = mon_y + mon_h - conf.gap_down - win_h;
 			break;
-		case BOTTOM_LEFT:
-			pos.x = win->geom.x;
-			pos.y = win->geom.y + win->geom.height;
+
+		case CENTER:
+			win_x = mon_x + (mon_w - win_w) / 2;
+			win_y = mon_y + (mon_h - win_h) / 2;
 			break;
+
+		default:
+			return;
 	}
-	return pos;
+
+	client->geom.x = win_x;
+	client->geom.y = win_y;
+	teleport_window(client->window, win_x, win_y);
+	if (client == focused_win)
+		center_pointer(client);
 }
 
-static bool
-is_in_cardinal_direction(uint32_t direction, struct client *a, struct client *b)
-{
-	struct win_position pos_a_top_left = get_window_position(TOP_LEFT, a);
-	struct win_position pos_a_top_right = get_window_position(TOP_RIGHT, a);
-	struct win_position pos_a_bot_left = get_window_position(BOTTOM_LEFT, a);
 
-	struct win_position pos_b_center = get_window_position(CENTER, b);
+/*
+ * Put window in grid.
+ */
 
-	switch(direction) {
-		case NORTH:
-		case SOUTH:
-			return pos_a_top_left.x <= pos_b_center.x && pos_a_top_right.x >= pos_b_center.x;
+static void
+grid_window(struct client *client, uint16_t grid_width, uint16_t grid_height, uint16_t grid_x, uint16_t grid_y, uint16_t occ_w, uint16_t occ_h)
+{
+	int16_t mon_x, mon_y;
+	uint16_t base_w, base_h;
+	uint16_t new_w, new_h;
+	uint16_t mon_w, mon_h;
 
-		case WEST:
-		case EAST:
-			return pos_a_top_left.y <= pos_b_center.y && pos_a_bot_left.y >= pos_b_center.y;
+	if (client == NULL || grid_x >= grid_width || grid_y >= grid_height)
+		return;
+
+	DMSG("Gridding window in grid of size (%d, %d) pos (%d, %d) window size (%d, %d)\n", grid_width, grid_height, grid_x, grid_y, occ_w, occ_h);
+	if (is_special(client)) {
+		reset_window(client);
+		refocus(client);
 	}
 
-	return false;
+	get_monitor_size(client, &mon_x, &mon_y, &mon_w, &mon_h);
+
+	base_w = (mon_w - conf.gap_left - conf.gap_right - (grid_width - 1) * conf.grid_gap
+			- grid_width * 2 * conf.border_width) / grid_width;
+	base_h = (mon_h - conf.gap_up - conf.gap_down - (grid_height - 1) * conf.grid_gap
+			- grid_height * 2 * conf.border_width) / grid_height;
+	/* calculate new window size */
+	new_w = base_w * occ_w + (occ_w - 1) * (conf.grid_gap + 2 * conf.border_width);
+
+	new_h = base_h * occ_h + (occ_h - 1) * (conf.grid_gap + 2 * conf.border_width);
+
+	client->orig_geom = client->geom;
+
+	client->geom.width = new_w;
+	client->geom.height = new_h;
+
+	client->geom.x = mon_x + conf.gap_left + grid_x
+		* (conf.border_width + base_w + conf.border_width + conf.grid_gap);
+	client->geom.y = mon_y + conf.gap_up + grid_y
+		* (conf.border_width + base_h + conf.border_width + conf.grid_gap);
+
+	client->gridded = true;
+	client->grid.gx = grid_width;
+	client->grid.gy = grid_height;
+	client->grid.px = grid_x;
+	client->grid.py = grid_y;
+	client->grid.sx = occ_w;
+	client->grid.sy = occ_h;
+
+	DMSG("w: %d\th: %d\n", new_w, new_h);
+
+	teleport_window(client->window, client->geom.x, client->geom.y);
+	resize_window_absolute(client->window, client->geom.width, client->geom.height);
 }
 
-static bool
-is_in_valid_direction(uint32_t direction, float window_direction, float delta)
+static void
+move_grid_window(struct client *client, uint16_t x, uint16_t y)
 {
-	switch((uint32_t)direction) {
-		case NORTH:
-			if (window_direction >= (180 - delta) || window_direction <= (-180 + delta))
-				return true;
-			break;
-		case SOUTH:
-			if (fabs(window_direction) <= ( 0 + delta))
-				return true;
-			break;
-		case EAST:
-			if (window_direction <= (90 + delta) && window_direction > (90 - delta))
-				return true;
-			break;
-		case WEST:
-			if (window_direction <= (-90 + delta) && window_direction >= (-90 - delta))
-				return true;
-			break;
-	}
 
-	return false;
+	int16_t new_px, new_py;
+
+	new_px = client->grid.px + x;
+	new_py = client->grid.py + y;
+
+	if (!client->gridded
+			|| client->grid.gx < new_px + client->grid.sx
+			|| client->grid.gy < new_py + client->grid.sy
+			|| new_px < 0
+			|| new_py < 0)
+		return;
+
+	grid_window(client, client->grid.gx, client->grid.gy, new_px, new_py, client->grid.sx, client->grid.sy);
 }
 
-static bool
-is_overlapping(struct client *a, struct client *b)
+static void
+resize_grid_window(struct client *client, uint16_t x, uint16_t y)
 {
-	struct win_position pos_a_top_left = get_window_position(TOP_LEFT, a);
-	struct win_position pos_a_top_right = get_window_position(TOP_RIGHT, a);
-	struct win_position pos_a_bot_left = get_window_position(BOTTOM_LEFT, a);
 
-	struct win_position pos_b_top_left = get_window_position(TOP_LEFT, b);
-	struct win_position pos_b_top_right = get_window_position(TOP_RIGHT, b);
-	struct win_position pos_b_bot_left = get_window_position(BOTTOM_LEFT, b);
+	int16_t new_sx, new_sy;
+
+	new_sx = client->grid.sx + x;
+	new_sy = client->grid.sy + y;
+
+	if (!client->gridded
+			|| client->grid.gx < new_sx + client->grid.px
+			|| client->grid.gy < new_sy + client->grid.py
+			|| new_sx < 1
+			|| new_sy < 1)
+		return;
+
+	grid_window(client, client->grid.gx, client->grid.gy, client->grid.px, client->grid.py, new_sx, new_sy);
+}
+
+/*
+ * Adds X event handlers to the array.
+ */
+
+static void
+register_event_handlers(void)
+{
+	for (int i = 0; i <= LAST_XCB_EVENT; i++)
+		events[i] = NULL;
+
+	events[XCB_CONFIGURE_REQUEST] = event_configure_request;
+	events[XCB_DESTROY_NOTIFY]    = event_destroy_notify;
+	events[XCB_ENTER_NOTIFY]      = event_enter_notify;
+	events[XCB_MAP_REQUEST]       = event_map_request;
+	events[XCB_MAP_NOTIFY]        = event_map_notify;
+	events[XCB_UNMAP_NOTIFY]      = event_unmap_notify;
+	events[XCB_CLIENT_MESSAGE]    = event_client_message;
+	events[XCB_CONFIGURE_NOTIFY]  = event_configure_notify;
+	events[XCB_CIRCULATE_REQUEST] = event_circulate_request;
+	events[XCB_FOCUS_IN]          = event_focus_in;
+	events[XCB_FOCUS_OUT]         = event_focus_out;
+	events[XCB_BUTTON_PRESS]      = event_button_press;
+	events[XCB_KEY_PRESS]         = event_key_press;
+	events[XCB_MAPPING_NOTIFY]    = event_mapping_notify;
+}
+
+/*
+ * A window wants to be configured.
+ */
+
+static void
+event_configure_request(xcb_generic_event_t *ev)
+{
+	xcb_configure_request_event_t *e = (xcb_configure_request_event_t *)ev;
+	struct client *client;
+	uint32_t values[7];
+	int i = 0;
+
+	client = find_client(&e->window);
+	if (client != NULL) {
+
+		if (e->value_mask & XCB_CONFIG_WINDOW_X
+				&& !client->maxed && !client->monocled && !client->hmaxed)
+			client->geom.x = e->x;
 
-	bool is_x_top_overlapped = pos_a_top_left.x <= pos_b_top_left.x && pos_a_top_right.x >= pos_b_top_left.x;
-	bool is_x_bot_overlapped = pos_a_top_left.x <= pos_b_top_right.x && pos_a_top_right.x >= pos_b_top_right.x;
+		if (e->value_mask & XCB_CONFIG_WINDOW_Y
+				&& !client->maxed && !client->monocled && !client->vmaxed)
+			client->geom.y = e->y;
 
-	bool is_y_top_overlapped = pos_a_top_left.y <= pos_b_top_left.y && pos_a_bot_left.y >= pos_b_top_left.y;
-	bool is_y_bot_overlapped = pos_a_top_left.y <= pos_b_bot_left.y && pos_a_bot_left.y >= pos_b_bot_left.y;
+		if (e->value_mask & XCB_CONFIG_WINDOW_WIDTH
+				&& !client->maxed && !client->monocled && !client->hmaxed)
+			client->geom.width = e->width;
 
-	return (is_x_top_overlapped || is_x_bot_overlapped) && (is_y_top_overlapped || is_y_bot_overlapped);
-}
+		if (e->value_mask & XCB_CONFIG_WINDOW_HEIGHT
+				&& !client->maxed && !client->monocled && !client->vmaxed)
+			client->geom.height = e->height;
 
-static float
-get_angle_between_windows(struct client *a, struct client *b)
-{
-	struct win_position a_pos = get_window_position(CENTER, a);
-	struct win_position b_pos = get_window_position(CENTER, b);
+		if (e->value_mask & XCB_CONFIG_WINDOW_STACK_MODE) {
+			if (e->stack_mode == XCB_STACK_MODE_ABOVE) {
+				raise_window(e->window);
+			} else if (e->stack_mode == XCB_STACK_MODE_BELOW) {
+				lower_window(e->window);
+			} else {
+				values[0] = e->stack_mode;
+				xcb_configure_window(conn, e->window,
+						XCB_CONFIG_WINDOW_STACK_MODE, values);
+				client->shadow.stack_known = false;
+			}
+		}
 
-	float dx = (float)(b_pos.x - a_pos.x);
-	float dy = (float)(b_pos.y - a_pos.y);
+		if (e->value_mask & XCB_CONFIG_WINDOW_BORDER_WIDTH)
+			set_border_width(client, e->border_width);
 
-	if (dx == 0.0 && dy == 0.0)
-		return 0.0;
+		/* answered even if nothing ends up changing */
+		client->configure.notify = true;
+		mark_dirty(client, DIRTY_CONFIGURE);
 
-	return atan2(dx,dy) * (180 / PI);
-}
+		if (!client->maxed) {
+			fit_on_screen(client);
+		}
 
-static float
-get_distance_between_windows(struct client *a, struct client *b)
-{
-	struct win_position a_pos = get_window_position(CENTER, a);
-	struct win_position b_pos = get_window_position(CENTER, b);
+		teleport_window(client->window, client->geom.x, client->geom.y);
+		resize_window_absolute(client->window, client->geom.width, client->geom.height);
+	} else {
+		if (e->value_mask & XCB_CONFIG_WINDOW_X) {
+			values[i] = e->x;
+			i++;
+		}
 
-	float distance = hypot((float)(b_pos.x - a_pos.x), (float)(b_pos.y - a_pos.y));
-	return distance;
-}
+		if (e->value_mask & XCB_CONFIG_WINDOW_Y) {
+			values[i] = e->y;
+			i++;
+		}
 
-/*
- * Get atom by name.
- */
+		if (e->value_mask & XCB_CONFIG_WINDOW_WIDTH) {
+			values[i] = e->width;
+			i++;
+		}
 
-static xcb_atom_t
-get_atom(char *name)
-{
-	xcb_intern_atom_cookie_t cookie = xcb_intern_atom(conn, false, strlen(name), name);
-	xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(conn, cookie, NULL);
+		if (e->value_mask & XCB_CONFIG_WINDOW_HEIGHT) {
+			values[i] = e->height;
+			i++;
+		}
 
-	if (!reply)
-		return XCB_ATOM_STRING;
+		if (e->value_mask & XCB_CONFIG_WINDOW_SIBLING) {
+			values[i] = e->sibling;
+			i++;
+		}
 
-	return reply->atom;
-}
+		if (e->value_mask & XCB_CONFIG_WINDOW_STACK_MODE) {
+			values[i] = e->stack_mode;
+			i++;
+		}
 
-/*
- * Update _NET_DESKTOP_VIEWPORT root property.
- */
+		if (e->value_mask & XCB_CONFIG_WINDOW_BORDER_WIDTH) {
+			values[i] = e->border_width;
+			i++;
+		}
 
-static void
-update_desktop_viewport(void)
-{
-	xcb_ewmh_coordinates_t coord = {0, 0};
-	xcb_ewmh_set_desktop_viewport(ewmh, scrno, 1, &coord);
+		if (i == 0)
+			return;
+		xcb_configure_window(conn, e->window, e->value_mask, values);
+		if (e->value_mask & XCB_CONFIG_WINDOW_STACK_MODE)
+			forget_stacking();
+	}
 }
 
 /*
- * Get the mouse pointer's coordinates.
+ * Window has been destroyed.
  */
 
-static bool
-get_pointer_location(xcb_window_t *win, int16_t *x, int16_t *y)
+static void
+event_destroy_notify(xcb_generic_event_t *ev)
 {
-	xcb_query_pointer_reply_t *pointer;
+	struct client *client;
+	struct adoption *a;
+	xcb_destroy_notify_event_t *e = (xcb_destroy_notify_event_t *)ev;
 
-	pointer = xcb_query_pointer_reply(conn,
-			xcb_query_pointer(conn, *win), 0);
+	/*
+	 * The adoption requests may already have reached the server: don't
+	 * manage the window once their replies are read.
+	 */
+	a = find_adoption(e->window);
+	if (a != NULL)
+		adopt_discard(a);
 
-	*x = pointer->win_x;
-	*y = pointer->win_y;
+	client = find_client(&e->window);
+	if (conf.last_window_focusing && focused_win != NULL && focused_win == client) {
+	    focused_win = NULL;
+		set_focused_last_best();
+	}
 
-	free(pointer);
+	if (client != NULL) {
+		ipc_emit(IPCEventDestroy, client->window, 0, 0, 0, 0);
+		free_window(client);
+	}
 
-	return pointer != NULL;
+	update_group_list();
 }
 
+/*
+ * The mouse pointer has entered the window.
+ */
+
 static void
-center_pointer(struct client *client)
+event_enter_notify(xcb_generic_event_t *ev)
 {
-	int16_t cur_x, cur_y;
+	xcb_enter_notify_event_t *e = (xcb_enter_notify_event_t *)ev;
+	struct client *client;
 
-	cur_x = cur_y = 0;
+	if (conf.sloppy_focus == false)
+		return;
 
-	switch (conf.cursor_position) {
-	case TOP_LEFT:
-		cur_x = -conf.border_width;
-		cur_y = -conf.border_width;
-		break;
-	case TOP_RIGHT:
-		cur_x = client->geom.width + conf.border_width;
-		cur_y = 0 - conf.border_width;
-		break;
-	case BOTTOM_LEFT:
-		cur_x = 0 - conf.border_width;
-		cur_y = client->geom.height + conf.border_width;
-		break;
-	case BOTTOM_RIGHT:
-		cur_x = client->geom.width + conf.border_width;
-		cur_y = client->geom.height + conf.border_width;
-		break;
-	case CENTER:
-		cur_x = client->geom.width / 2;
-		cur_y = client->geom.height / 2;
-		break;
-	default: break;
-	}
+	if (focused_win != NULL && e->event == focused_win->window)
+		return;
 
-	xcb_warp_pointer(conn, XCB_NONE, client->window, 0, 0, 0, 0, cur_x, cur_y);
-	xcb_flush(conn);
+	client = find_client(&e->event);
+
+	if (client != NULL)
+		set_focused_no_raise(client);
 }
 
 /*
- * Get the client instance with a given window id.
+ * A window wants to show up on the screen.
  */
 
-static struct client*
-find_client(xcb_window_t *win)
+static void
+event_map_request(xcb_generic_event_t *ev)
 {
-	struct list_item *item;
+	xcb_map_request_event_t *e = (xcb_map_request_event_t *)ev;
+	struct client *client;
 
-	item = win_list;
-	while (item != NULL && ((struct client *)item->data)->window != *win)
-		item = item ->next;
+	/* create window if new, once the replies are in */
+	client = find_client(&e->window);
+	if (client == NULL) {
+		adopt_begin(e->window, true);
+		return;
+	}
 
-	if (item == NULL)
-		return NULL;
-	else
-		return item->data;
+	map_client(client);
 }
 
 /*
- * Get a window's geometry.
+ * Find the monitor of a new window and fit it on it.
  */
 
-static bool
-get_geometry(xcb_window_t *win, int16_t *x, int16_t *y, uint16_t *width, uint16_t *height, uint8_t *depth)
+static void
+place_client(struct client *client)
 {
-	xcb_get_geometry_reply_t *reply = xcb_get_geometry_reply(conn, xcb_get_geometry(conn, *win), NULL);
-
-	if (reply == NULL)
-		return false;
-	if (x != NULL)
-		*x = reply->x;
-	if (y != NULL)
-		*y = reply->y;
-	if (width != NULL)
-		*width = reply->width;
-	if (height != NULL)
-		*height = reply->height;
-	if (depth != NULL)
-		*depth = reply->depth;
+	if (randr_base != -1) {
+		client->monitor = find_monitor_by_coord(client->geom.x, client->geom.y);
+		if (client->monitor == NULL && mon_list != NULL)
+			client->monitor = mon_list->data;
+	}
 
-	free(reply);
-	return true;
+	/* maximized, monocled and gridded windows already fit, and keep their state */
+	if (!is_special(client))
+		fit_on_screen(client);
 }
 
 /*
- * Set the color of the border.
+ * Map a managed window and give it focus.
  */
 
 static void
-set_borders(struct client *client, uint32_t color, uint32_t internal_color)
+map_client(struct client *client)
 {
-	if (client == NULL || conf.borders == false)
-		return;
-	uint32_t values[1];
-
-	color = get_color_pixel(color);
-	internal_color = get_color_pixel(internal_color);
-
-	values[0] = conf.border_width;
-	xcb_configure_window(conn, client->window,
-			XCB_CONFIG_WINDOW_BORDER_WIDTH, values);
-
-	if (conf.internal_border_width == 0) {
-		values[0] = color;
-		xcb_change_window_attributes(conn, client->window, XCB_CW_BORDER_PIXEL, values);
-	}
+	xcb_atom_t data[] = {
+		XCB_ICCCM_WM_STATE_NORMAL,
+		XCB_NONE,
+	};
 
-	if (conf.internal_border_width != 0) {
-		uint32_t calc_iborder = conf.border_width - conf.internal_border_width;
-		xcb_rectangle_t rect_inner[] = {
-			{
-				client->geom.width,
-				0,
-				conf.border_width - calc_iborder,
-				client->geom.height + conf.border_width - calc_iborder
-			},
-			{
-				client->geom.width + conf.border_width + calc_iborder,
-				0,
-				conf.border_width - calc_iborder,
-				client->geom.height + conf.border_width - calc_iborder
-			},
-			{
-				0,
-				client->geom.height,
-				client->geom.width + conf.border_width - calc_iborder,
-				conf.border_width - calc_iborder
-			},
-			{
-				0,
-				client->geom.height + conf.border_width + calc_iborder,
-				client->geom.width + conf.border_width - calc_iborder,
-				conf.border_width - calc_iborder
-			},
-			{
-				client->geom.width + conf.border_width + calc_iborder,
-				conf.border_width + client->geom.height + calc_iborder,
-				conf.border_width,
-				conf.border_width
-			}
-		};
-
-		xcb_rectangle_t rect_outer[] = {
-			{
-				client->geom.width + conf.border_width - calc_iborder,
-				0,
-				calc_iborder,
-				client->geom.height + conf.border_width * 2
-			},
-			{
-				client->geom.width + conf.border_width,
-				0,
-				calc_iborder,
-				client->geom.height + conf.border_width * 2
-			},
-			{
-				0,
-				client->geom.height + conf.border_width - calc_iborder,
-				client->geom.width + conf.border_width * 2,
-				calc_iborder
-			},
-			{
-				0,
-				client->geom.height + conf.border_width,
-				client->geom.width + conf.border_width * 2,
-				calc_iborder
-			},
-			{
-				1,1,1,1
-			}
-		};
+	place_client(client);
 
-		xcb_pixmap_t pmap = xcb_generate_id(conn);
-		xcb_create_pixmap(conn, client->depth, pmap, scr->root,
-			client->geom.width + (conf.border_width * 2),
-			client->geom.height + (conf.border_width * 2)
-		);
+	/* configure before mapping, so the client draws once, where it belongs */
+	commit_configure(client);
+	show_window(client);
 
-		xcb_gcontext_t gc = xcb_generate_id(conn);
-		xcb_create_gc(conn, gc, pmap, 0, NULL);
+	/* window is normal */
+	set_net_wm_state(client, ewmh->_NET_WM_STATE, 2, data);
 
-		values[0] = color;
-		xcb_change_gc(conn, gc, XCB_GC_FOREGROUND, &values[0]);
-		xcb_poly_fill_rectangle(conn, pmap, gc, 5, rect_outer);
+	if (!client->no_focus)
+		center_pointer(client);
 
-		values[0] = internal_color;
-		xcb_change_gc(conn, gc, XCB_GC_FOREGROUND, &values[0]);
-		xcb_poly_fill_rectangle(conn, pmap, gc, 5, rect_inner);
+	mark_dirty(client, DIRTY_FOCUS);
+	update_current_desktop(client);
+}
 
-		values[0] = pmap;
-		xcb_change_window_attributes(conn,client->window, XCB_CW_BORDER_PIXMAP,
-				&values[0]);
+static void
+event_map_notify(xcb_generic_event_t *ev)
+{
+	xcb_map_notify_event_t *e = (xcb_map_notify_event_t *)ev;
+	struct client *client = find_client(&e->window);
 
-		xcb_free_pixmap(conn,pmap);
-		xcb_free_gc(conn,gc);
+	if (client != NULL) {
+		client->mapped = true;
+		ipc_emit(IPCEventMap, client->window, 0, 0, 0, 0);
+		if (!client->no_focus)
+			set_focused(client);
+		update_window_status(client);
+	} else {
+		/* docks and override-redirect windows are mapped on top */
+		forget_stacking();
 	}
 }
 
 /*
- * Returns true if window is mapped.
+ * Window has been unmapped (became invisible).
  */
 
-static bool
-is_mapped(xcb_window_t win)
+static void
+event_unmap_notify(xcb_generic_event_t *ev)
 {
-	bool yes;
-	xcb_get_window_attributes_reply_t *r =
-		xcb_get_window_attributes_reply(conn,
-				xcb_get_window_attributes(conn, win),
-				NULL);
-	if (r == NULL)
-		return false;
+	xcb_map_request_event_t *e = (xcb_map_request_event_t *)ev;
+	struct client *client = NULL;
+	struct adoption *a;
 
-	yes = r->map_state == XCB_MAP_STATE_VIEWABLE;
-	free(r);
+	/* withdrawn before it was managed */
+	a = find_adoption(e->window);
+	if (a != NULL)
+		adopt_discard(a);
+
+	client = find_client(&e->window);
+	if (client == NULL)
+		return;
+
+	client->mapped = false;
+	client->shadow.mapped = false;
+	ipc_emit(IPCEventUnmap, client->window, 0, 0, 0, 0);
 
-	return yes;
+	if (conf.last_window_focusing && focused_win != NULL && client->window == focused_win->window) {
+		focused_win = NULL;
+		set_focused_last_best();
+	}
+
+	update_window_status(client);
 }
 
 /*
- * Deletes and frees a client from the list.
+ * Window has been configured.
  */
 
 static void
-free_window(struct client *client)
+event_configure_notify(xcb_generic_event_t *ev)
 {
+	xcb_configure_notify_event_t *e = (xcb_configure_notify_event_t *)ev;
+	struct client *client;
 	struct list_item *item;
-	struct list_item *focus_item;
-
-	DMSG("freeing 0x%08x\n", client->window);
-	item = client->item;
-	focus_item = client->focus_item;
 
+	/* The root window changes its geometry when the
+	 * user adds/removes/tilts screens */
+	if (e->window == scr->root) {
+		if (e->width != scr->width_in_pixels
+				|| e->height != scr->height_in_pixels) {
+			scr->width_in_pixels = e->width;
+			scr->height_in_pixels = e->height;
 
-	free(client);
-	list_delete_item(&win_list, item);
-	list_delete_item(&focus_list, focus_item);
+			if (randr_base != -1) {
+				get_randr();
+				for (item = win_list; item != NULL; item = item->next) {
+					client = item->data;
+					fit_on_screen(client);
+				}
+			}
+		}
+	} else {
+		/* our own configure requests are handled by commit_configure */
+		client = find_client(&e->window);
+		if (client != NULL) {
+			client->monitor = find_monitor_by_coord(client->geom.x, client->geom.y);
+			update_current_desktop(client);
+		}
+	}
 }
 
 /*
- * Add window to the ewmh client list.
+ * Window wants to change its position in the stacking order.
  */
 
 static void
-add_to_client_list(xcb_window_t win)
+event_circulate_request(xcb_generic_event_t *ev)
 {
-	xcb_change_property(conn, XCB_PROP_MODE_APPEND, scr->root,
-			ewmh->_NET_CLIENT_LIST, XCB_ATOM_WINDOW, 32, 1, &win);
-	xcb_change_property(conn, XCB_PROP_MODE_APPEND, scr->root, ewmh->_NET_CLIENT_LIST_STACKING, XCB_ATOM_WINDOW, 32, 1, &win);
+	xcb_circulate_request_event_t *e = (xcb_circulate_request_event_t *)ev;
+
+	if (e->place == XCB_PLACE_ON_TOP)
+		raise_window(e->window);
+	else
+		lower_window(e->window);
 }
 
 /*
- * Adds all windows to the ewmh client list.
+ * Received client message. Either ewmh/icccm thing or
+ * message from the client.
  */
 
 static void
-update_client_list(void)
+event_client_message(xcb_generic_event_t *ev)
 {
-	xcb_window_t *children;
+	xcb_client_message_event_t *e = (xcb_client_message_event_t *)ev;
+	uint32_t ipc_command, args[IPC_MAX_ARGS];
+	uint32_t *data;
 	struct client *client;
-	uint32_t len;
-
-	xcb_query_tree_reply_t *reply = xcb_query_tree_reply(conn,
-			xcb_query_tree(conn, scr->root), NULL);
-	xcb_delete_property(conn, scr->root, ewmh->_NET_CLIENT_LIST);
-	xcb_delete_property(conn, scr->root, ewmh->_NET_CLIENT_LIST_STACKING);
-
-	if (reply == NULL) {
-		add_to_client_list(0);
-		return;
-	}
 
-	len = xcb_query_tree_children_length(reply);
-	children = xcb_query_tree_children(reply);
-
-	for (unsigned int i = 0; i < len; i++) {
-		client = find_client(&children[i]);
-		if (client != NULL)
-			add_to_client_list(client->window);
+	if (e->type == ATOMS[_IPC_ATOM_COMMAND] && e->format == 32) {
+		/* Message from the client. there is nobody to reply to */
+		data = e->data.data32;
+		ipc_command = data[0];
+		/* any X client can send these, so they can't run programs */
+		if (ipc_command == IPCSpawn)
+			return;
+		/* no room for a target, so it's the focused window */
+		memset(args, 0, sizeof(args));
+		memcpy(args, data + 1, IPC_MIN_ARGS * sizeof(uint32_t));
+		run_ipc_command(ipc_command, args);
+		ipc_reply.len = 0;
+		DMSG("IPC Command %u with arguments %u %u %u\n", ipc_command, data[1], data[2], data[3]);
+	} else {
+		client = find_client(&e->window);
+		if (client == NULL)
+			return;
+		if (e->type == ewmh->_NET_WM_STATE) {
+			DMSG("got _NET_WM_STATE for 0x%08x\n", client->window);
+			handle_wm_state(client, e->data.data32[1], e->data.data32[0]);
+			handle_wm_state(client, e->data.data32[2], e->data.data32[0]);
+		} else if (e->type == ewmh->_NET_ACTIVE_WINDOW) {
+			DMSG("got _NET_ACTIVE_WINDOW for 0x%08x\n", client->window);
+			set_focused(client);
+		}
 	}
-
-	free(reply);
 }
 
 static void
-update_wm_desktop(struct client *client)
+event_focus_in(xcb_generic_event_t *ev)
 {
+	xcb_focus_in_event_t *e = (xcb_focus_in_event_t *)ev;
+	xcb_window_t win = e->event;
+	struct client *client = find_client(&win);
+
 	if (client != NULL)
-		xcb_ewmh_set_wm_desktop(ewmh, client->window, client->group);
+		update_current_desktop(client);
 }
 
 static void
-update_current_desktop(struct client *client)
+event_focus_out(xcb_generic_event_t *ev)
 {
-	if (client != NULL)
-		xcb_ewmh_set_current_desktop(ewmh, 0, client->group);
-}
+	(void)(ev);
+	xcb_get_input_focus_reply_t *focus = xcb_get_input_focus_reply(conn,
+			xcb_get_input_focus(conn), NULL);
+	struct client *client = NULL;
 
-static void update_window_status(struct client *client)
-{
-	/* it really shouldn't happen */
-	if (client == NULL)
-		return;
-	int size = 0;
-	char *str = NULL;
-	char *state;
-	if (client->maxed) state = "maxed";
-	else if (client->hmaxed) state = "hmaxed";
-	else if (client->vmaxed) state = "vmaxed";
-	else if (client->monocled) state = "monocled";
-	else if (client->gridded) state = "gridded";
-	else state = "normal";
-	/* this is going to be fun */
-#define _BOOL_VALUE(value) ((value) ? "true" : "false")
-	size = asprintf(&str,
-	"{"
-		"\"window\":\"0x%08x\","
-		"\"geom\":{"
-			"\"x\":%d,"
-			"\"y\":%d,"
-			"\"width\":%d,"
-			"\"height\":%d,"
-			"\"set_by_user\":%s"
-		"},"
-		"\"state\":\"%s\","
-		"\"min_width\":%d,"
-		"\"min_height\":%d,"
-		"\"max_width\":%d,"
-		"\"max_height\":%d,"
-		"\"width_inc\":%d,"
-		"\"height_inc\":%d,"
-		"\"mapped\":%s,"
-		"\"group\":%d"
-	"}", client->window, client->geom.x, client->geom.y, client->geom.width,
-	client->geom.height, _BOOL_VALUE(client->geom.set_by_user), state,
-	client->min_width, client->min_height, client->max_width, client->max_height,
-	client->width_inc, client->height_inc, _BOOL_VALUE(client->mapped), client->group);
-#undef _BOOL_VALUE
-	if (size == -1) {
-		DMSG("asprintf returned -1\n");
+	if (focused_win != NULL && focus->focus == focused_win->window)
 		return;
-	}
-	xcb_change_property(conn, XCB_PROP_MODE_REPLACE, client->window,
-			ATOMS[WINDOWCHEF_STATUS], XCB_ATOM_STRING, 8, size, str);
-	free(str);
-}
-
-static void
-group_add_window(struct client *client, uint32_t group)
-{
-	if (client != NULL && group < conf.groups) {
-		client->group = group;
-		group_in_use[group] = true;
-		update_wm_desktop(client);
-		update_group_list();
-		update_current_desktop(client);
-		update_window_status(client);
-	}
-}
 
-static void
-group_remove_window(struct client *client)
-{
-	if (client != NULL) {
-		client->group = NULL_GROUP;
-		update_wm_desktop(client);
-		update_group_list();
-		update_current_desktop(client);
-		update_window_status(client);
+	if (focus->focus == scr->root) {
+		focused_win = NULL;
+	} else {
+		client = find_client(&focus->focus);
+		if (client != NULL)
+			set_focused_no_raise(client);
 	}
 }
 
 static void
-group_remove_all_windows(uint32_t group)
+event_button_press(xcb_generic_event_t *ev)
 {
-	if (group >= conf.groups)
-		return;
+	xcb_button_press_event_t *e = (xcb_button_press_event_t *)ev;
+	bool replay = false;
 
-	struct list_item *item;
-	struct client *client;
+	for (int i = 0; i < NR_BUTTONS; i++) {
+		if (e->detail != mouse_buttons[i])
+			continue;
+		if ((conf.click_to_focus == (int8_t) XCB_BUTTON_INDEX_ANY ||
+			 conf.click_to_focus == (int8_t) mouse_buttons[i]) &&
+			(e->state & ~(num_lock | scroll_lock | caps_lock)) == XCB_NONE) {
 
-	for (item = win_list; item != NULL; item = item->next) {
-		client = item->data;
-		if (client != NULL && client->group == group) {
-			group_remove_window(client);
+			replay = !pointer_grab(POINTER_ACTION_FOCUS);
+		} else {
+			pointer_grab(conf.pointer_actions[i]);
 		}
 	}
-
-	group_in_use[group] = false;
+	xcb_allow_events(conn, replay ? XCB_ALLOW_REPLAY_POINTER : XCB_ALLOW_SYNC_POINTER, e->time);
 }
 
-static void
-group_activate(uint32_t group) {
-	if (group >= conf.groups)
-		return;
+/*
+ * A bound key was pressed, or any key while a chain is being typed.
+ */
 
+static void
+event_key_press(xcb_generic_event_t *ev)
+{
+	xcb_key_press_event_t *e = (xcb_key_press_event_t *)ev;
 	struct list_item *item;
-	struct client *client;
+	struct binding *b, *exact = NULL;
+	bool prefix = false;
+	uint32_t i;
 
-	for (item = win_list; item != NULL; item = item->next) {
-		client = item->data;
-		if (client->group == group) {
-			xcb_map_window(conn, client->window);
-			set_focused(client);
-		}
-	}
-	group_in_use[group] = true;
-	last_group = group;
-	update_group_list();
-}
+	chord[chord_len].keysym = xcb_key_symbols_get_keysym(keysyms, e->detail, 0);
+	chord[chord_len].modifiers = e->state & KEY_MODIFIERS & ~(num_lock | caps_lock | scroll_lock);
 
-static void
-group_deactivate(uint32_t group)
-{
-	if (group >= conf.groups)
+	/* modifiers pressed for the next key of the chain */
+	if ((chord[chord_len].keysym >= XK_Shift_L && chord[chord_len].keysym <= XK_Hyper_R)
+			|| chord[chord_len].keysym == XK_ISO_Level3_Shift
+			|| chord[chord_len].keysym == XK_Mode_switch)
 		return;
 
-	struct list_item *item;
-	struct client *client;
+	for (item = bindings; item != NULL; item = item->next) {
+		b = item->data;
+		if (b->nr_keys <= chord_len)
+			continue;
+		for (i = 0; i <= chord_len; i++)
+			if (b->chain[i].modifiers != chord[i].modifiers
+					|| b->chain[i].keysym != chord[i].keysym)
+				break;
+		if (i <= chord_len)
+			continue;
 
-	for (item = win_list; item != NULL; item = item->next) {
-		client = item->data;
-		if (client->group == group)
-			xcb_unmap_window(conn, client->window);
+		if (b->nr_keys == chord_len + 1)
+			exact = b;
+		else
+			prefix = true;
+	}
+
+	if (exact != NULL) {
+		if (exact->lock > 0) {
+			chord_len = exact->lock;
+			chord_locked = true;
+			chord_begin();
+		} else {
+			chord_end();
+		}
+		run_binding(exact);
+	} else if (prefix) {
+		chord_len++;
+		chord_begin();
+	} else {
+		/* Escape or any other key leaves the chain */
+		chord_end();
 	}
-	group_in_use[group] = false;
-	update_group_list();
 }
 
+/*
+ * The keyboard mapping changed. Keycodes and lock modifiers may have moved,
+ * so the grabs are done again.
+ */
+
 static void
-group_toggle(uint32_t group)
+event_mapping_notify(xcb_generic_event_t *ev)
 {
-	if (group >= conf.groups)
+	xcb_mapping_notify_event_t *e = (xcb_mapping_notify_event_t *)ev;
+
+	if (e->request == XCB_MAPPING_POINTER)
 		return;
 
-	if (group_in_use[group])
-		group_deactivate(group);
-	else
-		group_activate(group);
-	last_group = group;
-	update_group_list();
+	xcb_refresh_keyboard_mapping(keysyms, e);
+	pointer_init();
+	ungrab_buttons();
+	grab_buttons();
+	chord_end();
+	grab_keys();
 }
 
+/*
+ * Populates array with functions for handling IPC commands.
+ */
+
 static void
-group_activate_specific(uint32_t group)
+register_ipc_handlers(void)
 {
-	if (group >= conf.groups)
-		return;
-
-	for (unsigned int i = 0; i < conf.groups; i++) {
-		if (i == group)
-			group_activate(i);
-		else
-			group_deactivate(i);
-	}
-	update_group_list();
+	ipc_handlers[IPCWindowMove]            = ipc_window_move;
+	ipc_handlers[IPCWindowMoveAbsolute]    = ipc_window_move_absolute;
+	ipc_handlers[IPCWindowResize]          = ipc_window_resize;
+	ipc_handlers[IPCWindowResizeAbsolute]  = ipc_window_resize_absolute;
+	ipc_handlers[IPCWindowMaximize]        = ipc_window_maximize;
+	ipc_handlers[IPCWindowUnmaximize]      = ipc_window_unmaximize;
+	ipc_handlers[IPCWindowHorMaximize]     = ipc_window_hor_maximize;
+	ipc_handlers[IPCWindowVerMaximize]     = ipc_window_ver_maximize;
+	ipc_handlers[IPCWindowMonocle]         = ipc_window_monocle;
+	ipc_handlers[IPCWindowClose]           = ipc_window_close;
+	ipc_handlers[IPCWindowPutInGrid]       = ipc_window_put_in_grid;
+	ipc_handlers[IPCWindowMoveInGrid]      = ipc_window_move_in_grid;
+	ipc_handlers[IPCWindowResizeInGrid]    = ipc_window_resize_in_grid;
+	ipc_handlers[IPCWindowSnap]            = ipc_window_snap;
+	ipc_handlers[IPCWindowCycle]           = ipc_window_cycle;
+	ipc_handlers[IPCWindowRevCycle]        = ipc_window_rev_cycle;
+	ipc_handlers[IPCWindowCycleInGroup]    = ipc_window_cycle_in_group;
+	ipc_handlers[IPCWindowRevCycleInGroup] = ipc_window_rev_cycle_in_group;
+	ipc_handlers[IPCWindowCardinalFocus]   = ipc_window_cardinal_focus;
+	ipc_handlers[IPCWindowFocus]           = ipc_window_focus;
+	ipc_handlers[IPCWindowFocusLast]       = ipc_window_focus_last;
+	ipc_handlers[IPCGroupAddWindow]        = ipc_group_add_window;
+	ipc_handlers[IPCGroupRemoveWindow]     = ipc_group_remove_window;
+	ipc_handlers[IPCGroupRemoveAllWindows] = ipc_group_remove_all_windows;
+	ipc_handlers[IPCGroupActivate]         = ipc_group_activate;
+	ipc_handlers[IPCGroupDeactivate]       = ipc_group_deactivate;
+	ipc_handlers[IPCGroupToggle]           = ipc_group_toggle;
+	ipc_handlers[IPCGroupActivateSpecific] = ipc_group_activate_specific;
+	ipc_handlers[IPCWMQuit]                = ipc_wm_quit;
+	ipc_handlers[IPCWMConfig]              = ipc_wm_config;
+	ipc_handlers[IPCWMStats]               = ipc_wm_stats;
+	ipc_handlers[IPCSubscribe]             = ipc_subscribe;
+	ipc_handlers[IPCQueryFocused]          = ipc_query_focused;
+	ipc_handlers[IPCQueryClients]          = ipc_query_clients;
+	ipc_handlers[IPCQueryMonitors]         = ipc_query_monitors;
+	ipc_handlers[IPCQueryGroups]           = ipc_query_groups;
+	ipc_handlers[IPCQueryFocusHistory]     = ipc_query_focus_history;
+	ipc_handlers[IPCTransactionBegin]      = ipc_transaction_begin;
+	ipc_handlers[IPCTransactionCommit]     = ipc_transaction_commit;
+	ipc_handlers[IPCTransactionAbort]      = ipc_transaction_abort;
+	ipc_handlers[IPCWindowLayout]          = ipc_window_layout;
+	ipc_handlers[IPCBind]                  = ipc_bind;
+	ipc_handlers[IPCUnbind]                = ipc_unbind;
+	ipc_handlers[IPCSpawn]                 = ipc_spawn;
+	ipc_handlers[IPCRule]                  = ipc_rule;
+	ipc_handlers[IPCUnrule]                = ipc_unrule;
 }
 
-static void update_group_list(void)
+static void
+ipc_window_move(uint32_t *d)
 {
-	struct list_item *item;
-	struct client *client;
-	bool first = true;
-	uint32_t data[1];
+	int16_t x, y;
 
-	for (unsigned int i = 0; i < conf.groups; i++) {
-		/* deactivate group if no window in group */
-		item = win_list;
-		while (item != NULL && (client = item->data)->group != i)
-			item = item->next;
-		if (item == NULL)
-			group_in_use[i] = false;
+	if (ipc_target == NULL)
+		return;
 
-		if (group_in_use[i]) {
-			uint8_t mode = XCB_PROP_MODE_APPEND;
-			data[0] = i + 1;
-			if (first) {
-				mode = XCB_PROP_MODE_REPLACE;
-				first = false;
-			}
-			xcb_change_property(conn, mode, scr->root, ATOMS[WINDOWCHEF_ACTIVE_GROUPS], XCB_ATOM_INTEGER, 32, 1, data);
-		}
+	if (is_special(ipc_target)) {
+		reset_window(ipc_target);
+		refocus(ipc_target);
 	}
 
-	if (first) {
-		data[0] = 0;
-		xcb_change_property(conn, XCB_PROP_MODE_REPLACE, scr->root, ATOMS[WINDOWCHEF_ACTIVE_GROUPS], XCB_ATOM_INTEGER, 32, 1, data);
-	}
+	x = d[2];
+	y = d[3];
+	if (d[0])
+		x = -x;
+	if (d[1])
+		y = -y;
+
+	move_window(ipc_target, x, y);
+	if (ipc_target == focused_win)
+		center_pointer(ipc_target);
 }
 
 static void
-change_nr_of_groups(uint32_t groups)
+ipc_window_move_absolute(uint32_t *d)
 {
-	bool *copy = malloc(groups * sizeof(bool));
-	uint32_t until = groups < conf.groups ? groups : conf.groups;
-	struct list_item *item;
-	struct client *client;
+	int16_t x, y;
 
-	for (uint32_t i = 0; i < until; i++)
-		copy[i] = group_in_use[i];
+	if (ipc_target == NULL)
+		return;
 
-	if (groups < conf.groups)
-		for (item = win_list; item != NULL; item = item->next) {
-			client = item->data;
-			if (client->group != NULL_GROUP && client->group >= groups) {
-				group_activate(client->group);
-				client->group = NULL_GROUP;
-				update_wm_desktop(client);
-			}
-		}
+	if (is_special(ipc_target)) {
+		reset_window(ipc_target);
+		refocus(ipc_target);
+	}
 
-	conf.groups = groups;
-	free(group_in_use);
-	group_in_use = copy;
+	x = d[2];
+	y = d[3];
+
+	if (d[0] == IPC_MUL_MINUS)
+		x = -x;
+	if (d[1] == IPC_MUL_MINUS)
+		y = -y;
+
+	ipc_target->geom.x = x;
+	ipc_target->geom.y = y;
+
+	teleport_window(ipc_target->window, x, y);
+	if (ipc_target == focused_win)
+		center_pointer(ipc_target);
 }
 
 static void
-refresh_borders(void)
+ipc_window_resize(uint32_t *d)
 {
-	if (!conf.apply_settings)
+	int16_t w, h;
+
+	if (ipc_target == NULL)
 		return;
 
-	struct list_item *item;
-	struct client *client;
+	if (is_special(ipc_target)) {
+		reset_window(ipc_target);
+		refocus(ipc_target);
+	}
 
-	for (item = win_list; item != NULL; item = item->next) {
-		client = item->data;
-		if (client->maxed)
-			continue;
+	w = d[2];
+	h = d[3];
 
-		if (client == focused_win)
-			set_borders(client, conf.focus_color, conf.internal_focus_color);
-		else
-			set_borders(client, conf.unfocus_color, conf.internal_unfocus_color);
-	}
+	if (d[0] == IPC_MUL_MINUS)
+		w = -w;
+	if (d[1] == IPC_MUL_MINUS)
+		h = -h;
+
+	resize_window(ipc_target->window, w, h);
+	if (ipc_target == focused_win)
+		center_pointer(ipc_target);
 }
 
 static void
-update_ewmh_wm_state(struct client *client)
+ipc_window_resize_absolute(uint32_t *d)
 {
-	int i;
-	uint32_t values[12];
+	int16_t w, h;
 
-	if (client == NULL)
+	if (ipc_target == NULL)
 		return;
-#define HANDLE_WM_STATE(s) \
-	values[i] = ewmh->_NET_WM_STATE_##s; \
-	i++; \
-	DMSG("ewmh net_wm_state %s present\n", #s);
 
-	i = 0;
-	if (client->maxed) {
-		HANDLE_WM_STATE(FULLSCREEN);
-	}
-	if (client->vmaxed) {
-		HANDLE_WM_STATE(MAXIMIZED_VERT);
-	}
-	if (client->hmaxed) {
-		HANDLE_WM_STATE(MAXIMIZED_HORZ);
+	if (is_special(ipc_target)) {
+		reset_window(ipc_target);
+		refocus(ipc_target);
 	}
 
-	xcb_ewmh_set_wm_state(ewmh, client->window, i, values);
-}
+	w = d[0];
+	h = d[1];
 
-/*
- * Maximize / unmaximize windows based on ewmh requests.
- */
+	if (ipc_target->min_width != 0 && w < ipc_target->min_width)
+		w = ipc_target->min_width;
+
+	if (ipc_target->min_height != 0 && h < ipc_target->min_height)
+		h = ipc_target->min_height;
+
+	ipc_target->geom.width = w;
+	ipc_target->geom.height = h;
+
+	resize_window_absolute(ipc_target->window, w, h);
+	if (ipc_target == focused_win)
+		center_pointer(ipc_target);
+}
 
 static void
-handle_wm_state(struct client *client, xcb_atom_t state, unsigned int action)
+ipc_window_maximize(uint32_t *d)
 {
+	(void)(d);
 	int16_t mon_x, mon_y;
 	uint16_t mon_w, mon_h;
 
-	get_monitor_size(client, &mon_x, &mon_y, &mon_w, &mon_h);
+	if (ipc_target == NULL)
+		return;
 
-	if (state == ewmh->_NET_WM_STATE_FULLSCREEN) {
-		if (action == XCB_EWMH_WM_STATE_ADD) {
-			maximize_window(client, mon_x, mon_y, mon_w, mon_h);
-		} else if (action == XCB_EWMH_WM_STATE_REMOVE && client->maxed) {
-			reset_window(client);
-			set_focused(client);
-		} else if (action == XCB_EWMH_WM_STATE_TOGGLE) {
-			if (client->maxed) {
-				reset_window(client);
-				set_focused(client);
-			} else {
-				maximize_window(client, mon_x, mon_y, mon_w, mon_h);
-			}
-		}
-	} else if (state == ewmh->_NET_WM_STATE_MAXIMIZED_VERT) {
-		if (action == XCB_EWMH_WM_STATE_ADD) {
-			vmaximize_window(client, mon_y, mon_h);
-		} else if (action == XCB_EWMH_WM_STATE_REMOVE) {
-			if (client->vmaxed)
-				reset_window(client);
-		} else if (action == XCB_EWMH_WM_STATE_TOGGLE) {
-			if (client->vmaxed)
-				reset_window(client);
-			else
-				vmaximize_window(client, mon_y, mon_h);
-		}
-	} else if (state == ewmh->_NET_WM_STATE_MAXIMIZED_HORZ) {
-		if (action == XCB_EWMH_WM_STATE_ADD) {
-			hmaximize_window(client, mon_y, mon_h);
-		} else if (action == XCB_EWMH_WM_STATE_REMOVE) {
-			if (client->hmaxed)
-				reset_window(client);
-		} else if (action == XCB_EWMH_WM_STATE_TOGGLE) {
-			if (client->hmaxed)
-				reset_window(client);
-			else
-				hmaximize_window(client, mon_x, mon_w);
-		}
+	if (ipc_target->maxed) {
+		reset_window(ipc_target);
+	} else {
+		get_monitor_size(ipc_target, &mon_x, &mon_y, &mon_w, &mon_h);
+		maximize_window(ipc_target, mon_x, mon_y, mon_w, mon_h);
 	}
-}
 
-/*
- * Snap window in corner.
- */
+	refocus(ipc_target);
+}
 
 static void
-snap_window(struct client *client, enum position pos)
+ipc_window_unmaximize(uint32_t *d)
 {
-	int16_t mon_x, mon_y, win_x, win_y;
-	uint16_t mon_w, mon_h, win_w, win_h;
+	(void)(d);
 
-	if (client == NULL)
+	if (ipc_target == NULL)
 		return;
 
-	if (is_special(client)) {
-		reset_window(client);
-		set_focused(client);
+	if (is_special(ipc_target)) {
+		reset_window(ipc_target);
+		refocus(ipc_target);
 	}
+}
 
-	fit_on_screen(client);
-
-	win_x = client->geom.x;
-	win_y = client->geom.y;
-	win_w = client->geom.width + 2 * conf.border_width;
-	win_h = client->geom.height + 2 * conf.border_width;
-
-	get_monitor_size(client, &mon_x, &mon_y, &mon_w, &mon_h);
-
-	switch (pos) {
-		case TOP_LEFT:
-			win_x = mon_x + conf.gap_left;
-			win_y = mon_y + conf.gap_up;
-			break;
-
-		case TOP_RIGHT:
-			win_x = mon_x + mon_w - conf.gap_right - win_w;
-			win_y = mon_y + conf.gap_up;
-			break;
-
-		case BOTTOM_LEFT:
-			win_x = mon_x + conf.gap_left;
-			win_y = mon_y + mon_h - conf.gap_down - win_h;
-			break;
-
-		case BOTTOM_RIGHT:
-			win_x = mon_x + mon_w - conf.gap_right - win_w;
-			win_y = mon_y + mon_h - conf.gap_down - win_h;
-			break;
+static void
+ipc_window_hor_maximize(uint32_t *d)
+{
+	(void)(d);
+	int16_t mon_x, mon_y;
+	uint16_t mon_w;
 
-		case CENTER:
-			win_x = mon_x + (mon_w - win_w) / 2;
-			win_y = mon_y + (mon_h - win_h) / 2;
-			break;
+	if (ipc_target == NULL)
+		return;
 
-		default:
-			return;
+	if (ipc_target->hmaxed) {
+		reset_window(ipc_target);
+	} else {
+		get_monitor_size(ipc_target, &mon_x, &mon_y, &mon_w, NULL);
+		hmaximize_window(ipc_target, mon_x, mon_w);
 	}
 
-	client->geom.x = win_x;
-	client->geom.y = win_y;
-	teleport_window(client->window, win_x, win_y);
-	center_pointer(client);
-	xcb_flush(conn);
+	refocus(ipc_target);
 }
 
-
-/*
- * Put window in grid.
- */
-
 static void
-grid_window(struct client *client, uint16_t grid_width, uint16_t grid_height, uint16_t grid_x, uint16_t grid_y, uint16_t occ_w, uint16_t occ_h)
+ipc_window_ver_maximize(uint32_t *d)
 {
+	(void)(d);
 	int16_t mon_x, mon_y;
-	uint16_t base_w, base_h;
-	uint16_t new_w, new_h;
-	uint16_t mon_w, mon_h;
+	uint16_t mon_h;
 
-	if (client == NULL || grid_x >= grid_width || grid_y >= grid_height)
+	if (ipc_target == NULL)
 		return;
 
-	DMSG("Gridding window in grid of size (%d, %d) pos (%d, %d) window size (%d, %d)\n", grid_width, grid_height, grid_x, grid_y, occ_w, occ_h);
-	if (is_special(client)) {
-		reset_window(client);
-		set_focused(client);
+	if (ipc_target->vmaxed) {
+		reset_window(ipc_target);
+	} else {
+		get_monitor_size(ipc_target, &mon_x, &mon_y, NULL, &mon_h);
+		vmaximize_window(ipc_target, mon_y, mon_h);
 	}
 
-	get_monitor_size(client, &mon_x, &mon_y, &mon_w, &mon_h);
+	refocus(ipc_target);
+}
 
-	base_w = (mon_w - conf.gap_left - conf.gap_right - (grid_width - 1) * conf.grid_gap
-			- grid_width * 2 * conf.border_width) / grid_width;
-	base_h = (mon_h - conf.gap_up - conf.gap_down - (grid_height - 1) * conf.grid_gap
-			- grid_height * 2 * conf.border_width) / grid_height;
-	/* calculate new window size */
-	new_w = base_w * occ_w + (occ_w - 1) * (conf.grid_gap + 2 * conf.border_width);
+static void
+ipc_window_monocle(uint32_t *d)
+{
+	(void)(d);
+	int16_t mon_x, mon_y;
+	uint16_t mon_w, mon_h;
 
-	new_h = base_h * occ_h + (occ_h - 1) * (conf.grid_gap + 2 * conf.border_width);
+	if (ipc_target == NULL)
+		return;
 
-	client->orig_geom = client->geom;
+	if (ipc_target->monocled) {
+		reset_window(ipc_target);
+	} else {
+		get_monitor_size(ipc_target, &mon_x, &mon_y, &mon_w, &mon_h);
+		monocle_window(ipc_target, mon_x, mon_y, mon_w, mon_h);
+	}
 
-	client->geom.width = new_w;
-	client->geom.height = new_h;
+	refocus(ipc_target);
+}
 
-	client->geom.x = mon_x + conf.gap_left + grid_x
-		* (conf.border_width + base_w + conf.border_width + conf.grid_gap);
-	client->geom.y = mon_y + conf.gap_up + grid_y
-		* (conf.border_width + base_h + conf.border_width + conf.grid_gap);
+static void
+ipc_window_close(uint32_t *d)
+{
+	(void)(d);
+	close_window(ipc_target);
+}
 
-	client->gridded = true;
-	client->grid.gx = grid_width;
-	client->grid.gy = grid_height;
-	client->grid.px = grid_x;
-	client->grid.py = grid_y;
-	client->grid.sx = occ_w;
-	client->grid.sy = occ_h;
+static void
+ipc_window_put_in_grid(uint32_t *d)
+{
+	uint16_t grid_width, grid_height;
+	uint16_t grid_x, grid_y;
+	uint16_t occ_w, occ_h;
+	const uint16_t m1 = 16U, m2 = 0xffffU;
 
-	DMSG("w: %d\th: %d\n", new_w, new_h);
+	DMSG("data[4] = %d\n", d[4]);
+	grid_width  = d[0] >> m1;
+	grid_height = d[0] & m2;
+	grid_x      = d[1] >> m1;
+	grid_y      = d[1] & m2;
+	occ_w       = d[2] >> m1;
+	occ_h       = d[2] & m2;
 
-	teleport_window(client->window, client->geom.x, client->geom.y);
-	resize_window_absolute(client->window, client->geom.width, client->geom.height);
+	if (ipc_target == NULL || grid_x >= grid_width || grid_y >= grid_height)
+		return;
 
-	xcb_flush(conn);
+	grid_window(ipc_target, grid_width, grid_height, grid_x, grid_y, occ_w, occ_h);
 }
 
 static void
-move_grid_window(struct client *client, uint16_t x, uint16_t y)
+ipc_window_move_in_grid(uint32_t *d)
 {
+	uint16_t x, y;
 
-	int16_t new_px, new_py;
+	if (ipc_target == NULL)
+		return;
 
-	new_px = client->grid.px + x;
-	new_py = client->grid.py + y;
+	x = d[2];
+	y = d[3];
 
-	if (!client->gridded
-			|| client->grid.gx < new_px + client->grid.sx
-			|| client->grid.gy < new_py + client->grid.sy
-			|| new_px < 0
-			|| new_py < 0)
-		return;
+	if (d[0] == IPC_MUL_MINUS)
+		x = -x;
+	if (d[1] == IPC_MUL_MINUS)
+		y = -y;
 
-	grid_window(client, client->grid.gx, client->grid.gy, new_px, new_py, client->grid.sx, client->grid.sy);
+	move_grid_window(ipc_target, x, y);
 }
 
 static void
-resize_grid_window(struct client *client, uint16_t x, uint16_t y)
+ipc_window_resize_in_grid(uint32_t *d)
 {
+	uint16_t x, y;
 
-	int16_t new_sx, new_sy;
+	if (ipc_target == NULL)
+		return;
 
-	new_sx = client->grid.sx + x;
-	new_sy = client->grid.sy + y;
+	x = d[2];
+	y = d[3];
 
-	if (!client->gridded
-			|| client->grid.gx < new_sx + client->grid.px
-			|| client->grid.gy < new_sy + client->grid.py
-			|| new_sx < 1
-			|| new_sy < 1)
-		return;
+	if (d[0] == IPC_MUL_MINUS)
+		x = -x;
+	if (d[1] == IPC_MUL_MINUS)
+		y = -y;
 
-	grid_window(client, client->grid.gx, client->grid.gy, client->grid.px, client->grid.py, new_sx, new_sy);
+	resize_grid_window(ipc_target, x, y);
 }
 
-/*
- * Adds X event handlers to the array.
- */
-
 static void
-register_event_handlers(void)
+ipc_window_snap(uint32_t *d)
 {
-	for (int i = 0; i <= LAST_XCB_EVENT; i++)
-		events[i] = NULL;
+	enum position pos = d[0];
+	snap_window(ipc_target, pos);
+}
 
-	events[XCB_CONFIGURE_REQUEST] = event_configure_request;
-	events[XCB_DESTROY_NOTIFY]    = event_destroy_notify;
-	events[XCB_ENTER_NOTIFY]      = event_enter_notify;
-	events[XCB_MAP_REQUEST]       = event_map_request;
-	events[XCB_MAP_NOTIFY]        = event_map_notify;
-	events[XCB_UNMAP_NOTIFY]      = event_unmap_notify;
-	events[XCB_CLIENT_MESSAGE]    = event_client_message;
-	events[XCB_CONFIGURE_NOTIFY]  = event_configure_notify;
-	events[XCB_CIRCULATE_REQUEST] = event_circulate_request;
-	events[XCB_FOCUS_IN]          = event_focus_in;
-	events[XCB_FOCUS_OUT]         = event_focus_out;
-	events[XCB_BUTTON_PRESS]      = event_button_press;
+static
+void ipc_window_cycle(uint32_t *d)
+{
+	(void)(d);
+
+	cycle_window(focused_win);
 }
 
-/*
- * A window wants to be configured.
- */
+static
+void ipc_window_rev_cycle(uint32_t *d)
+{
+	(void)(d);
+
+	rcycle_window(focused_win);
+}
 
 static void
-event_configure_request(xcb_generic_event_t *ev)
+ipc_window_cardinal_focus(uint32_t *d)
 {
-	xcb_configure_request_event_t *e = (xcb_configure_request_event_t *)ev;
-	struct client *client;
-	uint32_t values[7];
-	int i = 0;
-
-	client = find_client(&e->window);
-	if (client != NULL) {
+	uint32_t mode = d[0];
+	cardinal_focus(mode);
+}
 
-		if (e->value_mask & XCB_CONFIG_WINDOW_X
-				&& !client->maxed && !client->monocled && !client->hmaxed)
-			client->geom.x = e->x;
+static void
+ipc_window_cycle_in_group(uint32_t *d)
+{
+	(void)(d);
 
-		if (e->value_mask & XCB_CONFIG_WINDOW_Y
-				&& !client->maxed && !client->monocled && !client->vmaxed)
-			client->geom.y = e->y;
+	if (focused_win == NULL)
+		return;
 
-		if (e->value_mask & XCB_CONFIG_WINDOW_WIDTH
-				&& !client->maxed && !client->monocled && !client->hmaxed)
-			client->geom.width = e->width;
+	cycle_window_in_group(focused_win);
+}
+static void
+ipc_window_rev_cycle_in_group(uint32_t *d)
+{
+	(void)(d);
 
-		if (e->value_mask & XCB_CONFIG_WINDOW_HEIGHT
-				&& !client->maxed && !client->monocled && !client->vmaxed)
-			client->geom.height = e->height;
+	rcycle_window_in_group(focused_win);
+}
 
-		if (e->value_mask & XCB_CONFIG_WINDOW_STACK_MODE) {
-			values[0] = e->stack_mode;
-			xcb_configure_window(conn, e->window,
-					XCB_CONFIG_WINDOW_STACK_MODE, values);
-		}
+static void
+ipc_window_focus(uint32_t *d)
+{
+	struct client *client = find_client(&d[0]);
 
-		if (e->value_mask & XCB_CONFIG_WINDOW_BORDER_WIDTH) {
-			values[0] = e->border_width;
-			xcb_configure_window(conn, e->window,
-					XCB_CONFIG_WINDOW_BORDER_WIDTH, values);
-		}
+	if (client != NULL)
+		set_focused(client);
+}
 
-		if (!client->maxed) {
-			fit_on_screen(client);
-		}
+static void
+ipc_window_focus_last(uint32_t *d)
+{
+	(void)(d);
+	if (focused_win != NULL)
+		set_focused_last_best();
+}
 
-		teleport_window(client->window, client->geom.x, client->geom.y);
-		resize_window_absolute(client->window, client->geom.width, client->geom.height);
-	} else {
-		if (e->value_mask & XCB_CONFIG_WINDOW_X) {
-			values[i] = e->x;
-			i++;
-		}
+static void
+ipc_group_add_window(uint32_t *d)
+{
+	if (ipc_target != NULL)
+		group_add_window(ipc_target, d[0] - 1);
+}
 
-		if (e->value_mask & XCB_CONFIG_WINDOW_Y) {
-			values[i] = e->y;
-			i++;
-		}
+static void
+ipc_group_remove_window(uint32_t *d)
+{
+	(void)(d);
+	if (ipc_target != NULL)
+		group_remove_window(ipc_target);
+}
 
-		if (e->value_mask & XCB_CONFIG_WINDOW_WIDTH) {
-			values[i] = e->width;
-			i++;
-		}
+static void
+ipc_group_remove_all_windows(uint32_t *d)
+{
+	group_remove_all_windows(d[0] - 1);
+}
 
-		if (e->value_mask & XCB_CONFIG_WINDOW_HEIGHT) {
-			values[i] = e->height;
-			i++;
-		}
+static void
+ipc_group_activate(uint32_t *d)
+{
+	group_activate(d[0] - 1);
+}
 
-		if (e->value_mask & XCB_CONFIG_WINDOW_SIBLING) {
-			values[i] = e->sibling;
-			i++;
-		}
+static void
+ipc_group_deactivate(uint32_t *d)
+{
+	group_deactivate(d[0] - 1);
+}
 
-		if (e->value_mask & XCB_CONFIG_WINDOW_STACK_MODE) {
-			values[i] = e->stack_mode;
-			i++;
-		}
+static void
+ipc_group_toggle(uint32_t *d)
+{
+	group_toggle(d[0] - 1);
+}
 
-		if (e->value_mask & XCB_CONFIG_WINDOW_BORDER_WIDTH) {
-			values[i] = e->border_width;
-			i++;
-		}
+static void
+ipc_group_activate_specific(uint32_t *d)
+{
+	group_activate_specific(d[0] - 1);
+}
 
-		if (i == 0)
-			return;
-		xcb_configure_window(conn, e->window, e->value_mask, values);
-	}
+static void
+ipc_wm_quit(uint32_t *d)
+{
+	uint32_t code = d[0];
+	halt = true;
+	exit_code = code;
 }
 
 /*
- * Window has been destroyed.
+ * Publish counters of the work saved by windowchef on the root window.
+ * Socket clients get them in the reply too.
  */
 
 static void
-event_destroy_notify(xcb_generic_event_t *ev)
+ipc_wm_stats(uint32_t *d)
 {
-	struct client *client;
-	xcb_destroy_notify_event_t *e = (xcb_destroy_notify_event_t *)ev;
-
-	client = find_client(&e->window);
-	if (conf.last_window_focusing && focused_win != NULL && focused_win == client) {
-	    focused_win = NULL;
-		set_focused_last_best();
-	}
-
-	if (client != NULL) {
-		free_window(client);
-	}
+	uint32_t data[3] = { requests_elided, motion_coalesced, events_ignored };
+	(void)(d);
 
+	xcb_change_property(conn, XCB_PROP_MODE_REPLACE, scr->root,
+			ATOMS[WINDOWCHEF_STATS], XCB_ATOM_CARDINAL, 32, 3, data);
 
-	update_client_list();
-	update_group_list();
+	buffer_printf(&ipc_reply, "%u %u %u\n", data[0], data[1], data[2]);
 }
 
-/*
- * The mouse pointer has entered the window.
- */
-
 static void
-event_enter_notify(xcb_generic_event_t *ev)
+ipc_subscribe(uint32_t *d)
 {
-	xcb_enter_notify_event_t *e = (xcb_enter_notify_event_t *)ev;
-	struct client *client;
-
-	if (conf.sloppy_focus == false)
-		return;
-
-	if (focused_win != NULL && e->event == focused_win->window)
+	/* only a socket connection can carry the events */
+	if (ipc_current == NULL) {
+		ipc_status = IPCStatusFailed;
 		return;
+	}
 
-	client = find_client(&e->event);
-
-	if (client != NULL)
-		set_focused_no_raise(client);
+	ipc_current->events = d[0];
+	ipc_current->dropped = 0;
 }
 
 /*
- * A window wants to show up on the screen.
+ * Set the geometry of many windows at once. The sizes are checked against
+ * the size hints, and every window gets a single configure request and
+ * border repaint at the end of the batch.
  */
 
 static void
-event_map_request(xcb_generic_event_t *ev)
+ipc_window_layout(uint32_t *d)
 {
-	xcb_map_request_event_t *e = (xcb_map_request_event_t *)ev;
 	struct client *client;
-	long data[] = {
-		XCB_ICCCM_WM_STATE_NORMAL,
-		XCB_NONE,
-	};
-
-	/* create window if new */
-	client = find_client(&e->window);
-	if (client == NULL) {
-		client = setup_window(e->window);
-
-		/* client is a dock or some kind of window that needs to be ignored */
-		if (client == NULL)
-			return;
-
-		if (!client->geom.set_by_user) {
-			if (!get_pointer_location(&scr->root, &client->geom.x, &client->geom.y))
-				client->geom.x = client->geom.y = 0;
-
-			client->geom.x -= client->geom.width / 2;
-			client->geom.y -= client->geom.height / 2;
-			teleport_window(client->window, client->geom.x, client->geom.y);
-		}
-		if (conf.sticky_windows)
-			group_add_window(client, last_group);
-	}
+	uint32_t i, *r;
+	int32_t x, y, w, h;
 
-	xcb_map_window(conn, e->window);
-
-	/* in case of fire, abort */
-	if (client == NULL)
+	if (d[0] > IPC_MAX_LAYOUT_RECORDS) {
+		ipc_status = IPCStatusBadArguments;
 		return;
-
-	if (randr_base != -1) {
-		client->monitor = find_monitor_by_coord(client->geom.x, client->geom.y);
-		if (client->monitor == NULL && mon_list != NULL)
-			client->monitor = mon_list->data;
 	}
 
-	fit_on_screen(client);
-
-	/* window is normal */
-	xcb_change_property(conn, XCB_PROP_MODE_REPLACE, client->window,
-			ewmh->_NET_WM_STATE, ewmh->_NET_WM_STATE, 32, 2, data);
+	for (i = 0; i < d[0]; i++) {
+		r = d + 1 + i * IPC_LAYOUT_RECORD;
+		client = find_client(&r[0]);
+		if (client == NULL) {
+			ipc_status = IPCStatusNoWindow;
+			continue;
+		}
 
-	center_pointer(client);
-	update_client_list();
+		x = r[1];
+		y = r[2];
+		w = r[3];
+		h = r[4];
+		if (client->min_width != 0 && w < client->min_width)
+			w = client->min_width;
+		if (client->min_height != 0 && h < client->min_height)
+			h = client->min_height;
+		if (client->max_width != 0 && w > client->max_width)
+			w = client->max_width;
+		if (client->max_height != 0 && h > client->max_height)
+			h = client->max_height;
+		if (conf.resize_hints && !(r[5] & IPCLayoutIgnoreHints)) {
+			if (client->width_inc > 1)
+				w -= w % client->width_inc;
+			if (client->height_inc > 1)
+				h -= h % client->height_inc;
+		}
+		/* the geometry has to fit in the 16 bits X uses for it */
+		if (w < 1 || h < 1 || w > UINT16_MAX || h > UINT16_MAX
+				|| x < INT16_MIN || x > INT16_MAX
+				|| y < INT16_MIN || y > INT16_MAX) {
+			ipc_status = IPCStatusBadArguments;
+			continue;
+		}
 
-	if (!client->maxed)
-		set_borders(client, conf.focus_color, conf.internal_focus_color);
-	update_current_desktop(client);
-}
+		/* a layout replaces whatever state the window was in */
+		if (is_special(client))
+			reset_window(client);
 
-static void
-event_map_notify(xcb_generic_event_t *ev)
-{
-	xcb_map_notify_event_t *e = (xcb_map_notify_event_t *)ev;
-	struct client *client = find_client(&e->window);
+		client->geom.x = x;
+		client->geom.y = y;
+		client->geom.width = w;
+		client->geom.height = h;
+		teleport_window(client->window, client->geom.x, client->geom.y);
+		resize_window_absolute(client->window, client->geom.width, client->geom.height);
 
-	if (client != NULL) {
-		client->mapped = true;
-		set_focused(client);
-		update_window_status(client);
+		if (r[5] & IPCLayoutRaise)
+			raise_window(client->window);
 	}
 }
 
 /*
- * Window has been unmapped (became invisible).
+ * Bind a chain of keys to a command. A binding on the same chain is
+ * replaced.
  */
 
 static void
-event_unmap_notify(xcb_generic_event_t *ev)
+ipc_bind(uint32_t *d)
 {
-	xcb_map_request_event_t *e = (xcb_map_request_event_t *)ev;
-	struct client *client = NULL;
+	struct binding *b;
+	struct list_item *item;
+	uint32_t words = d[IPC_BIND_HEADER];
+	uint32_t *command = d + IPC_BIND_HEADER + 1;
 
-	client = find_client(&e->window);
-	if (client == NULL)
+	if (!valid_chain(d) || words == 0 || words > IPC_MAX_ARGS - IPC_BIND_HEADER - 1
+			|| command[0] >= NR_IPC_COMMANDS
+			|| command[0] == IPCBind || command[0] == IPCUnbind) {
+		ipc_status = IPCStatusBadArguments;
 		return;
+	}
 
-	client->mapped = false;
+	remove_bindings(d);
 
-	if (conf.last_window_focusing && focused_win != NULL && client->window == focused_win->window) {
-		focused_win = NULL;
-		set_focused_last_best();
+	b = malloc(sizeof(struct binding));
+	if (b != NULL)
+		b->args = calloc(words, sizeof(uint32_t));
+	item = b != NULL && b->args != NULL ? list_add_item(&bindings) : NULL;
+	if (item == NULL) {
+		if (b != NULL)
+			free(b->args);
+		free(b);
+		ipc_status = IPCStatusFailed;
+		return;
 	}
 
-	update_client_list();
-	update_window_status(client);
+	for (b->nr_keys = 0; b->nr_keys < d[0]; b->nr_keys++) {
+		b->chain[b->nr_keys].modifiers = d[2 + 2 * b->nr_keys];
+		b->chain[b->nr_keys].keysym = d[3 + 2 * b->nr_keys];
+	}
+	b->lock = d[1];
+	b->command = command[0];
+	b->nr_args = words - 1;
+	memcpy(b->args, command + 1, b->nr_args * sizeof(uint32_t));
+	b->item = item;
+	item->data = b;
+
+	grab_key(b->chain[0]);
+	DMSG("bound %u keys to command %u\n", b->nr_keys, b->command);
 }
 
 /*
- * Window has been configured.
+ * Remove the bindings on a chain, or all of them.
  */
 
 static void
-event_configure_notify(xcb_generic_event_t *ev)
+ipc_unbind(uint32_t *d)
 {
-	xcb_configure_notify_event_t *e = (xcb_configure_notify_event_t *)ev;
-	struct client *client;
-	struct list_item *item;
-
-	/* The root window changes its geometry when the
-	 * user adds/removes/tilts screens */
-	if (e->window == scr->root) {
-		if (e->width != scr->width_in_pixels
-				|| e->height != scr->height_in_pixels) {
-			scr->width_in_pixels = e->width;
-			scr->height_in_pixels = e->height;
-
-			if (randr_base != -1) {
-				get_randr();
-				for (item = win_list; item != NULL; item = item->next) {
-					client = item->data;
-					fit_on_screen(client);
-				}
-			}
-		}
-	} else {
-		client = find_client(&e->window);
-		if (client != NULL) {
-			client->monitor = find_monitor_by_coord(client->geom.x, client->geom.y);
-			update_current_desktop(client);
-		}
+	if (d[0] == 0) {
+		while (bindings != NULL)
+			free_binding(bindings->data);
+	} else if (!valid_chain(d)) {
+		ipc_status = IPCStatusBadArguments;
+		return;
+	} else if (!remove_bindings(d)) {
+		ipc_status = IPCStatusFailed;
+		return;
 	}
+
+	chord_end();
+	grab_keys();
 }
 
 /*
- * Window wants to change its position in the stacking order.
+ * Run a shell command, detached from windowchef.
  */
 
 static void
-event_circulate_request(xcb_generic_event_t *ev)
+ipc_spawn(uint32_t *d)
 {
-	xcb_circulate_request_event_t *e = (xcb_circulate_request_event_t *)ev;
+	char *cmd = (char *)(d + 1);
+	pid_t pid;
+
+	if (d[0] == 0 || d[0] > (IPC_MAX_ARGS - 1) * sizeof(uint32_t) - 1) {
+		ipc_status = IPCStatusBadArguments;
+		return;
+	}
+	cmd[d[0]] = '\0';
 
-	xcb_circulate_window(conn, e->window, e->place);
+	pid = fork();
+	if (pid == 0) {
+		reset_signals();
+		setsid();
+		execl("/bin/sh", "sh", "-c", cmd, (char *)NULL);
+		/* don't run our atexit handlers in the child */
+		warn("couldn't run %s", cmd);
+		_exit(EXIT_FAILURE);
+	} else if (pid == -1) {
+		warn("couldn't run %s", cmd);
+		ipc_status = IPCStatusFailed;
+	}
 }
 
 /*
- * Received client message. Either ewmh/icccm thing or
- * message from the client.
+ * Add a window rule, applied to windows mapped from now on after the
+ * rules added before it.
  */
 
 static void
-event_client_message(xcb_generic_event_t *ev)
+ipc_rule(uint32_t *d)
 {
-	xcb_client_message_event_t *e = (xcb_client_message_event_t *)ev;
-	uint32_t ipc_command;
-	uint32_t *data;
-	struct client *client;
+	struct rule *r, *head, **tail;
+	char *strings[3], *p = (char *)(d + IPC_RULE_HEADER), *end;
+	size_t left = d[IPCRuleWordStrings] * sizeof(uint32_t);
+	uint32_t *g = d + IPCRuleWordGrid;
+	uint32_t hash = 0;
+	int i;
 
-	if (e->type == ATOMS[_IPC_ATOM_COMMAND] && e->format == 32) {
-		/* Message from the client */
-		data = e->data.data32;
-		ipc_command = data[0];
-		if (ipc_handlers[ipc_command] != NULL)
-			(ipc_handlers[ipc_command])(data + 1);
-		DMSG("IPC Command %u with arguments %u %u %u\n", ipc_command, data[1], data[2], data[3]);
-	} else {
-		client = find_client(&e->window);
-		if (client == NULL)
+	if (d[IPCRuleWordStrings] > IPC_MAX_ARGS - IPC_RULE_HEADER
+			|| d[IPCRuleWordActions] == 0
+			|| ((d[IPCRuleWordMatch] & IPCRuleType) && d[IPCRuleWordType] >= NR_IPC_WINDOW_TYPES)
+			|| ((d[IPCRuleWordActions] & IPCRuleGroup) && d[IPCRuleWordGroup] == 0)
+			|| ((d[IPCRuleWordActions] & IPCRuleGrid) && (g[2] >= g[0] || g[3] >= g[1]))
+			|| ((d[IPCRuleWordActions] & IPCRuleState) && (d[IPCRuleWordState] == IPCStateNormal
+					|| d[IPCRuleWordState] >= IPCStateGridded))) {
+		ipc_status = IPCStatusBadArguments;
+		return;
+	}
+
+	for (i = 0; i < 3; i++) {
+		end = memchr(p, '\0', left);
+		if (end == NULL) {
+			ipc_status = IPCStatusBadArguments;
 			return;
-		if (e->type == ewmh->_NET_WM_STATE) {
-			DMSG("got _NET_WM_STATE for 0x%08x\n", client->window);
-			handle_wm_state(client, e->data.data32[1], e->data.data32[0]);
-			handle_wm_state(client, e->data.data32[2], e->data.data32[0]);
-		} else if (e->type == ewmh->_NET_ACTIVE_WINDOW) {
-			DMSG("got _NET_ACTIVE_WINDOW for 0x%08x\n", client->window);
-			set_focused(client);
 		}
+		strings[i] = p;
+		left -= end - p + 1;
+		p = end + 1;
 	}
-}
-
-static void
-event_focus_in(xcb_generic_event_t *ev)
-{
-	xcb_focus_in_event_t *e = (xcb_focus_in_event_t *)ev;
-	xcb_window_t win = e->event;
-	struct client *client = find_client(&win);
-
-	if (client != NULL)
-		update_current_desktop(client);
-}
-
-static void
-event_focus_out(xcb_generic_event_t *ev)
-{
-	(void)(ev);
-	xcb_get_input_focus_reply_t *focus = xcb_get_input_focus_reply(conn,
-			xcb_get_input_focus(conn), NULL);
-	struct client *client = NULL;
 
-	if (focused_win != NULL && focus->focus == focused_win->window)
+	r = calloc(1, sizeof(struct rule));
+	if (r == NULL) {
+		ipc_status = IPCStatusFailed;
+		return;
+	}
+	r->match = d[IPCRuleWordMatch];
+	if (r->match & IPCRuleClass)
+		r->class_name = strdup(strings[0]);
+	if (r->match & IPCRuleInstance)
+		r->instance_name = strdup(strings[1]);
+	if (r->match & IPCRuleRole)
+		r->role = strdup(strings[2]);
+	r->type = d[IPCRuleWordType];
+	r->transient = d[IPCRuleWordTransient];
+	r->actions = d[IPCRuleWordActions];
+	r->group = d[IPCRuleWordGroup];
+	r->x = (int32_t)d[IPCRuleWordGeometry];
+	r->y = (int32_t)d[IPCRuleWordGeometry + 1];
+	r->width = d[IPCRuleWordGeometry + 2];
+	r->height = d[IPCRuleWordGeometry + 3];
+	memcpy(r->grid, g, sizeof(r->grid));
+	r->state = d[IPCRuleWordState];
+	r->focus = d[IPCRuleWordFocus];
+	r->order = nr_rules;
+
+	if (((r->match & IPCRuleClass) && r->class_name == NULL)
+			|| ((r->match & IPCRuleInstance) && r->instance_name == NULL)
+			|| ((r->match & IPCRuleRole) && r->role == NULL)) {
+		free_rule(r);
+		ipc_status = IPCStatusFailed;
 		return;
-
-	if (focus->focus == scr->root) {
-		focused_win = NULL;
-	} else {
-		client = find_client(&focus->focus);
-		if (client != NULL)
-			set_focused_no_raise(client);
 	}
-}
-
-static void
-event_button_press(xcb_generic_event_t *ev)
-{
-	xcb_button_press_event_t *e = (xcb_button_press_event_t *)ev;
-	bool replay = false;
-
-	for (int i = 0; i < NR_BUTTONS; i++) {
-		if (e->detail != mouse_buttons[i])
-			continue;
-		if ((conf.click_to_focus == (int8_t) XCB_BUTTON_INDEX_ANY ||
-			 conf.click_to_focus == (int8_t) mouse_buttons[i]) &&
-			(e->state & ~(num_lock | scroll_lock | caps_lock)) == XCB_NONE) {
 
-			replay = !pointer_grab(POINTER_ACTION_FOCUS);
-		} else {
-			pointer_grab(conf.pointer_actions[i]);
+	/* append to the chain of the class */
+	if (r->match & IPCRuleClass) {
+		hash = hash_string(r->class_name);
+		head = htable_get(&rule_table, hash);
+		if (head == NULL && !htable_put(&rule_table, hash, r)) {
+			free_rule(r);
+			ipc_status = IPCStatusFailed;
+			return;
 		}
+		tail = head != NULL ? &head->next : NULL;
+	} else {
+		tail = &generic_rules;
 	}
-	xcb_allow_events(conn, replay ? XCB_ALLOW_REPLAY_POINTER : XCB_ALLOW_SYNC_POINTER, e->time);
-	xcb_flush(conn);
+	for (; tail != NULL && *tail != NULL; tail = &(*tail)->next)
+		;
+	if (tail != NULL)
+		*tail = r;
+
+	nr_rules++;
+	DMSG("rule %u added\n", r->order);
 }
 
 /*
- * Populates array with functions for handling IPC commands.
+ * Remove every window rule.
  */
 
 static void
-register_ipc_handlers(void)
+ipc_unrule(uint32_t *d)
 {
-	ipc_handlers[IPCWindowMove]            = ipc_window_move;
-	ipc_handlers[IPCWindowMoveAbsolute]    = ipc_window_move_absolute;
-	ipc_handlers[IPCWindowResize]          = ipc_window_resize;
-	ipc_handlers[IPCWindowResizeAbsolute]  = ipc_window_resize_absolute;
-	ipc_handlers[IPCWindowMaximize]        = ipc_window_maximize;
-	ipc_handlers[IPCWindowUnmaximize]      = ipc_window_unmaximize;
-	ipc_handlers[IPCWindowHorMaximize]     = ipc_window_hor_maximize;
-	ipc_handlers[IPCWindowVerMaximize]     = ipc_window_ver_maximize;
-	ipc_handlers[IPCWindowMonocle]         = ipc_window_monocle;
-	ipc_handlers[IPCWindowClose]           = ipc_window_close;
-	ipc_handlers[IPCWindowPutInGrid]       = ipc_window_put_in_grid;
-	ipc_handlers[IPCWindowMoveInGrid]      = ipc_window_move_in_grid;
-	ipc_handlers[IPCWindowResizeInGrid]    = ipc_window_resize_in_grid;
-	ipc_handlers[IPCWindowSnap]            = ipc_window_snap;
-	ipc_handlers[IPCWindowCycle]           = ipc_window_cycle;
-	ipc_handlers[IPCWindowRevCycle]        = ipc_window_rev_cycle;
-	ipc_handlers[IPCWindowCycleInGroup]    = ipc_window_cycle_in_group;
-	ipc_handlers[IPCWindowRevCycleInGroup] = ipc_window_rev_cycle_in_group;
-	ipc_handlers[IPCWindowCardinalFocus]   = ipc_window_cardinal_focus;
-	ipc_handlers[IPCWindowFocus]           = ipc_window_focus;
-	ipc_handlers[IPCWindowFocusLast]       = ipc_window_focus_last;
-	ipc_handlers[IPCGroupAddWindow]        = ipc_group_add_window;
-	ipc_handlers[IPCGroupRemoveWindow]     = ipc_group_remove_window;
-	ipc_handlers[IPCGroupRemoveAllWindows] = ipc_group_remove_all_windows;
-	ipc_handlers[IPCGroupActivate]         = ipc_group_activate;
-	ipc_handlers[IPCGroupDeactivate]       = ipc_group_deactivate;
-	ipc_handlers[IPCGroupToggle]           = ipc_group_toggle;
-	ipc_handlers[IPCGroupActivateSpecific] = ipc_group_activate_specific;
-	ipc_handlers[IPCWMQuit]                = ipc_wm_quit;
-	ipc_handlers[IPCWMConfig]              = ipc_wm_config;
+	(void)(d);
+
+	free_rules();
 }
 
+/*
+ * Hold back the next requests of the connection until transaction_commit.
+ * With a true argument, the server is grabbed while they are applied.
+ */
+
 static void
-ipc_window_move(uint32_t *d)
+ipc_transaction_begin(uint32_t *d)
 {
-	int16_t x, y;
+	struct ipc_transaction *t;
 
-	if (focused_win == NULL)
+	if (ipc_current == NULL || ipc_current->transaction.active) {
+		ipc_status = IPCStatusFailed;
 		return;
-
-	if (is_special(focused_win)) {
-		reset_window(focused_win);
-		set_focused(focused_win);
 	}
 
-	x = d[2];
-	y = d[3];
-	if (d[0])
-		x = -x;
-	if (d[1])
-		y = -y;
-
-	focused_win->geom.x += x;
-	focused_win->geom.y += y;
-
-	move_window(focused_win->window, x, y);
-	center_pointer(focused_win);
+	t = &ipc_current->transaction;
+	t->active = true;
+	t->grab = d[0];
+	t->timer = loop_add_timer(&loop, IPC_TRANSACTION_TIMEOUT,
+			transaction_expire, ipc_current);
 }
 
+/*
+ * Run the requests of the transaction in one go. They end up in the same
+ * event batch, so their configure requests are merged and nothing is sent
+ * in between. The reply carries the first failed status and the payloads
+ * of all requests.
+ */
+
 static void
-ipc_window_move_absolute(uint32_t *d)
+ipc_transaction_commit(uint32_t *d)
 {
-	int16_t x, y;
+	struct ipc_connection *c = ipc_current;
+	struct ipc_transaction *t;
+	enum IPCStatus status = IPCStatusOk, s;
+	uint32_t head[2], args[IPC_MAX_ARGS];
+	size_t off;
+	(void)(d);
 
-	if (focused_win == NULL)
+	if (c == NULL || !c->transaction.active) {
+		ipc_status = IPCStatusFailed;
 		return;
-
-	if (is_special(focused_win)) {
-		reset_window(focused_win);
-		set_focused(focused_win);
 	}
 
-	x = d[2];
-	y = d[3];
-
-	if (d[0] == IPC_MUL_MINUS)
-		x = -x;
-	if (d[1] == IPC_MUL_MINUS)
-		y = -y;
+	t = &c->transaction;
+	t->active = false;
+	if (t->grab)
+		xcb_grab_server(conn);
+
+	for (off = 0; off < t->requests.len; off += sizeof(head) + head[1] * sizeof(uint32_t)) {
+		memcpy(head, t->requests.data + off, sizeof(head));
+		memset(args, 0, sizeof(args));
+		memcpy(args, t->requests.data + off + sizeof(head), head[1] * sizeof(uint32_t));
+		s = run_ipc_command(head[0], args);
+		if (status == IPCStatusOk)
+			status = s;
+	}
 
-	focused_win->geom.x = x;
-	focused_win->geom.y = y;
+	if (t->grab) {
+		/* queue what the batch would send before letting go */
+		commit_dirty_clients();
+		update_client_list();
+		xcb_ungrab_server(conn);
+	}
 
-	teleport_window(focused_win->window, x, y);
-	center_pointer(focused_win);
+	transaction_discard(c);
+	ipc_status = status;
 }
 
 static void
-ipc_window_resize(uint32_t *d)
+ipc_transaction_abort(uint32_t *d)
 {
-	int16_t w, h;
+	(void)(d);
 
-	if (focused_win == NULL)
+	if (ipc_current == NULL || !ipc_current->transaction.active) {
+		ipc_status = IPCStatusFailed;
 		return;
-
-	if (is_special(focused_win)) {
-		reset_window(focused_win);
-		set_focused(focused_win);
 	}
 
-	w = d[2];
-	h = d[3];
-
-	if (d[0] == IPC_MUL_MINUS)
-		w = -w;
-	if (d[1] == IPC_MUL_MINUS)
-		h = -h;
-
-	resize_window(focused_win->window, w, h);
-	center_pointer(focused_win);
+	transaction_discard(ipc_current);
 }
 
-static void
-ipc_window_resize_absolute(uint32_t *d)
+/*
+ * Keep a request for the commit. Only unknown commands are refused now.
+ */
+
+static enum IPCStatus
+transaction_queue(struct ipc_connection *c, uint32_t command, uint32_t length, uint32_t *args)
 {
-	int16_t w, h;
+	struct buffer *requests = &c->transaction.requests;
+	uint32_t head[2] = { command, length };
+	size_t len = requests->len;
 
-	if (focused_win == NULL)
-		return;
+	if (command >= NR_IPC_COMMANDS || ipc_handlers[command] == NULL)
+		return IPCStatusUnknownCommand;
+	if (len + sizeof(head) + length * sizeof(uint32_t) > IPC_MAX_QUEUED)
+		return IPCStatusFailed;
 
-	if (is_special(focused_win)) {
-		reset_window(focused_win);
-		set_focused(focused_win);
+	if (!buffer_append(requests, head, sizeof(head))
+			|| !buffer_append(requests, args, length * sizeof(uint32_t))) {
+		/* don't leave half a record behind */
+		requests->len = len;
+		return IPCStatusFailed;
 	}
 
-	w = d[0];
-	h = d[1];
-
-	if (focused_win->min_width != 0 && w < focused_win->min_width)
-		w = focused_win->min_width;
+	return IPCStatusOk;
+}
 
-	if (focused_win->min_height != 0 && h < focused_win->min_height)
-		h = focused_win->min_height;
+/*
+ * Forget the transaction of a connection, if any.
+ */
 
-	focused_win->geom.width = w;
-	focused_win->geom.height = h;
+static void
+transaction_discard(struct ipc_connection *c)
+{
+	struct ipc_transaction *t = &c->transaction;
 
-	resize_window_absolute(focused_win->window, w, h);
-	center_pointer(focused_win);
+	if (t->timer != 0)
+		loop_cancel_timer(&loop, t->timer);
+	buffer_free(&t->requests);
+	memset(t, 0, sizeof(*t));
 }
 
 static void
-ipc_window_maximize(uint32_t *d)
+transaction_expire(void *data)
 {
-	(void)(d);
-	int16_t mon_x, mon_y;
-	uint16_t mon_w, mon_h;
+	struct ipc_connection *c = data;
 
-	if (focused_win == NULL)
-		return;
+	DMSG("transaction on ipc connection %d timed out\n", c->fd);
+	c->transaction.timer = 0;
+	transaction_discard(c);
+}
 
-	if (focused_win->maxed) {
-		reset_window(focused_win);
-	} else {
-		get_monitor_size(focused_win, &mon_x, &mon_y, &mon_w, &mon_h);
-		maximize_window(focused_win, mon_x, mon_y, mon_w, mon_h);
-	}
+/*
+ * Append the WINDOWCHEF_STATUS object of a client to the reply, with its
+ * monitor and focus state added.
+ */
+
+static void
+reply_client(struct client *client)
+{
+	char buf[STATUS_MAXLEN];
+	int len;
 
-	set_focused(focused_win);
+	len = format_window_status(client, buf, sizeof(buf));
+	if (len < 1 || len >= STATUS_MAXLEN)
+		return;
 
-	xcb_flush(conn);
+	/* reopen the object */
+	buffer_append(&ipc_reply, buf, len - 1);
+	buffer_printf(&ipc_reply, ",\"monitor\":\"%s\",\"focused\":%s}",
+			client->monitor != NULL ? client->monitor->name : "",
+			client == focused_win ? "true" : "false");
 }
 
+/*
+ * The query commands answer from the state windowchef keeps, as one line
+ * of JSON.
+ */
+
 static void
-ipc_window_unmaximize(uint32_t *d)
+ipc_query_focused(uint32_t *d)
 {
 	(void)(d);
 
 	if (focused_win == NULL)
-		return;
+		buffer_printf(&ipc_reply, "null");
+	else
+		reply_client(focused_win);
+	buffer_printf(&ipc_reply, "\n");
+}
 
-	if (is_special(focused_win)) {
-		reset_window(focused_win);
-		set_focused(focused_win);
-	}
+static void
+ipc_query_clients(uint32_t *d)
+{
+	struct list_item *item;
+	(void)(d);
 
-	xcb_flush(conn);
+	buffer_printf(&ipc_reply, "[");
+	for (item = win_list; item != NULL; item = item->next) {
+		reply_client(item->data);
+		if (item->next != NULL)
+			buffer_printf(&ipc_reply, ",");
+	}
+	buffer_printf(&ipc_reply, "]\n");
 }
 
 static void
-ipc_window_hor_maximize(uint32_t *d)
+ipc_query_monitors(uint32_t *d)
 {
+	struct list_item *item;
+	struct monitor *mon;
 	(void)(d);
-	int16_t mon_x, mon_y;
-	uint16_t mon_w;
-
-	if (focused_win == NULL)
-		return;
 
-	if (focused_win->hmaxed) {
-		reset_window(focused_win);
-	} else {
-		get_monitor_size(focused_win, &mon_x, &mon_y, &mon_w, NULL);
-		hmaximize_window(focused_win, mon_x, mon_w);
+	buffer_printf(&ipc_reply, "[");
+	for (item = mon_list; item != NULL; item = item->next) {
+		mon = item->data;
+		buffer_printf(&ipc_reply,
+		"{"
+			"\"output\":\"0x%08x\","
+			"\"name\":\"%s\","
+			"\"x\":%d,"
+			"\"y\":%d,"
+			"\"width\":%u,"
+			"\"height\":%u,"
+			"\"refresh_rate\":%u"
+		"}%s", mon->monitor, mon->name != NULL ? mon->name : "",
+		mon->x, mon->y, mon->width, mon->height, mon->refresh_rate,
+		item->next != NULL ? "," : "");
 	}
+	buffer_printf(&ipc_reply, "]\n");
+}
 
-	set_focused(focused_win);
+static void
+ipc_query_groups(uint32_t *d)
+{
+	bool first = true;
+	uint32_t i;
+	(void)(d);
 
-	xcb_flush(conn);
+	buffer_printf(&ipc_reply, "{\"groups\":%u,\"last\":%d,\"active\":[",
+			conf.groups, last_group);
+	for (i = 0; i < conf.groups; i++) {
+		if (!group_in_use[i])
+			continue;
+		buffer_printf(&ipc_reply, first ? "%u" : ",%u", i);
+		first = false;
+	}
+	buffer_printf(&ipc_reply, "]}\n");
 }
 
 static void
-ipc_window_ver_maximize(uint32_t *d)
+ipc_query_focus_history(uint32_t *d)
 {
+	struct list_item *item;
 	(void)(d);
-	int16_t mon_x, mon_y;
-	uint16_t mon_h;
 
-	if (focused_win == NULL)
-		return;
+	/* most recently focused first */
+	buffer_printf(&ipc_reply, "[");
+	for (item = focus_list; item != NULL; item = item->next)
+		buffer_printf(&ipc_reply, "\"0x%08x\"%s",
+				((struct client *)item->data)->window,
+				item->next != NULL ? "," : "");
+	buffer_printf(&ipc_reply, "]\n");
+}
 
-	if (focused_win->vmaxed) {
-		reset_window(focused_win);
-	} else {
-		get_monitor_size(focused_win, &mon_x, &mon_y, NULL, &mon_h);
-		vmaximize_window(focused_win, mon_y, mon_h);
+/*
+ * Run an ipc command. Handlers may set ipc_status and append a payload
+ * to ipc_reply.
+ */
+
+static enum IPCStatus
+run_ipc_command(uint32_t command, uint32_t *args)
+{
+	struct list_item *item, *next;
+	struct client *client;
+	uint32_t *target = args + IPC_MIN_ARGS;
+	bool found = false;
+
+	if (command >= NR_IPC_COMMANDS || ipc_handlers[command] == NULL)
+		return IPCStatusUnknownCommand;
+
+	ipc_status = IPCStatusOk;
+	if (!command_takes_target(command) || target[0] == IPCTargetFocused) {
+		/* like a window given by id that isn't managed */
+		if (command_takes_target(command) && focused_win == NULL)
+			return IPCStatusNoWindow;
+		ipc_target = focused_win;
+		(ipc_handlers[command])(args);
+		ipc_target = NULL;
+		return ipc_status;
 	}
 
-	set_focused(focused_win);
+	switch (target[0]) {
+	case IPCTargetWindow:
+		ipc_target = find_client(&target[1]);
+		if (ipc_target == NULL)
+			return IPCStatusNoWindow;
+		(ipc_handlers[command])(args);
+		break;
+	case IPCTargetGroup:
+	case IPCTargetAll:
+		for (item = win_list; item != NULL; item = next) {
+			next = item->next;
+			client = item->data;
+			/* numbered like in the group commands */
+			if (target[0] == IPCTargetGroup && client->group != target[1] - 1)
+				continue;
+			ipc_target = client;
+			(ipc_handlers[command])(args);
+			found = true;
+		}
+		if (!found)
+			ipc_status = IPCStatusNoWindow;
+		break;
+	default:
+		ipc_status = IPCStatusBadArguments;
+		break;
+	}
 
-	xcb_flush(conn);
+	ipc_target = NULL;
+	return ipc_status;
 }
 
+/*
+ * Listen for ipc clients on a unix socket. Without it, waitron falls back
+ * to client messages.
+ */
+
 static void
-ipc_window_monocle(uint32_t *d)
+ipc_listen(void)
 {
-	(void)(d);
-	int16_t mon_x, mon_y;
-	uint16_t mon_w, mon_h;
+	struct sockaddr_un addr;
+	mode_t mask;
+	int ret;
 
-	if (focused_win == NULL)
+	if (!get_ipc_socket_path(ipc_path, sizeof(ipc_path))) {
+		warnx("ipc socket path too long");
 		return;
+	}
 
-	if (focused_win->monocled) {
-		reset_window(focused_win);
-	} else {
-		get_monitor_size(focused_win, &mon_x, &mon_y, &mon_w, &mon_h);
-		monocle_window(focused_win, mon_x, mon_y, mon_w, mon_h);
+	ipc_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (ipc_fd == -1) {
+		warn("couldn't create the ipc socket");
+		return;
+	}
+	fcntl(ipc_fd, F_SETFL, fcntl(ipc_fd, F_GETFL) | O_NONBLOCK);
+	fcntl(ipc_fd, F_SETFD, FD_CLOEXEC);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", ipc_path);
+
+	/* we own the display, so a socket of ours left there is stale */
+	if (!remove_stale_file(ipc_path, true)) {
+		warnx("%s isn't ours, not listening for ipc clients", ipc_path);
+		close(ipc_fd);
+		ipc_fd = -1;
+		return;
 	}
 
-	set_focused(focused_win);
+	/* commands can spawn programs: only our user may connect */
+	mask = umask(077);
+	ret = bind(ipc_fd, (struct sockaddr *)&addr, sizeof(addr));
+	umask(mask);
+	if (ret == -1 || listen(ipc_fd, SOMAXCONN) == -1) {
+		warn("couldn't listen on %s", ipc_path);
+		close(ipc_fd);
+		ipc_fd = -1;
+		return;
+	}
 
-	xcb_flush(conn);
+	loop_add_fd(&loop, ipc_fd, POLLIN, ipc_accept);
+	/* let the rc script and its children find us */
+	setenv(IPC_SOCKET_ENV, ipc_path, 1);
+	DMSG("listening on %s\n", ipc_path);
 }
 
 static void
-ipc_window_close(uint32_t *d)
+ipc_accept(int fd, short revents)
 {
-	(void)(d);
-	close_window(focused_win);
+	struct ipc_connection *c;
+	struct list_item *item;
+	int cfd;
+	(void)(revents);
+
+	while ((cfd = accept(fd, NULL, NULL)) != -1) {
+		if (!is_peer_ours(cfd)) {
+			DMSG("refused an ipc client of another user\n");
+			close(cfd);
+			continue;
+		}
+
+		fcntl(cfd, F_SETFL, fcntl(cfd, F_GETFL) | O_NONBLOCK);
+		fcntl(cfd, F_SETFD, FD_CLOEXEC);
+
+		c = calloc(1, sizeof(struct ipc_connection));
+		item = c != NULL ? list_add_item(&ipc_connections) : NULL;
+		if (item == NULL || !loop_add_fd(&loop, cfd, POLLIN, ipc_handle)) {
+			if (item != NULL)
+				list_delete_item(&ipc_connections, item);
+			free(c);
+			close(cfd);
+			continue;
+		}
+
+		c->fd = cfd;
+		c->item = item;
+		item->data = c;
+	}
 }
 
-static void
-ipc_window_put_in_grid(uint32_t *d)
+static struct ipc_connection *
+find_ipc_connection(int fd)
 {
-	uint16_t grid_width, grid_height;
-	uint16_t grid_x, grid_y;
-	uint16_t occ_w, occ_h;
-	const uint16_t m1 = 16U, m2 = 0xffffU;
+	struct list_item *item;
 
-	DMSG("data[4] = %d\n", d[4]);
-	grid_width  = d[0] >> m1;
-	grid_height = d[0] & m2;
-	grid_x      = d[1] >> m1;
-	grid_y      = d[1] & m2;
-	occ_w       = d[2] >> m1;
-	occ_h       = d[2] & m2;
+	for (item = ipc_connections; item != NULL; item = item->next)
+		if (((struct ipc_connection *)item->data)->fd == fd)
+			return item->data;
 
-	if (focused_win == NULL || grid_x >= grid_width || grid_y >= grid_height)
-		return;
+	return NULL;
+}
 
-	grid_window(focused_win, grid_width, grid_height, grid_x, grid_y, occ_w, occ_h);
+static void
+ipc_close(struct ipc_connection *c)
+{
+	transaction_discard(c);
+	loop_remove_fd(&loop, c->fd);
+	close(c->fd);
+	buffer_free(&c->in);
+	buffer_free(&c->out);
+	list_delete_item(&ipc_connections, c->item);
+	free(c);
 }
 
 static void
-ipc_window_move_in_grid(uint32_t *d)
+ipc_handle(int fd, short revents)
 {
-	uint16_t x, y;
+	struct ipc_connection *c = find_ipc_connection(fd);
 
-	if (focused_win == NULL)
+	if (c == NULL)
 		return;
 
-	x = d[2];
-	y = d[3];
+	/* the peer is gone: only the last replies are left to send */
+	if (c->closing) {
+		if ((revents & (POLLHUP | POLLERR)) || !ipc_write(c) || c->out.len == 0)
+			ipc_close(c);
+		return;
+	}
 
-	if (d[0] == IPC_MUL_MINUS)
-		x = -x;
-	if (d[1] == IPC_MUL_MINUS)
-		y = -y;
+	/* a paused peer that hung up can't get its replies */
+	if (c->paused && (revents & (POLLHUP | POLLERR))) {
+		c->closing = true;
+		loop_set_fd_events(&loop, c->fd, 0);
+		return;
+	}
 
-	move_grid_window(focused_win, x, y);
+	if ((revents & POLLOUT) && !ipc_write(c)) {
+		ipc_close(c);
+		return;
+	}
+	if ((revents & (POLLIN | POLLHUP | POLLERR))
+			|| (c->paused && c->out.len <= IPC_MAX_QUEUED))
+		ipc_read(c);
 }
 
+/*
+ * Read what the client sent, run every complete request and queue the
+ * replies. On end of file or malformed input, the connection is closed
+ * once its replies are sent. A client with too many replies queued is
+ * paused: it isn't read from and its requests wait until ipc_write has
+ * sent enough.
+ */
+
 static void
-ipc_window_resize_in_grid(uint32_t *d)
-{
-	uint16_t x, y;
+ipc_read(struct ipc_connection *c)
+{
+	struct ipc_request_header req;
+	struct ipc_reply_header rep;
+	uint32_t args[IPC_MAX_ARGS];
+	char buf[4096];
+	ssize_t n;
+	bool eof = false;
+
+	c->paused = c->out.len > IPC_MAX_QUEUED;
+	if (!c->paused) {
+		while ((n = read(c->fd, buf, sizeof(buf))) > 0)
+			if (!buffer_append(&c->in, buf, n))
+				eof = true;
+		if (n == 0 || (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+			eof = true;
+	}
 
-	if (focused_win == NULL)
-		return;
+	while (c->in.len >= sizeof(req)) {
+		if (c->out.len > IPC_MAX_QUEUED) {
+			c->paused = true;
+			break;
+		}
 
-	x = d[2];
-	y = d[3];
+		memcpy(&req, c->in.data, sizeof(req));
+		if (req.length > IPC_MAX_ARGS) {
+			eof = true;
+			break;
+		}
+		if (c->in.len < sizeof(req) + req.length * sizeof(uint32_t))
+			break;
 
-	if (d[0] == IPC_MUL_MINUS)
-		x = -x;
-	if (d[1] == IPC_MUL_MINUS)
-		y = -y;
+		memset(args, 0, sizeof(args));
+		memcpy(args, c->in.data + sizeof(req), req.length * sizeof(uint32_t));
+		buffer_consume(&c->in, sizeof(req) + req.length * sizeof(uint32_t));
+
+		ipc_reply.len = 0;
+		ipc_current = c;
+		if (c->transaction.active
+				&& req.command != IPCTransactionBegin
+				&& req.command != IPCTransactionCommit
+				&& req.command != IPCTransactionAbort)
+			rep.status = transaction_queue(c, req.command, req.length, args);
+		else
+			rep.status = run_ipc_command(req.command, args);
+		ipc_current = NULL;
+		rep.id = req.id;
+		rep.length = ipc_reply.len;
+		buffer_append(&c->out, &rep, sizeof(rep));
+		buffer_append(&c->out, ipc_reply.data, ipc_reply.len);
+		ipc_reply.len = 0;
+		DMSG("ipc request %u: command %u, status %u\n", req.id, req.command, rep.status);
+	}
 
-	resize_grid_window(focused_win, x, y);
+	/*
+	 * Replies are sent by ipc_flush at the end of the event batch. A
+	 * paused client reads end of file again once it is resumed.
+	 */
+	if (c->paused) {
+		loop_set_fd_events(&loop, c->fd, POLLOUT);
+	} else if (eof) {
+		/* the peer may only have closed its writing end */
+		c->closing = true;
+		loop_set_fd_events(&loop, c->fd, 0);
+	} else {
+		loop_set_fd_events(&loop, c->fd, POLLIN);
+	}
 }
 
-static void
-ipc_window_snap(uint32_t *d)
-{
-	enum position pos = d[0];
-	snap_window(focused_win, pos);
-}
+/*
+ * Send as much of the queued replies as the socket takes. Returns false
+ * if the peer can't be written to anymore.
+ */
 
-static
-void ipc_window_cycle(uint32_t *d)
+static bool
+ipc_write(struct ipc_connection *c)
 {
-	(void)(d);
+	ssize_t n;
 
-	cycle_window(focused_win);
+	while (c->out.len > 0) {
+		n = send(c->fd, c->out.data, c->out.len, MSG_NOSIGNAL);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if (n <= 0)
+			return false;
+		buffer_consume(&c->out, n);
+	}
+
+	/*
+	 * A paused client waits for POLLOUT only: to send the rest, or, once
+	 * enough is sent, to have ipc_handle run its waiting requests. So
+	 * does a closing one, until its replies are sent.
+	 */
+	if (c->paused || c->closing)
+		loop_set_fd_events(&loop, c->fd, POLLOUT);
+	else
+		loop_set_fd_events(&loop, c->fd, c->out.len > 0 ? POLLIN | POLLOUT : POLLIN);
+	return true;
 }
 
-static
-void ipc_window_rev_cycle(uint32_t *d)
+/*
+ * Queue an event for every connection subscribed to it. A subscriber
+ * that doesn't keep up loses events instead of growing its queue; the
+ * next event it gets says how many.
+ */
+
+static void
+ipc_emit(enum IPCEvent type, uint32_t id, int32_t x, int32_t y,
+		uint32_t width, uint32_t height)
 {
-	(void)(d);
+	struct ipc_reply_header rep;
+	struct ipc_event event;
+	struct ipc_connection *c;
+	struct list_item *item;
 
-	rcycle_window(focused_win);
+	rep.length = sizeof(event);
+	rep.id = IPC_EVENT_ID;
+	rep.status = type;
+	event.id = id;
+	event.x = x;
+	event.y = y;
+	event.width = width;
+	event.height = height;
+
+	for (item = ipc_connections; item != NULL; item = item->next) {
+		c = item->data;
+		if (!(c->events & (1 << type)) || c->closing)
+			continue;
+
+		if (c->out.len + sizeof(rep) + sizeof(event) > IPC_MAX_QUEUED_EVENTS) {
+			c->dropped++;
+			continue;
+		}
+
+		event.dropped = c->dropped;
+		if (buffer_append(&c->out, &rep, sizeof(rep))
+				&& buffer_append(&c->out, &event, sizeof(event)))
+			c->dropped = 0;
+		else
+			c->dropped++;
+	}
 }
 
+/*
+ * Send the replies and events queued during the event batch. A
+ * connection whose peer went away is closed once all its replies are
+ * sent; until then ipc_handle sends the rest.
+ */
+
 static void
-ipc_window_cardinal_focus(uint32_t *d)
+ipc_flush(void)
 {
-	uint32_t mode = d[0];
-	cardinal_focus(mode);
+	struct ipc_connection *c;
+	struct list_item *item, *next;
+
+	for (item = ipc_connections; item != NULL; item = next) {
+		next = item->next;
+		c = item->data;
+		if ((c->out.len > 0 && !ipc_write(c))
+				|| (c->closing && c->out.len == 0))
+			ipc_close(c);
+	}
 }
 
+/*
+ * Create the state table and map it. Without it, readers have to use the
+ * query commands.
+ */
+
 static void
-ipc_window_cycle_in_group(uint32_t *d)
+state_open(void)
 {
-	(void)(d);
+	void *map;
+	int fd;
 
-	if (focused_win == NULL)
+	if (!get_ipc_state_path(state_path, sizeof(state_path))) {
+		warnx("state table path too long");
 		return;
+	}
 
-	cycle_window_in_group(focused_win);
-}
-static void
-ipc_window_rev_cycle_in_group(uint32_t *d)
-{
-	(void)(d);
+	/*
+	 * The path may be in a directory other users can write to: never
+	 * follow or reuse a file someone else put there.
+	 */
+	if (!remove_stale_file(state_path, false)) {
+		warnx("%s isn't ours, not publishing the state table", state_path);
+		return;
+	}
 
-	rcycle_window_in_group(focused_win);
-}
+	fd = open(state_path, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC,
+			0600);
+	if (fd == -1) {
+		warn("couldn't create %s", state_path);
+		return;
+	}
 
-static void
-ipc_window_focus(uint32_t *d)
-{
-	struct client *client = find_client(&d[0]);
+	if (ftruncate(fd, sizeof(struct ipc_state)) == -1) {
+		warn("couldn't create %s", state_path);
+		close(fd);
+		unlink(state_path);
+		return;
+	}
 
-	if (client != NULL)
-		set_focused(client);
-}
+	map = mmap(NULL, sizeof(struct ipc_state), PROT_READ | PROT_WRITE,
+			MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		warn("couldn't map %s", state_path);
+		unlink(state_path);
+		return;
+	}
 
-static void
-ipc_window_focus_last(uint32_t *d)
-{
-	(void)(d);
-	if (focused_win != NULL)
-		set_focused_last_best();
+	state_table = map;
+	setenv(IPC_STATE_ENV, state_path, 1);
+	DMSG("state table at %s\n", state_path);
 }
 
-static void
-ipc_group_add_window(uint32_t *d)
-{
-	if (focused_win != NULL)
-		group_add_window(focused_win, d[0] - 1);
-}
+/*
+ * Build the state table and write it under the seqlock if it changed.
+ */
 
 static void
-ipc_group_remove_window(uint32_t *d)
+state_publish(void)
 {
-	(void)(d);
-	if (focused_win != NULL)
-		group_remove_window(focused_win);
-}
+	struct monitor *mons[IPC_STATE_MAX_MONITORS];
+	struct ipc_state *st = &state_next;
+	struct ipc_state_client *sc;
+	struct ipc_state_monitor *sm;
+	struct list_item *item;
+	struct client *client;
+	struct monitor *mon;
+	uint32_t i;
 
-static void
-ipc_group_remove_all_windows(uint32_t *d)
-{
-	group_remove_all_windows(d[0] - 1);
-}
+	if (state_table == NULL)
+		return;
 
-static void
-ipc_group_activate(uint32_t *d)
-{
-	group_activate(d[0] - 1);
-}
+	memset(st, 0, sizeof(*st));
+	st->magic = IPC_STATE_MAGIC;
+	st->version = IPC_STATE_VERSION;
+	st->size = sizeof(*st);
+	st->focused = focused_win != NULL ? focused_win->window : 0;
 
-static void
-ipc_group_deactivate(uint32_t *d)
-{
-	group_deactivate(d[0] - 1);
-}
+	for (item = mon_list; item != NULL; item = item->next) {
+		mon = item->data;
+		st->total_monitors++;
+		if (st->nr_monitors == IPC_STATE_MAX_MONITORS)
+			continue;
+		mons[st->nr_monitors] = mon;
+		sm = &st->monitors[st->nr_monitors++];
+		sm->output = mon->monitor;
+		sm->x = mon->x;
+		sm->y = mon->y;
+		sm->width = mon->width;
+		sm->height = mon->height;
+		sm->refresh_rate = mon->refresh_rate;
+		if (mon->name != NULL)
+			snprintf(sm->name, sizeof(sm->name), "%s", mon->name);
+	}
 
-static void
-ipc_group_toggle(uint32_t *d)
-{
-	group_toggle(d[0] - 1);
-}
+	for (item = win_list; item != NULL; item = item->next) {
+		client = item->data;
+		st->total_clients++;
+		if (st->nr_clients == IPC_STATE_MAX_CLIENTS)
+			continue;
+		sc = &st->clients[st->nr_clients++];
+		sc->window = client->window;
+		sc->x = client->geom.x;
+		sc->y = client->geom.y;
+		sc->width = client->geom.width;
+		sc->height = client->geom.height;
+		sc->group = client->group;
+		sc->mapped = client->mapped;
+		if (client->maxed) sc->state = IPCStateMaxed;
+		else if (client->hmaxed) sc->state = IPCStateHMaxed;
+		else if (client->vmaxed) sc->state = IPCStateVMaxed;
+		else if (client->monocled) sc->state = IPCStateMonocled;
+		else if (client->gridded) sc->state = IPCStateGridded;
+		else sc->state = IPCStateNormal;
+		sc->monitor = 0xffffffff;
+		for (i = 0; i < st->nr_monitors; i++)
+			if (mons[i] == client->monitor)
+				sc->monitor = i;
+	}
 
-static void
-ipc_group_activate_specific(uint32_t *d)
-{
-	group_activate_specific(d[0] - 1);
-}
+	st->nr_groups = conf.groups;
+	st->last_group = last_group;
+	for (i = 0; i < conf.groups && i < IPC_STATE_MAX_GROUPS; i++)
+		st->active_groups[i] = group_in_use[i];
 
-static void
-ipc_wm_quit(uint32_t *d)
-{
-	uint32_t code = d[0];
-	halt = true;
-	exit_code = code;
+	/* readers may be watching seq, don't bump it for nothing */
+	st->seq = state_table->seq;
+	if (memcmp(st, state_table, sizeof(*st)) == 0)
+		return;
+
+	ipc_state_write(state_table, st);
 }
 
 static void
@@ -3317,6 +5881,16 @@ ipc_wm_config(uint32_t *d)
 		ungrab_buttons();
 		grab_buttons();
 		break;
+	case IPCConfigEnableFramePacing:
+		conf.frame_pacing = d[1];
+		break;
+	case IPCConfigHideMode:
+		if (d[1] != HIDE_UNMAP && d[1] != HIDE_OFFSCREEN) {
+			ipc_status = IPCStatusBadArguments;
+			return;
+		}
+		conf.hide_mode = d[1];
+		break;
 	case IPCConfigClickToFocus:
 		if (d[1] == UINT32_MAX)
 			conf.click_to_focus = -1;
@@ -3529,6 +6103,10 @@ track_pointer(struct client *client, enum pointer_action pac, xcb_point_t pos)
 	struct window_geom geom = client->geom;
 
 	xcb_generic_event_t *ev = NULL;
+	xcb_generic_event_t *pending = NULL;
+	struct timespec last_update = {0, 0};
+	struct monitor *mon;
+	int timeout;
 
 	bool grabbing = true;
 	struct client *grabbed = client;
@@ -3538,11 +6116,33 @@ track_pointer(struct client *client, enum pointer_action pac, xcb_point_t pos)
 
 	do {
 		free(ev);
-		while ((ev = xcb_wait_for_event(conn)) == NULL)
-			xcb_flush(conn);
+		if (pending != NULL) {
+			ev = pending;
+			pending = NULL;
+		} else {
+			while ((ev = xcb_wait_for_event(conn)) == NULL)
+				xcb_flush(conn);
+		}
 		uint8_t resp = EVENT_MASK(ev->response_type);
 
 		if (resp == XCB_MOTION_NOTIFY) {
+			/* act only on the newest position */
+			ev = newest_motion(ev, &pending);
+
+			/* don't update the window more often than the monitor refreshes */
+			mon = find_monitor_by_coord(((xcb_motion_notify_event_t *)ev)->root_x,
+					((xcb_motion_notify_event_t *)ev)->root_y);
+			while (conf.frame_pacing && pending == NULL && mon != NULL
+					&& (timeout = frame_time_left(&last_update, mon->refresh_rate)) > 0) {
+				struct pollfd pfd = { xcb_get_file_descriptor(conn), POLLIN, 0 };
+				if (poll(&pfd, 1, timeout) <= 0)
+					break;
+				ev = newest_motion(ev, &pending);
+				if (xcb_connection_has_error(conn))
+					break;
+			}
+			clock_gettime(CLOCK_MONOTONIC, &last_update);
+
 			xcb_motion_notify_event_t *e = (xcb_motion_notify_event_t *)ev;
 			DMSG("tracking window by mouse root_x = %d  root_y = %d  posx = %d  posy = %d\n", e->root_x, e->root_y, pos.x, pos.y);
 			int16_t dx = e->root_x - pos.x;
@@ -3554,6 +6154,7 @@ track_pointer(struct client *client, enum pointer_action pac, xcb_point_t pos)
 				client->geom.x = geom.x + dx;
 				client->geom.y = geom.y + dy;
 				teleport_window(client->window, client->geom.x, client->geom.y);
+				end_event_batch();
 			} else if (pac == POINTER_ACTION_RESIZE_SIDE || pac == POINTER_ACTION_RESIZE_CORNER) {
 
 				DMSG("dx: %d\tdy: %d\n", dx, dy);
@@ -3624,21 +6225,73 @@ track_pointer(struct client *client, enum pointer_action pac, xcb_point_t pos)
 
 				resize_window_absolute(client->window, client->geom.width, client->geom.height);
 				teleport_window(client->window, client->geom.x, client->geom.y);
-				xcb_flush(conn);
+				end_event_batch();
 			}
 		} else if (resp == XCB_BUTTON_RELEASE) {
 
 			grabbing = false;
 		} else {
-			if (events[resp] != NULL)
-				(events[resp])(ev);
+			/* the notifies of our own moves are ignored here too */
+			handle_event(ev);
 		}
 	} while (grabbing && grabbed != NULL);
 	free(ev);
+	/* an event queued behind the button release still needs handling */
+	if (pending != NULL) {
+		handle_event(pending);
+		free(pending);
+	}
 
+	DMSG("%u motion events coalesced so far\n", motion_coalesced);
 	xcb_ungrab_pointer(conn, XCB_CURRENT_TIME);
 }
 
+/*
+ * Replace a motion event with the newest one already received.
+ * The first other event found is returned in pending.
+ */
+
+static xcb_generic_event_t *
+newest_motion(xcb_generic_event_t *ev, xcb_generic_event_t **pending)
+{
+	xcb_generic_event_t *next;
+
+	while ((next = xcb_poll_for_event(conn)) != NULL) {
+		if (EVENT_MASK(next->response_type) != XCB_MOTION_NOTIFY) {
+			*pending = next;
+			break;
+		}
+		free(ev);
+		ev = next;
+		motion_coalesced++;
+	}
+
+	return ev;
+}
+
+/*
+ * Milliseconds until a frame at refresh_rate (in mHz) has passed since last.
+ */
+
+static int
+frame_time_left(struct timespec *last, uint32_t refresh_rate)
+{
+	struct timespec now;
+	int64_t elapsed, frame;
+
+	if (refresh_rate == 0)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = (now.tv_sec - last->tv_sec) * 1000000LL
+		+ (now.tv_nsec - last->tv_nsec) / 1000;
+	frame = 1000000000LL / refresh_rate;
+
+	if (elapsed >= frame)
+		return 0;
+	return (frame - elapsed + 999) / 1000;
+}
+
 static void
 grab_buttons(void)
 {
@@ -3663,6 +6316,154 @@ ungrab_buttons(void)
 	}
 }
 
+/*
+ * Grab a key on the root window, with any of the lock modifiers on too.
+ */
+
+static void
+grab_key(struct key key)
+{
+	uint16_t locks[] = { num_lock, caps_lock, scroll_lock };
+	uint16_t modifiers;
+	xcb_keycode_t *keycodes;
+
+	keycodes = xcb_key_symbols_get_keycode(keysyms, key.keysym);
+	if (keycodes == NULL)
+		return;
+
+	for (xcb_keycode_t *k = keycodes; *k != XCB_NO_SYMBOL; k++) {
+		for (int i = 0; i < 1 << 3; i++) {
+			modifiers = key.modifiers;
+			for (int j = 0; j < 3; j++)
+				if (i & (1 << j))
+					modifiers |= locks[j];
+			xcb_grab_key(conn, true, scr->root, modifiers, *k,
+					XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC);
+		}
+	}
+	free(keycodes);
+}
+
+/*
+ * Grab the first key of every binding, and only those.
+ */
+
+static void
+grab_keys(void)
+{
+	struct list_item *item;
+
+	xcb_ungrab_key(conn, XCB_GRAB_ANY, scr->root, XCB_MOD_MASK_ANY);
+	for (item = bindings; item != NULL; item = item->next)
+		grab_key(((struct binding *)item->data)->chain[0]);
+}
+
+/*
+ * Checks the chain at the start of the arguments of bind and unbind.
+ */
+
+static bool
+valid_chain(uint32_t *d)
+{
+	return d[0] >= 1 && d[0] <= IPC_MAX_CHORD && d[1] < d[0];
+}
+
+static bool
+chain_equal(struct binding *b, uint32_t *d)
+{
+	if (b->nr_keys != d[0])
+		return false;
+	for (uint32_t i = 0; i < b->nr_keys; i++)
+		if (b->chain[i].modifiers != d[2 + 2 * i] || b->chain[i].keysym != d[3 + 2 * i])
+			return false;
+
+	return true;
+}
+
+/*
+ * Returns true if there were bindings on the chain.
+ */
+
+static bool
+remove_bindings(uint32_t *d)
+{
+	struct list_item *item, *next;
+	bool found = false;
+
+	for (item = bindings; item != NULL; item = next) {
+		next = item->next;
+		if (chain_equal(item->data, d)) {
+			free_binding(item->data);
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+static void
+free_binding(struct binding *b)
+{
+	list_delete_item(&bindings, b->item);
+	free(b->args);
+	free(b);
+}
+
+static void
+run_binding(struct binding *b)
+{
+	uint32_t args[IPC_MAX_ARGS];
+
+	memset(args, 0, sizeof(args));
+	memcpy(args, b->args, b->nr_args * sizeof(uint32_t));
+	if (run_ipc_command(b->command, args) != IPCStatusOk) {
+		DMSG("bound command %u failed\n", b->command);
+	}
+	ipc_reply.len = 0;
+}
+
+/*
+ * Take the whole keyboard while a chain is typed, so its next key comes
+ * to us whatever it is. Unless the chain is locked, it times out.
+ */
+
+static void
+chord_begin(void)
+{
+	xcb_grab_keyboard_cookie_t cookie;
+
+	if (chord_timer != 0)
+		loop_cancel_timer(&loop, chord_timer);
+	chord_timer = chord_locked ? 0 : loop_add_timer(&loop, CHORD_TIMEOUT, chord_expire, NULL);
+
+	cookie = xcb_grab_keyboard(conn, true, scr->root, XCB_CURRENT_TIME,
+			XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC);
+	xcb_discard_reply(conn, cookie.sequence);
+}
+
+static void
+chord_end(void)
+{
+	if (chord_timer != 0)
+		loop_cancel_timer(&loop, chord_timer);
+	chord_timer = 0;
+
+	if (chord_len > 0)
+		xcb_ungrab_keyboard(conn, XCB_CURRENT_TIME);
+	chord_len = 0;
+	chord_locked = false;
+}
+
+static void
+chord_expire(void *data)
+{
+	(void)(data);
+
+	DMSG("key chain timed out\n");
+	chord_timer = 0;
+	chord_end();
+}
+
 static void
 usage(char *name)
 {
@@ -3706,30 +6507,159 @@ load_defaults(void)
 	conf.pointer_actions[BUTTON_RIGHT]  = DEFAULT_RIGHT_BUTTON_ACTION;
 	conf.pointer_modifier = POINTER_MODIFIER;
 	conf.click_to_focus = CLICK_TO_FOCUS_BUTTON;
+	conf.frame_pacing = FRAME_PACING;
+	conf.hide_mode = HIDE_MODE;
 }
 
+/*
+ * Executable rc files are run as scripts. Other files are read as waitron
+ * commands, one per line, and applied right away.
+ */
+
 static void
 load_config(char *config_path)
 {
+	if (access(config_path, X_OK) != 0) {
+		read_config_file(config_path);
+		return;
+	}
+
 	int f = fork();
 	if (f == 0) {
+		reset_signals();
 		setsid();
 		DMSG("loading %s\n", config_path);
 		execl(config_path, config_path, NULL);
-		err(EXIT_FAILURE, "couldn't load config file");
+		/* don't run our atexit handlers in the child */
+		warn("couldn't load config file");
+		_exit(EXIT_FAILURE);
 	} else if (f == -1) {
 		err(EXIT_FAILURE, NULL);
 	}
 }
 
-void
-handle_child(int sig)
+static void
+read_config_file(char *config_path)
+{
+	uint32_t data[COMMAND_WORDS];
+	char *argv[MAX_COMMAND_ARGS];
+	char *line = NULL;
+	size_t size = 0;
+	unsigned int lineno = 0;
+	FILE *f;
+	int argc, skip;
+
+	f = fopen(config_path, "r");
+	if (f == NULL) {
+		warn("couldn't load config file %s", config_path);
+		return;
+	}
+
+	while (getline(&line, &size, f) != -1) {
+		lineno++;
+		argc = split_line(line, argv, MAX_COMMAND_ARGS);
+		/* so lines copied from rc scripts work too */
+		skip = argc > 0 && strcmp(argv[0], __NAME_CLIENT__) == 0;
+		if (argc - skip == 0)
+			continue;
+
+		if (!encode_command(data, argc - skip, argv + skip)) {
+			warnx("%s:%u: skipped", config_path, lineno);
+			continue;
+		}
+		if (run_ipc_command(data[0], data + 1) != IPCStatusOk)
+			warnx("%s:%u: failed", config_path, lineno);
+		ipc_reply.len = 0;
+	}
+
+	free(line);
+	fclose(f);
+}
+
+/*
+ * Catch the signals we care about. Handlers only set a flag and wake up
+ * the main loop through a pipe; the work is done in read_signals.
+ */
+
+static void
+setup_signals(void)
+{
+	struct sigaction sa;
+	int i;
+
+	if (pipe(signal_pipe) == -1)
+		err(EXIT_FAILURE, "couldn't create the signal pipe");
+	for (i = 0; i < 2; i++) {
+		fcntl(signal_pipe[i], F_SETFL, fcntl(signal_pipe[i], F_GETFL) | O_NONBLOCK);
+		fcntl(signal_pipe[i], F_SETFD, FD_CLOEXEC);
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = handle_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGCHLD, &sa, NULL);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	loop_add_fd(&loop, signal_pipe[0], POLLIN, read_signals);
+}
+
+static void
+handle_signal(int sig)
+{
+	int saved_errno = errno;
+	char c = 0;
+	ssize_t n;
+
+	if (sig == SIGCHLD)
+		got_sigchld = 1;
+	else
+		got_sigterm = 1;
+
+	/* if the pipe is full, a wakeup is already pending */
+	n = write(signal_pipe[1], &c, 1);
+	(void)(n);
+	errno = saved_errno;
+}
+
+static void
+read_signals(int fd, short revents)
 {
-	if (sig == SIGCHLD) {
-		wait(NULL);
+	char buf[64];
+	(void)(revents);
+
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+
+	if (got_sigchld) {
+		got_sigchld = 0;
+		/* signals coalesce, so reap every child that exited */
+		while (waitpid(-1, NULL, WNOHANG) > 0)
+			;
+	}
+
+	if (got_sigterm) {
+		got_sigterm = 0;
+		halt = true;
 	}
 }
 
+/*
+ * Give a forked child the default signal handling back.
+ */
+
+static void
+reset_signals(void)
+{
+	sigset_t set;
+
+	signal(SIGCHLD, SIG_DFL);
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	sigemptyset(&set);
+	sigprocmask(SIG_SETMASK, &set, NULL);
+}
+
 int main(int argc, char *argv[])
 {
 	int opt;
@@ -3756,6 +6686,8 @@ int main(int argc, char *argv[])
 
 	if (setup() < 0)
 		errx(EXIT_FAILURE, "error connecting to X");
+	ipc_listen();
+	state_open();
 	/* if not set, get path of the rc file */
 	if (config_path[0] == '\0') {
 		char *xdg_home = getenv("XDG_CONFIG_HOME");
@@ -3766,10 +6698,11 @@ int main(int argc, char *argv[])
 					__NAME__, __CONFIG_NAME__);
 	}
 
-	signal(SIGCHLD, handle_child);
+	setup_signals();
 
 	/* execute config file */
 	load_config(config_path);
+	adopt_existing_windows();
 	run();
 
 	free(config_path);